@@ -0,0 +1,302 @@
+#include "aggregate_kernels.h"
+#include "simd.h"
+
+#include <limits>
+
+IntSummary::IntSummary() {
+  count = 0;
+  sum = 0;
+  min = numeric_limits<int>::max();
+  max = numeric_limits<int>::min();
+}
+
+FloatSummary::FloatSummary() {
+  count = 0;
+  sum = 0.0;
+  min = numeric_limits<float>::infinity();
+  max = -numeric_limits<float>::infinity();
+}
+
+// Add the sum, min and max of the values to the summary; counting is left to
+// count_bits. The float kernels return the sum of their block instead of
+// adding it, so the sums can be added pairwise.
+typedef void (*IntKernel)(const int*, const uint64_t*, unsigned, IntSummary&);
+typedef double (*FloatBlockKernel)(const float*, const uint64_t*, unsigned, FloatSummary&);
+
+// Floats are summed in blocks of this many values, and the block sums added
+// pairwise. A multiple of 64, so each block starts on a word of the bitmap.
+static const unsigned pairwise_block = 256;
+
+static inline bool is_valid(const uint64_t* valid, unsigned i) {
+  return (valid[i / 64] >> (i % 64) & 1) != 0;
+}
+
+static void scalar_ints(const int* values, const uint64_t* valid, unsigned count, IntSummary& summary) {
+  for (unsigned i = 0; i < count; ++i) {
+    int value = values[i];
+    summary.sum += value;  // NULLs are 0
+    if (!is_valid(valid, i))
+      continue;
+    if (value < summary.min)
+      summary.min = value;
+    if (value > summary.max)
+      summary.max = value;
+  }
+}
+
+static double scalar_float_block(const float* values, const uint64_t* valid, unsigned count, FloatSummary& summary) {
+  double sum = 0.0;
+  for (unsigned i = 0; i < count; ++i) {
+    float value = values[i];
+    sum += value;
+    if (!is_valid(valid, i))
+      continue;
+    if (value < summary.min)
+      summary.min = value;
+    if (value > summary.max)
+      summary.max = value;
+  }
+  return sum;
+}
+
+// Adds to the summary the smallest and largest value and the sum of each of
+// a SIMD kernel's lanes. Sums are wider than values, so they have their own
+// number of lanes.
+template <typename T, typename Summary, typename Sum>
+static void merge_lanes(const T* lows, const T* highs, unsigned lanes,
+                        const Sum* sums, unsigned sum_lanes, Summary& summary) {
+  for (unsigned i = 0; i < lanes; ++i) {
+    if (lows[i] < summary.min)
+      summary.min = lows[i];
+    if (highs[i] > summary.max)
+      summary.max = highs[i];
+  }
+  for (unsigned i = 0; i < sum_lanes; ++i)
+    summary.sum += sums[i];
+}
+
+template <typename Summary>
+static void merge_block(const Summary& block, Summary& summary) {
+  if (block.min < summary.min)
+    summary.min = block.min;
+  if (block.max > summary.max)
+    summary.max = block.max;
+}
+
+#ifdef SIMD_X86
+
+// The SIMD kernels handle whole words of 64 values and leave the rest to the
+// scalar ones. The bits of each vector's values in the bitmap are spread
+// into a mask with one lane per value, and NULL lanes are replaced with a
+// value that can't win min or max before comparing. Sums need no mask, as
+// NULLs are 0.
+
+TARGET_SSE2 static inline __m128i sse2_select(__m128i mask, __m128i a, __m128i b) {
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Sets the lanes whose bit is set in the low 4 bits of bits
+TARGET_SSE2 static inline __m128i sse2_lane_mask(uint64_t bits) {
+  __m128i lanes = _mm_set_epi32(8, 4, 2, 1);
+  __m128i spread = _mm_and_si128(_mm_set1_epi32(static_cast<int>(bits & 0xF)), lanes);
+  return _mm_cmpeq_epi32(spread, lanes);
+}
+
+TARGET_SSE2 static void sse2_ints(const int* values, const uint64_t* valid, unsigned count, IntSummary& summary) {
+  __m128i largest = _mm_set1_epi32(numeric_limits<int>::max());
+  __m128i smallest = _mm_set1_epi32(numeric_limits<int>::min());
+  __m128i zero = _mm_setzero_si128();
+  __m128i sums = zero;
+  __m128i low = largest;
+  __m128i high = smallest;
+  unsigned words = count / 64;
+  for (unsigned word = 0; word < words; ++word) {
+    const int* chunk = values + word * 64;
+    for (unsigned i = 0; i < 64; i += 4) {
+      __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk + i));
+      __m128i mask = sse2_lane_mask(valid[word] >> i);
+      __m128i candidate = sse2_select(mask, value, largest);
+      low = sse2_select(_mm_cmplt_epi32(candidate, low), candidate, low);
+      candidate = sse2_select(mask, value, smallest);
+      high = sse2_select(_mm_cmpgt_epi32(candidate, high), candidate, high);
+
+      // Sign-extend to 64 bits
+      __m128i sign = _mm_cmpgt_epi32(zero, value);
+      sums = _mm_add_epi64(sums, _mm_unpacklo_epi32(value, sign));
+      sums = _mm_add_epi64(sums, _mm_unpackhi_epi32(value, sign));
+    }
+  }
+
+  int lows[4], highs[4];
+  int64_t lane_sums[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lows), low);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(highs), high);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_sums), sums);
+  merge_lanes(lows, highs, 4, lane_sums, 2, summary);
+  scalar_ints(values + words * 64, valid + words, count - words * 64, summary);
+}
+
+TARGET_SSE2 static double sse2_float_block(const float* values, const uint64_t* valid, unsigned count, FloatSummary& summary) {
+  __m128 largest = _mm_set1_ps(numeric_limits<float>::infinity());
+  __m128 smallest = _mm_set1_ps(-numeric_limits<float>::infinity());
+  __m128d sum_low = _mm_setzero_pd();
+  __m128d sum_high = _mm_setzero_pd();
+  __m128 low = largest;
+  __m128 high = smallest;
+  unsigned words = count / 64;
+  for (unsigned word = 0; word < words; ++word) {
+    const float* chunk = values + word * 64;
+    for (unsigned i = 0; i < 64; i += 4) {
+      __m128 value = _mm_loadu_ps(chunk + i);
+      __m128 mask = _mm_castsi128_ps(sse2_lane_mask(valid[word] >> i));
+      low = _mm_min_ps(_mm_or_ps(_mm_and_ps(mask, value), _mm_andnot_ps(mask, largest)), low);
+      high = _mm_max_ps(_mm_or_ps(_mm_and_ps(mask, value), _mm_andnot_ps(mask, smallest)), high);
+      sum_low = _mm_add_pd(sum_low, _mm_cvtps_pd(value));
+      sum_high = _mm_add_pd(sum_high, _mm_cvtps_pd(_mm_movehl_ps(value, value)));
+    }
+  }
+
+  float lows[4], highs[4];
+  double lane_sums[4];
+  _mm_storeu_ps(lows, low);
+  _mm_storeu_ps(highs, high);
+  _mm_storeu_pd(lane_sums, sum_low);
+  _mm_storeu_pd(lane_sums + 2, sum_high);
+
+  FloatSummary block;
+  merge_lanes(lows, highs, 4, lane_sums, 4, block);
+  double sum = block.sum + scalar_float_block(values + words * 64, valid + words, count - words * 64, block);
+  merge_block(block, summary);
+  return sum;
+}
+
+// Sets the lanes whose bit is set in the low 8 bits of bits
+TARGET_AVX2 static inline __m256i avx2_lane_mask(uint64_t bits) {
+  __m256i lanes = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+  __m256i spread = _mm256_and_si256(_mm256_set1_epi32(static_cast<int>(bits & 0xFF)), lanes);
+  return _mm256_cmpeq_epi32(spread, lanes);
+}
+
+TARGET_AVX2 static void avx2_ints(const int* values, const uint64_t* valid, unsigned count, IntSummary& summary) {
+  __m256i largest = _mm256_set1_epi32(numeric_limits<int>::max());
+  __m256i smallest = _mm256_set1_epi32(numeric_limits<int>::min());
+  __m256i sums = _mm256_setzero_si256();
+  __m256i low = largest;
+  __m256i high = smallest;
+  unsigned words = count / 64;
+  for (unsigned word = 0; word < words; ++word) {
+    const int* chunk = values + word * 64;
+    for (unsigned i = 0; i < 64; i += 8) {
+      __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk + i));
+      __m256i mask = avx2_lane_mask(valid[word] >> i);
+      low = _mm256_min_epi32(low, _mm256_blendv_epi8(largest, value, mask));
+      high = _mm256_max_epi32(high, _mm256_blendv_epi8(smallest, value, mask));
+      sums = _mm256_add_epi64(sums, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(value)));
+      sums = _mm256_add_epi64(sums, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(value, 1)));
+    }
+  }
+
+  int lows[8], highs[8];
+  int64_t lane_sums[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lows), low);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(highs), high);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_sums), sums);
+  merge_lanes(lows, highs, 8, lane_sums, 4, summary);
+  scalar_ints(values + words * 64, valid + words, count - words * 64, summary);
+}
+
+TARGET_AVX2 static double avx2_float_block(const float* values, const uint64_t* valid, unsigned count, FloatSummary& summary) {
+  __m256 largest = _mm256_set1_ps(numeric_limits<float>::infinity());
+  __m256 smallest = _mm256_set1_ps(-numeric_limits<float>::infinity());
+  __m256d sum_low = _mm256_setzero_pd();
+  __m256d sum_high = _mm256_setzero_pd();
+  __m256 low = largest;
+  __m256 high = smallest;
+  unsigned words = count / 64;
+  for (unsigned word = 0; word < words; ++word) {
+    const float* chunk = values + word * 64;
+    for (unsigned i = 0; i < 64; i += 8) {
+      __m256 value = _mm256_loadu_ps(chunk + i);
+      __m256 mask = _mm256_castsi256_ps(avx2_lane_mask(valid[word] >> i));
+      low = _mm256_min_ps(_mm256_blendv_ps(largest, value, mask), low);
+      high = _mm256_max_ps(_mm256_blendv_ps(smallest, value, mask), high);
+      sum_low = _mm256_add_pd(sum_low, _mm256_cvtps_pd(_mm256_castps256_ps128(value)));
+      sum_high = _mm256_add_pd(sum_high, _mm256_cvtps_pd(_mm256_extractf128_ps(value, 1)));
+    }
+  }
+
+  float lows[8], highs[8];
+  double lane_sums[8];
+  _mm256_storeu_ps(lows, low);
+  _mm256_storeu_ps(highs, high);
+  _mm256_storeu_pd(lane_sums, sum_low);
+  _mm256_storeu_pd(lane_sums + 4, sum_high);
+
+  FloatSummary block;
+  merge_lanes(lows, highs, 8, lane_sums, 8, block);
+  double sum = block.sum + scalar_float_block(values + words * 64, valid + words, count - words * 64, block);
+  merge_block(block, summary);
+  return sum;
+}
+
+#endif  // SIMD_X86
+
+struct Kernels {
+  IntKernel ints;
+  FloatBlockKernel float_block;
+  const char* name;
+};
+
+static Kernels pick_kernels() {
+  Kernels kernels = { scalar_ints, scalar_float_block, "scalar" };
+#ifdef SIMD_X86
+  if (has_avx2()) {
+    kernels.ints = avx2_ints;
+    kernels.float_block = avx2_float_block;
+    kernels.name = "avx2";
+  } else if (has_sse2()) {
+    kernels.ints = sse2_ints;
+    kernels.float_block = sse2_float_block;
+    kernels.name = "sse2";
+  }
+#endif
+  return kernels;
+}
+
+// Picked when the library is loaded
+static const Kernels kernels = pick_kernels();
+
+// Splits the values in halves until they fit in a block, so each value goes
+// through about log2(count / pairwise_block) additions after its block's
+static double pairwise_sum(const float* values, const uint64_t* valid, unsigned count, FloatSummary& summary) {
+  if (count <= pairwise_block)
+    return kernels.float_block(values, valid, count, summary);
+  // Keep the halves whole words of the bitmap long
+  unsigned half = (count / 2 + 63) & ~63u;
+  return pairwise_sum(values, valid, half, summary) +
+         pairwise_sum(values + half, valid + half / 64, count - half, summary);
+}
+
+void summarize_ints(const int* values, const uint64_t* valid, unsigned count, IntSummary& summary) {
+  summary.count += count_bits(valid, count);
+  kernels.ints(values, valid, count, summary);
+}
+
+void summarize_floats(const float* values, const uint64_t* valid, unsigned count, FloatSummary& summary) {
+  summary.count += count_bits(valid, count);
+  summary.sum += pairwise_sum(values, valid, count, summary);
+}
+
+uint64_t count_bits(const uint64_t* bits, unsigned count) {
+  uint64_t result = 0;
+  unsigned words = count / 64;
+  for (unsigned word = 0; word < words; ++word)
+    result += popcount64(bits[word]);
+  if (count % 64 != 0)
+    result += popcount64(bits[words] & ((static_cast<uint64_t>(1) << (count % 64)) - 1));
+  return result;
+}
+
+const char* aggregate_kernels_name() {
+  return kernels.name;
+}
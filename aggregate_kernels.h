@@ -0,0 +1,53 @@
+#ifndef AGGREGATE_KERNELS_H_
+#define AGGREGATE_KERNELS_H_
+
+#include <cstdint>
+using namespace std;
+
+/** The count, sum, min and max of the non-NULL values in an int array. */
+struct IntSummary {
+  IntSummary();
+
+  int64_t count;
+  int64_t sum;
+  // Only meaningful if count isn't 0
+  int min;
+  int max;
+};
+
+/** The count, sum, min and max of the non-NULL values in a float array. */
+struct FloatSummary {
+  FloatSummary();
+
+  int64_t count;
+  double sum;
+  // Only meaningful if count isn't 0
+  float min;
+  float max;
+};
+
+/**
+ * Aggregation kernels used by Table and Column to sum, count and find the
+ * extremes of a column's array in one pass.
+ *
+ * Each kernel adds the \a count values starting at \a values to \a summary.
+ * Bit i of \a valid (64 values per word) is set if values[i] is not NULL;
+ * NULL values must be stored as 0, so they can be summed along with the rest.
+ * The count is a popcount of \a valid. Integer sums are kept in 64 bits, so
+ * they don't overflow. Floats are added in double precision, pairwise over
+ * blocks of a few hundred values, so the rounding error grows with the log
+ * of \a count rather than with \a count.
+ *
+ * An implementation is picked for the processor at hand when the library is
+ * loaded: AVX2, SSE2 or plain C++.
+ */
+void summarize_ints(const int* values, const uint64_t* valid, unsigned count, IntSummary& summary);
+void summarize_floats(const float* values, const uint64_t* valid, unsigned count, FloatSummary& summary);
+
+/** Returns the number of set bits among the first \a count bits of \a bits. */
+uint64_t count_bits(const uint64_t* bits, unsigned count);
+
+/** Returns the name of the kernels in use ("avx2", "sse2" or "scalar"). */
+const char* aggregate_kernels_name();
+
+#endif  // AGGREGATE_KERNELS_H_
@@ -0,0 +1,41 @@
+#include "binary_io.h"
+
+#include <cstring>
+
+static uint64_t rotate_left(uint64_t x, unsigned bits) {
+  return (x << bits) | (x >> (64 - bits));
+}
+
+static uint64_t read_word(const unsigned char* p) {
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+// A 64-bit hash in the style of xxHash: four lanes take 8-byte words in turn,
+// so their multiplies overlap, and are mixed together at the end
+uint64_t checksum(const void* data, size_t bytes) {
+  static const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+  static const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+
+  uint64_t lanes[4] = { prime1 + prime2, prime2, 0, 0 - prime1 };
+  size_t i = 0;
+  for (; i + 32 <= bytes; i += 32) {
+    for (unsigned lane = 0; lane < 4; ++lane)
+      lanes[lane] = rotate_left(lanes[lane] + read_word(p + i + lane * 8) * prime2, 31) * prime1;
+  }
+
+  uint64_t hash = static_cast<uint64_t>(bytes);
+  for (unsigned lane = 0; lane < 4; ++lane)
+    hash = rotate_left(hash ^ lanes[lane], 27) * prime1 + prime2;
+  for (; i + 8 <= bytes; i += 8)
+    hash = rotate_left(hash ^ read_word(p + i) * prime2, 27) * prime1;
+  for (; i < bytes; ++i)
+    hash = rotate_left(hash ^ p[i] * prime1, 11) * prime2;
+
+  hash ^= hash >> 33;
+  hash *= prime2;
+  hash ^= hash >> 29;
+  return hash;
+}
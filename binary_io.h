@@ -0,0 +1,32 @@
+#ifndef BINARY_IO_H_
+#define BINARY_IO_H_
+
+#include <string>
+#include <cstdint>
+using namespace std;
+
+/**
+ * Helpers shared by the binary files of the database: snapshots (see
+ * Snapshot) and the write-ahead log (see WriteAheadLog). Numbers are written
+ * in the byte order of the machine.
+ */
+
+/** Appends the bytes of \a value to \a out. */
+template <typename T>
+void put(string& out, T value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+/** Appends the size of \a value, then its characters, to \a out. */
+inline void put_string(string& out, const string& value) {
+  put<uint32_t>(out, value.size());
+  out.append(value);
+}
+
+/**
+ * A 64-bit hash of the \a bytes at \a data, for catching damaged files. It
+ * is not meant to stand up to deliberate tampering.
+ */
+uint64_t checksum(const void* data, size_t bytes);
+
+#endif  // BINARY_IO_H_
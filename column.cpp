@@ -0,0 +1,704 @@
+#include "column.h"
+#include "thread_pool.h"
+#include "aggregate_kernels.h"
+#include "simd.h"
+
+#include <cstdlib>
+#include <cerrno>
+#include <limits>
+#include <cstring>
+#include <algorithm>
+
+// Compares two byte strings like string::compare
+static int compare_bytes(const char* a, unsigned a_length, const char* b, unsigned b_length) {
+  unsigned length = min(a_length, b_length);
+  int result = length == 0 ? 0 : memcmp(a, b, length);
+  if (result != 0)
+    return result;
+  return a_length < b_length ? -1 : (b_length < a_length ? 1 : 0);
+}
+
+// "?" marks missing values in the data files
+static bool is_null_string(const string& value) {
+  return value == "NULL" || value == "?";
+}
+
+ColumnSummary::ColumnSummary() {
+  count = 0;
+  int_sum = 0;
+  float_sum = 0.0;
+  min_row = max_row = -1;
+}
+
+Column::Column(RecordType type) {
+  type_ = type;
+  garbage_ = 0;
+}
+
+Column::RecordType Column::type() const {
+  return type_;
+}
+
+bool Column::is_numeric() const {
+  return type_ == integer || type_ == floating;
+}
+
+unsigned Column::size() const {
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    return ints_.size();
+  case floating:
+    return floats_.size();
+  default:
+    return offsets_.size();
+  }
+}
+
+void Column::reserve(unsigned rows) {
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    ints_.reserve(rows);
+    break;
+  case floating:
+    floats_.reserve(rows);
+    break;
+  default:
+    offsets_.reserve(rows);
+    lengths_.reserve(rows);
+  }
+  valid_.reserve((rows + 63) / 64);
+}
+
+void Column::reserve_text(size_t bytes) {
+  blob_.reserve(blob_.size() + bytes);
+}
+
+void Column::append(const string& value) {
+  if (is_null_string(value) || (value.empty() && type_ != varchar)) {
+    append_null();
+    return;
+  }
+
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    ints_.push_back(Value::pack(type_, value));
+    break;
+  case floating: {
+    const char *begin = value.c_str();
+    char *end;
+    errno = 0;
+    double parsed = strtod(begin, &end);
+    if (end == begin || *end != '\0' || errno == ERANGE)
+      throw InvalidTypeError("Invalid floating point value: " + value);
+    floats_.push_back(static_cast<float>(parsed));
+    break;
+  }
+  default:
+    append_varchar(value);
+  }
+  push_valid(true);
+}
+
+void Column::append(const Value& value) {
+  if (value.is_null()) {
+    append_null();
+    return;
+  }
+
+  if (value.type() == type_) {
+    switch (type_) {
+    case integer:
+    case date:
+    case time:
+      ints_.push_back(value.packed_value());
+      push_valid(true);
+      return;
+    case floating:
+      floats_.push_back(value.float_value());
+      push_valid(true);
+      return;
+    default:
+      append(value.text());
+      return;
+    }
+  }
+
+  if (type_ == floating && value.type() == integer) {
+    floats_.push_back(static_cast<float>(value.packed_value()));
+    push_valid(true);
+  } else {
+    append(value.to_string());
+  }
+}
+
+void Column::append_null() {
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    ints_.push_back(0);
+    break;
+  case floating:
+    floats_.push_back(0.0f);
+    break;
+  default:
+    offsets_.push_back(blob_.size());
+    lengths_.push_back(0);
+  }
+  push_valid(false);
+}
+
+void Column::append(const Column& other, unsigned row) {
+  if (other.type_ != type_) {
+    if (other.is_null(row))
+      append_null();
+    else
+      append(other.get_string(row));
+    return;
+  }
+
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    ints_.push_back(other.ints_[row]);
+    break;
+  case floating:
+    floats_.push_back(other.floats_[row]);
+    break;
+  default:
+    offsets_.push_back(blob_.size());
+    lengths_.push_back(other.lengths_[row]);
+    blob_.append(other.blob_.data() + other.offsets_[row], other.lengths_[row]);
+  }
+  push_valid(!other.is_null(row));
+}
+
+void Column::append(const Column& other) {
+  unsigned old_size = size(), rows = other.size();
+  if (other.type_ != type_) {
+    for (unsigned row = 0; row < rows; ++row)
+      append(other, row);
+    return;
+  }
+
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    ints_.append(other.ints_.data(), rows);
+    break;
+  case floating:
+    floats_.append(other.floats_.data(), rows);
+    break;
+  default: {
+    unsigned base = blob_.size();
+    offsets_.reserve(old_size + rows);
+    for (unsigned row = 0; row < rows; ++row)
+      offsets_.push_back(base + other.offsets_[row]);
+    lengths_.append(other.lengths_.data(), rows);
+    blob_.append(other.blob_.data(), other.blob_.size());
+    garbage_ += other.garbage_;
+  }
+  }
+
+  // Shift the words of the other bitmap in after the last row
+  resize_valid(old_size + rows);
+  for (unsigned word = 0; word < other.valid_.size(); ++word) {
+    unsigned row = old_size + word * 64;
+    uint64_t bits = other.valid_[word];
+    valid_[row / 64] |= bits << (row % 64);
+    if (row % 64 != 0 && row / 64 + 1 < valid_.size())
+      valid_[row / 64 + 1] |= bits >> (64 - row % 64);
+  }
+}
+
+void Column::append_varchar(const string& value) {
+  offsets_.push_back(blob_.size());
+  lengths_.push_back(value.size());
+  blob_.append(value.data(), value.size());
+}
+
+void Column::pop_back() {
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    ints_.pop_back();
+    break;
+  case floating:
+    floats_.pop_back();
+    break;
+  default:
+    if (offsets_.back() + lengths_.back() == blob_.size())
+      blob_.resize(offsets_.back());
+    offsets_.pop_back();
+    lengths_.pop_back();
+  }
+  resize_valid(size());
+}
+
+void Column::clear() {
+  ints_.clear();
+  floats_.clear();
+  offsets_.clear();
+  lengths_.clear();
+  blob_.clear();
+  garbage_ = 0;
+  valid_.clear();
+}
+
+void Column::set(unsigned row, const string& value) {
+  // Reuse the parsing and error handling in append
+  append(value);
+  move_last_to(row);
+}
+
+void Column::set(unsigned row, const Value& value) {
+  append(value);
+  move_last_to(row);
+}
+
+void Column::move_last_to(unsigned row) {
+  set_valid(row, !is_null(size() - 1));
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    ints_[row] = ints_.back();
+    ints_.pop_back();
+    break;
+  case floating:
+    floats_[row] = floats_.back();
+    floats_.pop_back();
+    break;
+  default:
+    // The old value stays in the blob until it is compacted
+    garbage_ += lengths_[row];
+    offsets_[row] = offsets_.back();
+    lengths_[row] = lengths_.back();
+    offsets_.pop_back();
+    lengths_.pop_back();
+    if (garbage_ > blob_.size() / 2)
+      compact_blob();
+  }
+  resize_valid(size());
+}
+
+void Column::keep(const vector<bool>& keep_rows) {
+  unsigned kept = 0;
+  for (unsigned row = 0; row < keep_rows.size(); ++row) {
+    if (!keep_rows[row]) {
+      if (type_ == varchar)
+        garbage_ += lengths_[row];
+      continue;
+    }
+    set_valid(kept, !is_null(row));
+    switch (type_) {
+    case integer:
+    case date:
+    case time:
+      ints_[kept] = ints_[row];
+      break;
+    case floating:
+      floats_[kept] = floats_[row];
+      break;
+    default:
+      offsets_[kept] = offsets_[row];
+      lengths_[kept] = lengths_[row];
+    }
+    ++kept;
+  }
+
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    ints_.resize(kept);
+    break;
+  case floating:
+    floats_.resize(kept);
+    break;
+  default:
+    offsets_.resize(kept);
+    lengths_.resize(kept);
+    if (garbage_ > blob_.size() / 2)
+      compact_blob();
+  }
+  resize_valid(kept);
+}
+
+void Column::compact_blob() {
+  ColumnArray<char> compacted;
+  compacted.reserve(blob_.size() - garbage_);
+  for (unsigned row = 0; row < offsets_.size(); ++row) {
+    unsigned offset = compacted.size();
+    compacted.append(blob_.data() + offsets_[row], lengths_[row]);
+    offsets_[row] = offset;
+  }
+  blob_.swap(compacted);
+  garbage_ = 0;
+}
+
+bool Column::is_null(unsigned row) const {
+  return (valid_[row / 64] >> (row % 64) & 1) == 0;
+}
+
+unsigned Column::count(unsigned begin, unsigned end) const {
+  if (begin % 64 == 0)
+    return static_cast<unsigned>(count_bits(valid_data() + begin / 64, end - begin));
+
+  unsigned result = 0;
+  for (unsigned row = begin; row < end; row += 64) {
+    uint64_t word = valid_word(row);
+    if (end - row < 64)
+      word &= (static_cast<uint64_t>(1) << (end - row)) - 1;
+    result += popcount64(word);
+  }
+  return result;
+}
+
+void Column::clear_nulls(unsigned begin, unsigned count, uint64_t* bits) const {
+  for (unsigned i = 0; i < count; i += 64)
+    bits[i / 64] &= valid_word(begin + i);
+}
+
+void Column::push_valid(bool valid) {
+  unsigned row = size() - 1;
+  if (row % 64 == 0)
+    valid_.push_back(0);
+  set_valid(row, valid);
+}
+
+void Column::set_valid(unsigned row, bool valid) {
+  uint64_t bit = static_cast<uint64_t>(1) << (row % 64);
+  if (valid)
+    valid_[row / 64] |= bit;
+  else
+    valid_[row / 64] &= ~bit;
+}
+
+// Drops the bits of rows past the last, so the last word stays clear past it
+void Column::resize_valid(unsigned rows) {
+  valid_.resize((rows + 63) / 64);
+  if (rows % 64 != 0)
+    valid_.back() &= (static_cast<uint64_t>(1) << (rows % 64)) - 1;
+}
+
+// Returns the bits of rows [row, row + 64), with 0 for rows past the last
+uint64_t Column::valid_word(unsigned row) const {
+  unsigned word = row / 64, shift = row % 64;
+  uint64_t bits = word < valid_.size() ? valid_[word] >> shift : 0;
+  if (shift != 0 && word + 1 < valid_.size())
+    bits |= valid_[word + 1] << (64 - shift);
+  return bits;
+}
+
+string Column::get_string(unsigned row) const {
+  string result;
+  append_string(row, result);
+  return result;
+}
+
+void Column::append_string(unsigned row, string& out) const {
+  if (is_null(row))
+    return;
+
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    Value::append_unpacked(out, type_, ints_[row]);
+    break;
+  case floating:
+    Value::append_float(out, floats_[row]);
+    break;
+  default:
+    if (lengths_[row] != 0)
+      out.append(blob_.data() + offsets_[row], lengths_[row]);
+  }
+}
+
+// The varchar at row, which may be NULL (and so empty)
+string Column::text(unsigned row) const {
+  if (lengths_[row] == 0)
+    return string();
+  return string(blob_.data() + offsets_[row], lengths_[row]);
+}
+
+Value Column::get_value(unsigned row) const {
+  if (is_null(row))
+    return Value();
+
+  switch (type_) {
+  case integer:
+    return Value(ints_[row]);
+  case date:
+  case time:
+    return Value::packed(type_, ints_[row]);
+  case floating:
+    return Value(floats_[row]);
+  default:
+    return Value(text(row));
+  }
+}
+
+bool Column::equals(unsigned row, const Column& other, unsigned other_row) const {
+  if (is_null(row) || other.is_null(other_row))
+    return is_null(row) && other.is_null(other_row);
+  if (other.type_ != type_)
+    return get_string(row) == other.get_string(other_row);
+
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    return ints_[row] == other.ints_[other_row];
+  case floating:
+    return floats_[row] == other.floats_[other_row];
+  default:
+    return lengths_[row] == other.lengths_[other_row] &&
+      compare_bytes(blob_.data() + offsets_[row], lengths_[row],
+                    other.blob_.data() + other.offsets_[other_row], other.lengths_[other_row]) == 0;
+  }
+}
+
+bool Column::equals(unsigned row, const Value& value) const {
+  if (value.is_null() || is_null(row))
+    return value.is_null() && is_null(row);
+  if (value.type() != type_)
+    return get_string(row) == value.to_string();
+
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    return ints_[row] == value.packed_value();
+  case floating:
+    return floats_[row] == value.float_value();
+  default:
+    return compare_bytes(blob_.data() + offsets_[row], lengths_[row], value.text().data(), value.text().size()) == 0;
+  }
+}
+
+int Column::compare(unsigned row, const Column& other, unsigned other_row) const {
+  bool null = is_null(row), other_null = other.is_null(other_row);
+  if (null || other_null)
+    return null == other_null ? 0 : (null ? -1 : 1);
+
+  switch (type_) {
+  case integer:
+  case date:
+  case time: {
+    int left = ints_[row], right = other.ints_[other_row];
+    return left < right ? -1 : (right < left ? 1 : 0);
+  }
+  case floating: {
+    float left = floats_[row], right = other.floats_[other_row];
+    return left < right ? -1 : (right < left ? 1 : 0);
+  }
+  default:
+    return compare_bytes(blob_.data() + offsets_[row], lengths_[row], other.blob_.data() + other.offsets_[other_row], other.lengths_[other_row]);
+  }
+}
+
+int Column::compare_text(unsigned row, const string& text) const {
+  if (is_null(row))
+    return text.empty() ? 0 : -1;
+  return compare_bytes(blob_.data() + offsets_[row], lengths_[row], text.data(), text.size());
+}
+
+Value Column::coerce(const Value& value) const {
+  if (value.is_null() || value.type() == type_)
+    return value;
+
+  // Let append do the parsing, then read the result back
+  Column converted(type_);
+  converted.append(value);
+  return converted.get_value(0);
+}
+
+static void append_bytes(string& key, const void* bytes, unsigned size) {
+  key.append(static_cast<const char*>(bytes), size);
+}
+
+// The same encoding as append_key(get_value(row), key), written straight from
+// the arrays
+void Column::append_key(unsigned row, string& key) const {
+  if (is_null(row)) {
+    key.push_back(0);
+    return;
+  }
+  key.push_back(1);
+
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    append_bytes(key, &ints_[row], sizeof(int));
+    break;
+  case floating: {
+    float number = floats_[row];
+    if (number == 0)
+      number = 0;
+    append_bytes(key, &number, sizeof(number));
+    break;
+  }
+  default: {
+    unsigned length = lengths_[row];
+    append_bytes(key, &length, sizeof(length));
+    if (length != 0)
+      key.append(blob_.data() + offsets_[row], length);
+  }
+  }
+}
+
+void Column::append_key(const Value& value, string& key) const {
+  Value typed = coerce(value);
+  if (typed.is_null()) {
+    key.push_back(0);
+    return;
+  }
+  key.push_back(1);
+
+  switch (type_) {
+  case integer:
+  case date:
+  case time: {
+    int packed = typed.packed_value();
+    append_bytes(key, &packed, sizeof(packed));
+    break;
+  }
+  case floating: {
+    float number = typed.float_value();
+    if (number == 0)
+      number = 0;  // -0 and 0 are equal, so they need the same encoding
+    append_bytes(key, &number, sizeof(number));
+    break;
+  }
+  default: {
+    // Prefix the length so that ("ab", "c") and ("a", "bc") differ
+    unsigned length = typed.text().size();
+    append_bytes(key, &length, sizeof(length));
+    key.append(typed.text());
+  }
+  }
+}
+
+int Column::compare(unsigned a, unsigned b) const {
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    return ints_[a] < ints_[b] ? -1 : (ints_[b] < ints_[a] ? 1 : 0);
+  case floating:
+    return floats_[a] < floats_[b] ? -1 : (floats_[b] < floats_[a] ? 1 : 0);
+  default:
+    return compare_bytes(blob_.data() + offsets_[a], lengths_[a], blob_.data() + offsets_[b], lengths_[b]);
+  }
+}
+
+int Column::min_row() const {
+  return best_row(-1);
+}
+
+int Column::max_row() const {
+  return best_row(1);
+}
+
+// Finds the first row whose value compares furthest in direction (-1 for the
+// smallest, 1 for the largest). Morsels are searched in parallel and their
+// winners compared in order, so ties go to the earliest row either way.
+int Column::best_row(int direction) const {
+  unsigned rows = size();
+  vector<int> winners(ThreadPool::morsel_count(0, rows), -1);
+  ThreadPool::instance().parallel_for(0, rows, [&](unsigned morsel, unsigned begin, unsigned end) {
+    ColumnSummary summary;
+    if (summarize(begin, end, true, summary)) {
+      winners[morsel] = direction < 0 ? summary.min_row : summary.max_row;
+      return;
+    }
+
+    int best = -1;
+    for (unsigned row = begin; row < end; ++row)
+      if (!is_null(row) && (best < 0 || compare(row, best) * direction > 0))
+        best = row;
+    winners[morsel] = best;
+  });
+
+  int best = -1;
+  for (unsigned i = 0; i < winners.size(); ++i)
+    if (winners[i] >= 0 && (best < 0 || compare(winners[i], best) * direction > 0))
+      best = winners[i];
+  return best;
+}
+
+// Returns the first non-NULL row in [begin, end) holding value, or -1 if there
+// is none. A NaN value is held by no row.
+template <typename T>
+static int first_row_with(const Column& column, const T* values, unsigned begin, unsigned end, T value) {
+  for (unsigned row = begin; row < end; ++row)
+    if (values[row] == value && !column.is_null(row))
+      return row;
+  return -1;
+}
+
+bool Column::summarize(unsigned begin, unsigned end, bool find_rows, ColumnSummary& summary) const {
+  if (type_ == varchar)
+    return false;
+
+  ColumnSummary result;
+  // The kernels want the bitmap to start with row begin
+  const uint64_t* valid = valid_data() + begin / 64;
+  vector<uint64_t> shifted;
+  if (begin % 64 != 0 && begin < end) {
+    for (unsigned row = begin; row < end; row += 64)
+      shifted.push_back(valid_word(row));
+    valid = &shifted[0];
+  }
+
+  if (type_ == floating) {
+    FloatSummary values;
+    summarize_floats(float_data() + begin, valid, end - begin, values);
+    result.count = values.count;
+    result.float_sum = values.sum;
+    // -0 and 0 compare equal, so either finds the first of them
+    if (find_rows && values.count != 0) {
+      result.min_row = first_row_with(*this, float_data(), begin, end, values.min);
+      result.max_row = first_row_with(*this, float_data(), begin, end, values.max);
+      // The kernels pass over NaN, so if every value is NaN they are left
+      // with infinities no row holds
+      if (result.min_row < 0 || result.max_row < 0)
+        return false;
+    }
+  } else {
+    IntSummary values;
+    summarize_ints(int_data() + begin, valid, end - begin, values);
+    result.count = values.count;
+    result.int_sum = values.sum;
+    if (find_rows && values.count != 0) {
+      result.min_row = first_row_with(*this, int_data(), begin, end, values.min);
+      result.max_row = first_row_with(*this, int_data(), begin, end, values.max);
+    }
+  }
+  summary = result;
+  return true;
+}
+
+const int* Column::int_data() const {
+  return ints_.data();
+}
+
+const float* Column::float_data() const {
+  return floats_.data();
+}
+
+const uint64_t* Column::valid_data() const {
+  return valid_.data();
+}
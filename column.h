@@ -0,0 +1,255 @@
+#ifndef COLUMN_H_
+#define COLUMN_H_
+#pragma warning(disable: 4251)
+
+#include <string>
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+#include "exception.h"
+#include "column_type.h"
+#include "value.h"
+#include "column_array.h"
+
+/**
+ * What Column::summarize() found in a range of rows.
+ */
+struct EXPORT ColumnSummary {
+  ColumnSummary();
+
+  /** The number of non-NULL values. */
+  int64_t count;
+  /** The sum of the values, for integer columns. */
+  int64_t int_sum;
+  /** The sum of the values, for floating columns. */
+  double float_sum;
+  /**
+   * The first rows holding the smallest and the largest value, if they were
+   * asked for. -1 if there are no non-NULL values.
+   */
+  int min_row;
+  int max_row;
+};
+
+/**
+ * The storage for a single column of a Table.
+ *
+ * Every column keeps its values in one contiguous, typed array instead of as
+ * strings inside each Record:
+ *   - integer columns use an array of 32-bit ints
+ *   - floating columns use an array of floats
+ *   - date and time columns are packed into ints (yyyymmdd and hhmmss), which
+ *     keeps them ordered the same way as their string forms
+ *   - varchar columns keep an offset and length per row into a single blob
+ *
+ * Which rows are NULL is kept in a validity bitmap beside the values, with
+ * one bit per row that is set if the row holds a value. NULL rows hold 0 (or
+ * an empty string) in the typed array, so scans can read the array without
+ * checking, and the bitmap is only consulted where NULL makes a difference.
+ * Strings only show up at the edges, when values are read or written in
+ * string form.
+ *
+ * The arrays of a column loaded from a mapped snapshot point into the file
+ * until they are changed (see ColumnArray).
+ */
+class EXPORT Column : public ColumnType {
+public:
+  /** Creates an empty column of the given type. */
+  Column(RecordType type);
+
+  RecordType type() const;
+
+  /** Returns true for integer and floating columns. */
+  bool is_numeric() const;
+
+  /** Returns the number of values (rows) in the column. */
+  unsigned size() const;
+
+  /** Reserves room for \a rows values without changing the size. */
+  void reserve(unsigned rows);
+
+  /** Reserves room for \a bytes more bytes of varchar text. */
+  void reserve_text(size_t bytes);
+
+  /**
+   * Appends a value given in string form.
+   * "NULL" and "?" (which marks missing values in data files) are stored as
+   * NULL, and so is the empty string for typed columns.
+   * Throws an \a InvalidTypeError if \a value cannot be converted to the column type.
+   */
+  void append(const string& value);
+
+  /**
+   * Appends a typed value. Values of the column type are stored directly,
+   * others are converted through their string form.
+   * Throws an \a InvalidTypeError if \a value cannot be converted to the column type.
+   */
+  void append(const Value& value);
+
+  /** Appends a NULL value. */
+  void append_null();
+
+  /**
+   * Appends row \a row of \a other to this column.
+   * Columns of the same type are copied without going through strings.
+   */
+  void append(const Column& other, unsigned row);
+
+  /**
+   * Appends every row of \a other, which must not be this column. Columns of
+   * the same type are copied an array at a time.
+   */
+  void append(const Column& other);
+
+  /** Removes the last value. */
+  void pop_back();
+
+  /** Removes all values, keeping the memory for reuse. */
+  void clear();
+
+  /**
+   * Overwrites the value at \a row.
+   * Throws an \a InvalidTypeError if \a value cannot be converted to the column type.
+   */
+  void set(unsigned row, const string& value);
+  void set(unsigned row, const Value& value);
+
+  /**
+   * Removes every row whose entry in \a keep_rows is false, preserving the
+   * order of the remaining rows.
+   */
+  void keep(const vector<bool>& keep_rows);
+
+  bool is_null(unsigned row) const;
+
+  /** Returns the number of non-NULL values in rows [\a begin, \a end). */
+  unsigned count(unsigned begin, unsigned end) const;
+
+  /**
+   * Clears bit i of \a bits (64 rows per word) for each NULL row begin + i,
+   * for the \a count rows starting at \a begin.
+   */
+  void clear_nulls(unsigned begin, unsigned count, uint64_t* bits) const;
+
+  /** Returns the value at \a row in string form. NULL is returned as "". */
+  string get_string(unsigned row) const;
+  /** Appends the value at \a row in string form to \a out, like get_string(). */
+  void append_string(unsigned row, string& out) const;
+
+  /** Returns the value at \a row in its native type. */
+  Value get_value(unsigned row) const;
+
+  /**
+   * Returns the value at \a row converted to \a T.
+   * NULL values are returned as T().
+   */
+  template <typename T>
+  T get(unsigned row) const;
+
+  /** Returns true if \a row of this column holds the same value as \a other_row of \a other. */
+  bool equals(unsigned row, const Column& other, unsigned other_row) const;
+  /** Returns true if \a row holds \a value. */
+  bool equals(unsigned row, const Value& value) const;
+
+  /**
+   * Compares \a row of this column with \a other_row of \a other, which must
+   * have the same type. Returns a negative number, 0 or a positive number
+   * like string::compare. NULL is equal to NULL and less than anything else.
+   */
+  int compare(unsigned row, const Column& other, unsigned other_row) const;
+
+  /**
+   * Compares the varchar at \a row with \a text, like string::compare.
+   * NULL compares as the empty string.
+   */
+  int compare_text(unsigned row, const string& text) const;
+
+  /**
+   * Converts \a value to the type of this column.
+   * Throws an \a InvalidTypeError if it cannot be converted.
+   */
+  Value coerce(const Value& value) const;
+
+  /**
+   * Appends a binary encoding of the value at \a row to \a key. Two rows have
+   * the same encoding exactly when they hold the same value, so the encodings
+   * of several columns can be concatenated into a composite hash key.
+   */
+  void append_key(unsigned row, string& key) const;
+  /** Appends the encoding of \a value, converted to the column type, to \a key. */
+  void append_key(const Value& value, string& key) const;
+
+  /**
+   * Returns the row holding the smallest (or largest) non-NULL value, using the
+   * ordering of the column type. Returns -1 if there are no such rows.
+   */
+  int min_row() const;
+  int max_row() const;
+
+  /**
+   * Counts, sums and finds the extremes of the non-NULL values in rows
+   * [\a begin, \a end) in one pass over the typed array, using the kernels
+   * in aggregate_kernels.h. The rows holding the extremes are only looked for
+   * if \a find_rows is true. Returns false, leaving \a summary alone, for
+   * varchar columns, and for floating columns whose extremes can't be found
+   * that way because every value is NaN.
+   */
+  bool summarize(unsigned begin, unsigned end, bool find_rows, ColumnSummary& summary) const;
+
+  /** Raw values of integer, date and time columns. NULL rows hold 0. */
+  const int* int_data() const;
+  /** Raw values of floating columns. NULL rows hold 0. */
+  const float* float_data() const;
+  /**
+   * The validity bitmap: bit i % 64 of word i / 64 is set if row i is not
+   * NULL. Bits past the last row are clear.
+   */
+  const uint64_t* valid_data() const;
+
+private:
+  friend class Snapshot;
+
+  int compare(unsigned a, unsigned b) const;
+  int best_row(int direction) const;
+  void append_varchar(const string& value);
+  string text(unsigned row) const;
+  void move_last_to(unsigned row);
+  void compact_blob();
+  void push_valid(bool valid);
+  void set_valid(unsigned row, bool valid);
+  void resize_valid(unsigned rows);
+  uint64_t valid_word(unsigned row) const;
+
+  RecordType type_;
+
+  // Either owned or mapped from a snapshot (see ColumnArray)
+  ColumnArray<int> ints_;
+  ColumnArray<float> floats_;
+
+  // varchar rows are the lengths_[i] bytes at blob_[offsets_[i]]. Overwritten
+  // values are left in the blob as garbage until it is compacted.
+  ColumnArray<unsigned> offsets_;
+  ColumnArray<unsigned> lengths_;
+  ColumnArray<char> blob_;
+  unsigned garbage_;
+
+  ColumnArray<uint64_t> valid_;
+};
+
+template <typename T>
+T Column::get(unsigned row) const {
+  if (is_null(row))
+    return T();
+
+  switch (type_) {
+  case integer:
+    return ValueCast<T>::from_int(ints_[row]);
+  case floating:
+    return ValueCast<T>::from_float(floats_[row]);
+  default:
+    return ValueCast<T>::from_text(get_string(row));
+  }
+}
+
+#endif  // COLUMN_H_
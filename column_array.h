@@ -0,0 +1,160 @@
+#ifndef COLUMN_ARRAY_H_
+#define COLUMN_ARRAY_H_
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+using namespace std;
+
+#include "mapped_file.h"
+
+/**
+ * One of the arrays behind a Column: either a vector it owns, or a range of
+ * a MappedFile that a snapshot was mapped from (see Database::load()).
+ *
+ * A mapped array is copied into a vector the first time it is changed, so
+ * the file itself is never written to. Non-const access counts as a change,
+ * while const access reads the mapping directly. Copying a mapped array
+ * shares the mapping instead of reading it.
+ */
+template <typename T>
+class ColumnArray {
+public:
+  ColumnArray() : data_(NULL), size_(0) {}
+
+  ColumnArray(const ColumnArray& other) : owned_(other.owned_), file_(other.file_) {
+    point_at(other);
+  }
+
+  ColumnArray& operator=(const ColumnArray& other) {
+    owned_ = other.owned_;
+    file_ = other.file_;
+    point_at(other);
+    return *this;
+  }
+
+  /** Makes this array the \a size values at \a data, inside \a file. */
+  void map(const shared_ptr<const MappedFile>& file, const T* data, size_t size) {
+    owned_.clear();
+    file_ = file;
+    data_ = data;
+    size_ = size;
+  }
+
+  /** Copies a mapped array into a vector, so it no longer needs the file. */
+  void unmap() {
+    own();
+  }
+
+  bool is_mapped() const {
+    return file_ != NULL;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  /** NULL if the array is empty. */
+  const T* data() const {
+    return data_;
+  }
+
+  const T& operator[](size_t i) const {
+    return data_[i];
+  }
+
+  T& operator[](size_t i) {
+    own();
+    return owned_[i];
+  }
+
+  const T& back() const {
+    return data_[size_ - 1];
+  }
+
+  T& back() {
+    own();
+    return owned_.back();
+  }
+
+  void push_back(const T& value) {
+    own();
+    owned_.push_back(value);
+    sync();
+  }
+
+  /** Appends the \a count values at \a values. */
+  void append(const T* values, size_t count) {
+    own();
+    owned_.insert(owned_.end(), values, values + count);
+    sync();
+  }
+
+  void pop_back() {
+    own();
+    owned_.pop_back();
+    sync();
+  }
+
+  void resize(size_t size) {
+    own();
+    owned_.resize(size);
+    sync();
+  }
+
+  void reserve(size_t size) {
+    own();
+    owned_.reserve(size);
+    sync();
+  }
+
+  void clear() {
+    file_.reset();
+    owned_.clear();
+    sync();
+  }
+
+  void swap(ColumnArray& other) {
+    // Swapping vectors keeps their buffers, so data_ stays valid
+    owned_.swap(other.owned_);
+    file_.swap(other.file_);
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+  }
+
+private:
+  // Copies a mapped array into owned_ before it is changed
+  void own() {
+    if (!file_)
+      return;
+    owned_.assign(data_, data_ + size_);
+    file_.reset();
+    sync();
+  }
+
+  void sync() {
+    data_ = owned_.empty() ? NULL : &owned_[0];
+    size_ = owned_.size();
+  }
+
+  void point_at(const ColumnArray& other) {
+    if (file_) {
+      data_ = other.data_;
+      size_ = other.size_;
+    } else {
+      sync();
+    }
+  }
+
+  vector<T> owned_;
+  shared_ptr<const MappedFile> file_;
+  // The values, in owned_ or in the mapping
+  const T* data_;
+  size_t size_;
+};
+
+#endif  // COLUMN_ARRAY_H_
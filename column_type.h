@@ -0,0 +1,23 @@
+#ifndef COLUMN_TYPE_H_
+#define COLUMN_TYPE_H_
+
+/**
+ * Holds the enum of column types.
+ *
+ * The column store needs to know about column types without including all of
+ * table.h. Table inherits from ColumnType, so user code still spells these as
+ * Table::RecordType, Table::integer, and so on.
+ */
+struct ColumnType {
+  /** An enum specifying the type of a column. */
+  enum RecordType {
+    undefined_type = 0, ///< Not for normal use
+    integer        = 1, ///< 32-bit signed integer
+    floating       = 2, ///< 32-bit floating point
+    varchar        = 3, ///< Variable-length string
+    date           = 4, ///< Date with no time
+    time           = 5  ///< Time without time zone
+  };
+};
+
+#endif  // COLUMN_TYPE_H_
@@ -0,0 +1,264 @@
+#include "compare_kernels.h"
+#include "simd.h"
+
+// Calls kernel<op> args, where op is only known at run time
+#define DISPATCH_OP(op, kernel, args) \
+  switch (op) { \
+  case conditional_eq: kernel<conditional_eq> args; break; \
+  case conditional_neq: kernel<conditional_neq> args; break; \
+  case conditional_lt: kernel<conditional_lt> args; break; \
+  case conditional_gt: kernel<conditional_gt> args; break; \
+  case conditional_lte: kernel<conditional_lte> args; break; \
+  default: kernel<conditional_gte> args; break; \
+  }
+
+typedef void (*IntKernel)(const int*, unsigned, TokenType, int, uint64_t*);
+typedef void (*FloatKernel)(const float*, unsigned, TokenType, float, uint64_t*);
+
+template <int Op, typename T>
+static inline bool compare(T left, T right) {
+  switch (Op) {
+  case conditional_eq:
+    return left == right;
+  case conditional_neq:
+    return left != right;
+  case conditional_lt:
+    return left < right;
+  case conditional_gt:
+    return left > right;
+  case conditional_lte:
+    return left <= right;
+  default:
+    return left >= right;
+  }
+}
+
+// Compares up to 64 values, returning one bit per value
+template <int Op, typename T>
+static inline uint64_t scalar_word(const T* values, unsigned count, T constant) {
+  uint64_t result = 0;
+  for (unsigned i = 0; i < count; ++i)
+    result |= static_cast<uint64_t>(compare<Op>(values[i], constant)) << i;
+  return result;
+}
+
+template <int Op, typename T>
+static void scalar_kernel(const T* values, unsigned count, T constant, uint64_t* bits) {
+  for (unsigned word = 0; word * 64 < count; ++word) {
+    unsigned n = count - word * 64 < 64 ? count - word * 64 : 64;
+    bits[word] = scalar_word<Op>(values + word * 64, n, constant);
+  }
+}
+
+static void scalar_ints(const int* values, unsigned count, TokenType op, int constant, uint64_t* bits) {
+  DISPATCH_OP(op, scalar_kernel, (values, count, constant, bits))
+}
+
+static void scalar_floats(const float* values, unsigned count, TokenType op, float constant, uint64_t* bits) {
+  DISPATCH_OP(op, scalar_kernel, (values, count, constant, bits))
+}
+
+#ifdef SIMD_X86
+
+// The SIMD kernels handle whole words of 64 rows and leave the rest to
+// scalar_word. Operators without a direct instruction are the complement of
+// one that has it.
+
+template <int Op>
+TARGET_SSE2 static inline __m128i sse2_compare(__m128i left, __m128i right) {
+  __m128i ones = _mm_set1_epi32(-1);
+  switch (Op) {
+  case conditional_eq:
+    return _mm_cmpeq_epi32(left, right);
+  case conditional_neq:
+    return _mm_xor_si128(_mm_cmpeq_epi32(left, right), ones);
+  case conditional_lt:
+    return _mm_cmplt_epi32(left, right);
+  case conditional_gt:
+    return _mm_cmpgt_epi32(left, right);
+  case conditional_lte:
+    return _mm_xor_si128(_mm_cmpgt_epi32(left, right), ones);
+  default:
+    return _mm_xor_si128(_mm_cmplt_epi32(left, right), ones);
+  }
+}
+
+template <int Op>
+TARGET_SSE2 static inline __m128 sse2_compare(__m128 left, __m128 right) {
+  switch (Op) {
+  case conditional_eq:
+    return _mm_cmpeq_ps(left, right);
+  case conditional_neq:
+    return _mm_cmpneq_ps(left, right);
+  case conditional_lt:
+    return _mm_cmplt_ps(left, right);
+  case conditional_gt:
+    return _mm_cmpgt_ps(left, right);
+  case conditional_lte:
+    return _mm_cmple_ps(left, right);
+  default:
+    return _mm_cmpge_ps(left, right);
+  }
+}
+
+template <int Op>
+TARGET_SSE2 static void sse2_int_kernel(const int* values, unsigned count, int constant, uint64_t* bits) {
+  __m128i right = _mm_set1_epi32(constant);
+  unsigned words = count / 64;
+  for (unsigned word = 0; word < words; ++word) {
+    const int* chunk = values + word * 64;
+    uint64_t result = 0;
+    for (unsigned i = 0; i < 64; i += 4) {
+      __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk + i));
+      __m128i mask = sse2_compare<Op>(left, right);
+      result |= static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(mask))) << i;
+    }
+    bits[word] = result;
+  }
+  if (count % 64 != 0)
+    bits[words] = scalar_word<Op>(values + words * 64, count % 64, constant);
+}
+
+template <int Op>
+TARGET_SSE2 static void sse2_float_kernel(const float* values, unsigned count, float constant, uint64_t* bits) {
+  __m128 right = _mm_set1_ps(constant);
+  unsigned words = count / 64;
+  for (unsigned word = 0; word < words; ++word) {
+    const float* chunk = values + word * 64;
+    uint64_t result = 0;
+    for (unsigned i = 0; i < 64; i += 4) {
+      __m128 left = _mm_loadu_ps(chunk + i);
+      result |= static_cast<uint64_t>(_mm_movemask_ps(sse2_compare<Op>(left, right))) << i;
+    }
+    bits[word] = result;
+  }
+  if (count % 64 != 0)
+    bits[words] = scalar_word<Op>(values + words * 64, count % 64, constant);
+}
+
+static void sse2_ints(const int* values, unsigned count, TokenType op, int constant, uint64_t* bits) {
+  DISPATCH_OP(op, sse2_int_kernel, (values, count, constant, bits))
+}
+
+static void sse2_floats(const float* values, unsigned count, TokenType op, float constant, uint64_t* bits) {
+  DISPATCH_OP(op, sse2_float_kernel, (values, count, constant, bits))
+}
+
+template <int Op>
+TARGET_AVX2 static inline __m256i avx2_compare(__m256i left, __m256i right) {
+  __m256i ones = _mm256_set1_epi32(-1);
+  switch (Op) {
+  case conditional_eq:
+    return _mm256_cmpeq_epi32(left, right);
+  case conditional_neq:
+    return _mm256_xor_si256(_mm256_cmpeq_epi32(left, right), ones);
+  case conditional_lt:
+    return _mm256_cmpgt_epi32(right, left);
+  case conditional_gt:
+    return _mm256_cmpgt_epi32(left, right);
+  case conditional_lte:
+    return _mm256_xor_si256(_mm256_cmpgt_epi32(left, right), ones);
+  default:
+    return _mm256_xor_si256(_mm256_cmpgt_epi32(right, left), ones);
+  }
+}
+
+template <int Op>
+TARGET_AVX2 static inline __m256 avx2_compare(__m256 left, __m256 right) {
+  switch (Op) {
+  case conditional_eq:
+    return _mm256_cmp_ps(left, right, _CMP_EQ_OQ);
+  case conditional_neq:
+    return _mm256_cmp_ps(left, right, _CMP_NEQ_UQ);
+  case conditional_lt:
+    return _mm256_cmp_ps(left, right, _CMP_LT_OQ);
+  case conditional_gt:
+    return _mm256_cmp_ps(left, right, _CMP_GT_OQ);
+  case conditional_lte:
+    return _mm256_cmp_ps(left, right, _CMP_LE_OQ);
+  default:
+    return _mm256_cmp_ps(left, right, _CMP_GE_OQ);
+  }
+}
+
+template <int Op>
+TARGET_AVX2 static void avx2_int_kernel(const int* values, unsigned count, int constant, uint64_t* bits) {
+  __m256i right = _mm256_set1_epi32(constant);
+  unsigned words = count / 64;
+  for (unsigned word = 0; word < words; ++word) {
+    const int* chunk = values + word * 64;
+    uint64_t result = 0;
+    for (unsigned i = 0; i < 64; i += 8) {
+      __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk + i));
+      __m256i mask = avx2_compare<Op>(left, right);
+      result |= static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(mask))) << i;
+    }
+    bits[word] = result;
+  }
+  if (count % 64 != 0)
+    bits[words] = scalar_word<Op>(values + words * 64, count % 64, constant);
+}
+
+template <int Op>
+TARGET_AVX2 static void avx2_float_kernel(const float* values, unsigned count, float constant, uint64_t* bits) {
+  __m256 right = _mm256_set1_ps(constant);
+  unsigned words = count / 64;
+  for (unsigned word = 0; word < words; ++word) {
+    const float* chunk = values + word * 64;
+    uint64_t result = 0;
+    for (unsigned i = 0; i < 64; i += 8) {
+      __m256 left = _mm256_loadu_ps(chunk + i);
+      result |= static_cast<uint64_t>(_mm256_movemask_ps(avx2_compare<Op>(left, right))) << i;
+    }
+    bits[word] = result;
+  }
+  if (count % 64 != 0)
+    bits[words] = scalar_word<Op>(values + words * 64, count % 64, constant);
+}
+
+static void avx2_ints(const int* values, unsigned count, TokenType op, int constant, uint64_t* bits) {
+  DISPATCH_OP(op, avx2_int_kernel, (values, count, constant, bits))
+}
+
+static void avx2_floats(const float* values, unsigned count, TokenType op, float constant, uint64_t* bits) {
+  DISPATCH_OP(op, avx2_float_kernel, (values, count, constant, bits))
+}
+
+#endif  // SIMD_X86
+
+struct Kernels {
+  IntKernel ints;
+  FloatKernel floats;
+  const char* name;
+};
+
+static Kernels pick_kernels() {
+  Kernels kernels = { scalar_ints, scalar_floats, "scalar" };
+#ifdef SIMD_X86
+  if (has_avx2()) {
+    kernels.ints = avx2_ints;
+    kernels.floats = avx2_floats;
+    kernels.name = "avx2";
+  } else if (has_sse2()) {
+    kernels.ints = sse2_ints;
+    kernels.floats = sse2_floats;
+    kernels.name = "sse2";
+  }
+#endif
+  return kernels;
+}
+
+// Picked when the library is loaded
+static const Kernels kernels = pick_kernels();
+
+void compare_ints(const int* values, unsigned count, TokenType op, int constant, uint64_t* bits) {
+  kernels.ints(values, count, op, constant, bits);
+}
+
+void compare_floats(const float* values, unsigned count, TokenType op, float constant, uint64_t* bits) {
+  kernels.floats(values, count, op, constant, bits);
+}
+
+const char* compare_kernels_name() {
+  return kernels.name;
+}
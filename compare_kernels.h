@@ -0,0 +1,28 @@
+#ifndef COMPARE_KERNELS_H_
+#define COMPARE_KERNELS_H_
+
+#include <cstdint>
+using namespace std;
+
+#include "tokenizer.h"
+
+/**
+ * Comparison kernels used by WhereMatcher to compare a column's array with a
+ * constant.
+ *
+ * Each kernel sets bit i of \a bits (64 rows per word) if values[i] \a op
+ * \a constant holds, for the six comparison operators in TokenType. Bits past
+ * \a count in the last word are left clear. NULL values are stored as 0 and
+ * compare as such; callers clear their bits afterwards (see
+ * Column::clear_nulls).
+ *
+ * An implementation is picked for the processor at hand when the library is
+ * loaded: AVX2, SSE2 or plain C++.
+ */
+void compare_ints(const int* values, unsigned count, TokenType op, int constant, uint64_t* bits);
+void compare_floats(const float* values, unsigned count, TokenType op, float constant, uint64_t* bits);
+
+/** Returns the name of the kernels in use ("avx2", "sse2" or "scalar"). */
+const char* compare_kernels_name();
+
+#endif  // COMPARE_KERNELS_H_
@@ -0,0 +1,278 @@
+#include "csv_loader.h"
+#include "thread_pool.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+// Chunks are at least this big, so small files are parsed in one go
+static const size_t min_chunk_bytes = 256 * 1024;
+
+// The types tried for a column when inferring, narrowest first
+static const Table::RecordType inferred_types[] = {
+  Table::integer, Table::floating, Table::date, Table::time
+};
+static const unsigned inferred_type_count = 4;
+
+CsvOptions::CsvOptions() {
+  delimiter = 0;
+  header = true;
+  infer_types = true;
+}
+
+// Reads the fields of the line at pos into fields, reusing their strings, and
+// moves pos to the start of the next line. Returns the number of fields.
+static unsigned read_line(const char*& pos, const char* end, char delimiter, vector<string>& fields) {
+  unsigned count = 0;
+  for (;;) {
+    if (count == fields.size())
+      fields.push_back(string());
+    string& field = fields[count++];
+    field.clear();
+
+    if (pos < end && *pos == '"') {
+      ++pos;
+      for (;;) {
+        const char* quote = static_cast<const char*>(memchr(pos, '"', end - pos));
+        if (quote == NULL) {
+          // Unterminated, so the rest of the file is the field
+          field.append(pos, end);
+          pos = end;
+          break;
+        }
+        field.append(pos, quote);
+        pos = quote + 1;
+        if (pos == end || *pos != '"')
+          break;
+        field += '"';
+        ++pos;
+      }
+    }
+
+    // Anything after a closing quote is kept as it is
+    const char* field_end = pos;
+    while (field_end < end && *field_end != delimiter && *field_end != '\n')
+      ++field_end;
+    field.append(pos, field_end);
+    pos = field_end;
+    if (pos == end || *pos == '\n') {
+      if (pos != end)
+        ++pos;
+      if (!field.empty() && field[field.size() - 1] == '\r')
+        field.erase(field.size() - 1);
+      return count;
+    }
+    ++pos;  // the delimiter
+  }
+}
+
+static bool is_blank(unsigned count, const vector<string>& fields) {
+  return count == 1 && fields[0].empty();
+}
+
+// Returns true if value can be appended to a column of the given type
+static bool fits(Table::RecordType type, const string& value) {
+  if (type == Table::floating) {
+    const char *begin = value.c_str();
+    char *end;
+    errno = 0;
+    strtod(begin, &end);
+    return end != begin && *end == '\0' && errno != ERANGE;
+  }
+  try {
+    Value::pack(type, value);
+    return true;
+  } catch (const InvalidTypeError&) {
+    return false;
+  }
+}
+
+static bool is_null_field(const string& value) {
+  return value.empty() || value == "?" || value == "NULL";
+}
+
+CsvLoader::CsvLoader(const string& path, const CsvOptions& options)
+  : path_(path), options_(options) {
+  file_ = make_shared<MappedFile>(path);
+  const char* begin = file_->data();
+  const char* end = begin + file_->size();
+
+  if (options_.delimiter == 0) {
+    const char* line_end = static_cast<const char*>(memchr(begin, '\n', end - begin));
+    if (line_end == NULL)
+      line_end = end;
+    options_.delimiter = memchr(begin, '\t', line_end - begin) != NULL ? '\t' : ',';
+  }
+
+  const char* pos = begin;
+  vector<string> fields;
+  unsigned count = 0;
+  while (pos < end && is_blank(count = read_line(pos, end, options_.delimiter, fields), fields))
+    ;
+  if (count != 0 && !is_blank(count, fields)) {
+    if (options_.header) {
+      names_.assign(fields.begin(), fields.begin() + count);
+    } else {
+      for (unsigned i = 0; i < count; ++i)
+        names_.push_back("column" + to_string(static_cast<long long>(i + 1)));
+      // The first line is data, so parse it again with the rest
+      pos = begin;
+    }
+  }
+  split_chunks(pos, end);
+}
+
+// Splits [begin, end) into chunks of whole lines, a few per thread. A newline
+// inside quotes doesn't end a line, so files with quotes are scanned from the
+// start to find the line ends.
+void CsvLoader::split_chunks(const char* begin, const char* end) {
+  size_t threads = ThreadPool::instance().size();
+  size_t chunk_bytes = max(min_chunk_bytes, static_cast<size_t>(end - begin) / (threads * 4) + 1);
+  bool quoted = memchr(begin, '"', end - begin) != NULL;
+
+  chunks_.push_back(begin);
+  const char* pos = begin;
+  bool in_quotes = false;
+  while (static_cast<size_t>(end - pos) > chunk_bytes) {
+    const char* target = pos + chunk_bytes;
+    if (quoted) {
+      while (pos < end && (pos < target || in_quotes || *pos != '\n')) {
+        if (*pos == '"')
+          in_quotes = !in_quotes;
+        ++pos;
+      }
+    } else {
+      pos = static_cast<const char*>(memchr(target, '\n', end - target));
+      if (pos == NULL)
+        pos = end;
+    }
+    if (pos == end)
+      break;
+    chunks_.push_back(++pos);
+  }
+  chunks_.push_back(end);
+}
+
+Table::ColumnList CsvLoader::columns() const {
+  unsigned column_count = names_.size();
+  unsigned chunk_count = chunks_.size() - 1;
+  // Bit t of a column's mask is set while every value fits inferred_types[t]
+  vector<vector<unsigned> > masks(chunk_count);
+  vector<vector<bool> > seen(chunk_count);
+
+  if (options_.infer_types) {
+    ThreadPool::instance().parallel_for(0, chunk_count, 1, [&](unsigned chunk, unsigned, unsigned) {
+      vector<unsigned>& mask = masks[chunk];
+      vector<bool>& values = seen[chunk];
+      mask.assign(column_count, (1 << inferred_type_count) - 1);
+      values.assign(column_count, false);
+
+      vector<string> fields;
+      const char* pos = chunks_[chunk];
+      while (pos < chunks_[chunk + 1]) {
+        unsigned count = read_line(pos, chunks_[chunk + 1], options_.delimiter, fields);
+        if (is_blank(count, fields))
+          continue;
+        for (unsigned i = 0; i < min(count, column_count); ++i) {
+          if (mask[i] == 0 || is_null_field(fields[i]))
+            continue;
+          values[i] = true;
+          for (unsigned t = 0; t < inferred_type_count; ++t) {
+            if ((mask[i] & 1 << t) != 0 && !fits(inferred_types[t], fields[i]))
+              mask[i] &= ~(1 << t);
+          }
+        }
+      }
+    });
+  }
+
+  Table::ColumnList columns;
+  for (unsigned i = 0; i < column_count; ++i) {
+    unsigned mask = (1 << inferred_type_count) - 1;
+    bool any_values = false;
+    for (unsigned chunk = 0; chunk < chunk_count && options_.infer_types; ++chunk) {
+      mask &= masks[chunk][i];
+      any_values = any_values || seen[chunk][i];
+    }
+
+    Table::RecordType type = Table::varchar;
+    for (unsigned t = 0; t < inferred_type_count && any_values; ++t) {
+      if ((mask & 1 << t) != 0) {
+        type = inferred_types[t];
+        break;
+      }
+    }
+    columns.push_back(make_pair(names_[i], type));
+  }
+  return columns;
+}
+
+void CsvLoader::append_to(Table& table) const {
+  // The table column of each field of a line
+  vector<int> targets;
+  unsigned table_columns = table.data_.size();
+  if (options_.header) {
+    for (const string& name : names_)
+      targets.push_back(table.schema_->index_for(name));  // throws if the column doesn't exist
+  } else {
+    for (unsigned i = 0; i < table_columns; ++i)
+      targets.push_back(i);
+  }
+  for (unsigned i = 0; i < targets.size(); ++i) {
+    if (find(targets.begin(), targets.begin() + i, targets[i]) != targets.begin() + i)
+      throw IOError(path_ + " names column " + names_[i] + " twice");
+  }
+
+  // Parse each chunk into columns of its own
+  unsigned chunk_count = chunks_.size() - 1;
+  vector<vector<Column> > parsed(chunk_count);
+  ThreadPool::instance().parallel_for(0, chunk_count, 1, [&](unsigned chunk, unsigned, unsigned) {
+    vector<Column>& columns = parsed[chunk];
+    for (unsigned i = 0; i < table_columns; ++i)
+      columns.push_back(Column(table.data_[i].type()));
+
+    vector<string> fields;
+    const char* pos = chunks_[chunk];
+    while (pos < chunks_[chunk + 1]) {
+      unsigned count = read_line(pos, chunks_[chunk + 1], options_.delimiter, fields);
+      if (is_blank(count, fields))
+        continue;
+      if (count != targets.size())
+        throw IOError(path_ + " has a line with " + to_string(static_cast<long long>(count)) +
+                      " fields instead of " + to_string(static_cast<long long>(targets.size())));
+      for (unsigned i = 0; i < count; ++i)
+        columns[targets[i]].append(fields[i]);
+      // Columns the file doesn't have are NULL
+      if (targets.size() != table_columns) {
+        unsigned rows = columns[targets[0]].size();
+        for (unsigned i = 0; i < table_columns; ++i)
+          if (columns[i].size() != rows)
+            columns[i].append_null();
+      }
+    }
+  });
+
+  table.before_change();
+  unsigned old_rows = table.size();
+  for (unsigned i = 0; i < table_columns; ++i) {
+    for (unsigned chunk = 0; chunk < chunk_count; ++chunk)
+      table.data_[i].append(parsed[chunk][i]);
+  }
+  // Index the new rows, and take them all out again if one has the key of
+  // another
+  unsigned rows = table.size();
+  for (unsigned row = old_rows; row < rows && !table.key_.empty(); ++row) {
+    if (table.key_index_.insert(make_pair(table.key_for_row(row), row)).second)
+      continue;
+
+    for (unsigned added = old_rows; added < row; ++added)
+      table.key_index_.erase(table.key_for_row(added));
+    vector<bool> keep_rows(rows, false);
+    fill(keep_rows.begin(), keep_rows.begin() + old_rows, true);
+    for (Column& column : table.data_)
+      column.keep(keep_rows);
+    throw KeyConflictError("Already a record with this key");
+  }
+  table.log_.inserted(table, old_rows);
+}
@@ -0,0 +1,56 @@
+#ifndef CSV_LOADER_H_
+#define CSV_LOADER_H_
+#pragma warning(disable: 4251)
+
+#include <string>
+#include <vector>
+#include <memory>
+using namespace std;
+
+#include "exception.h"
+#include "database.h"
+#include "mapped_file.h"
+
+/**
+ * Parses a CSV or tab-separated file for Database::import_csv().
+ *
+ * The file is mapped into memory and split into chunks of whole lines,
+ * which are parsed in parallel on the ThreadPool. Each chunk is parsed into
+ * columns of its own, and the chunks' columns are then appended to the
+ * table in order with Column::append(), an array at a time.
+ */
+class CsvLoader {
+public:
+  /**
+   * Maps \a path, reads the header and splits the rest into chunks.
+   * Throws an \a IOError if \a path cannot be read.
+   */
+  CsvLoader(const string& path, const CsvOptions& options);
+
+  /**
+   * Returns the columns for a new table: the names from the header, typed
+   * as CsvOptions::infer_types says.
+   */
+  Table::ColumnList columns() const;
+
+  /**
+   * Appends the rows of the file to \a table. Either every row is added or,
+   * if an exception is thrown, none.
+   */
+  void append_to(Table& table) const;
+
+private:
+  CsvLoader(const CsvLoader&);
+  CsvLoader& operator=(const CsvLoader&);
+
+  void split_chunks(const char* begin, const char* end);
+
+  string path_;
+  CsvOptions options_;
+  shared_ptr<const MappedFile> file_;
+  vector<string> names_;
+  // The start of each chunk, followed by the end of the last one
+  vector<const char*> chunks_;
+};
+
+#endif  // CSV_LOADER_H_
@@ -0,0 +1,102 @@
+#include "cursor.h"
+
+Cursor::~Cursor() {
+}
+
+QueryCursor::QueryCursor(const Table& source, const vector<string>& column_names, string where, Database* database)
+  : matcher_(where, source, database) {
+  Schema::FieldList fields;
+  for (unsigned i = 0; i < column_names.size(); ++i) {
+    columns_.push_back(source.index_for(column_names[i]));
+    fields.push_back(source.schema_->fields()[columns_.back()]);
+  }
+  schema_ = make_shared<Schema>(fields);
+
+  source_ = &source;
+  version_ = source.version_;
+  position_ = 0;
+  next_row_ = 0;
+}
+
+bool QueryCursor::next(Record& record) {
+  if (source_->version_ != version_)
+    throw InvalidOperationError("Table was changed while a cursor was reading it");
+
+  while (position_ == selection_.size()) {
+    unsigned rows = source_->size();
+    if (next_row_ >= rows)
+      return false;
+
+    unsigned end = rows - next_row_ < WhereMatcher::batch_size ? rows : next_row_ + WhereMatcher::batch_size;
+    selection_.clear();
+    position_ = 0;
+    matcher_.select(next_row_, end, selection_);
+    next_row_ = end;
+  }
+
+  record = source_->make_record(selection_[position_++], schema_, columns_);
+  return true;
+}
+
+CrossJoinCursor::CrossJoinCursor(const Table& left, const Table& right, string where, uint64_t max_rows)
+  : block_(left.schema_->joined(*right.schema_)->fields()),
+    matcher_(where, block_) {
+  Table::check_cross_join_size(left, right, max_rows);
+
+  left_ = &left;
+  right_ = &right;
+  left_version_ = left.version_;
+  right_version_ = right.version_;
+  left_row_ = 0;
+  right_row_ = 0;
+  position_ = 0;
+}
+
+bool CrossJoinCursor::next(Record& record) {
+  if (left_->version_ != left_version_ || right_->version_ != right_version_)
+    throw InvalidOperationError("Table was changed while a cursor was reading it");
+
+  while (position_ == selection_.size()) {
+    unsigned left_size = left_->size();
+    if (left_row_ >= left_size || right_->size() == 0)
+      return false;
+
+    fill_block();
+    selection_.clear();
+    position_ = 0;
+    matcher_.select(0, block_.size(), selection_);
+  }
+
+  record = block_.make_record(selection_[position_++]);
+  return true;
+}
+
+// Replaces the block's rows with the next batch_size combinations, copying
+// one column at a time
+void CrossJoinCursor::fill_block() {
+  vector<unsigned> left_rows, right_rows;
+  unsigned left_size = left_->size();
+  unsigned right_size = right_->size();
+  while (left_rows.size() < WhereMatcher::batch_size && left_row_ < left_size) {
+    left_rows.push_back(left_row_);
+    right_rows.push_back(right_row_);
+    if (++right_row_ == right_size) {
+      right_row_ = 0;
+      ++left_row_;
+    }
+  }
+
+  unsigned left_columns = left_->data_.size();
+  for (unsigned i = 0; i < block_.data_.size(); ++i) {
+    Column& out = block_.data_[i];
+    out.clear();
+    out.reserve(left_rows.size());
+    if (i < left_columns) {
+      for (unsigned j = 0; j < left_rows.size(); ++j)
+        out.append(left_->data_[i], left_rows[j]);
+    } else {
+      for (unsigned j = 0; j < right_rows.size(); ++j)
+        out.append(right_->data_[i - left_columns], right_rows[j]);
+    }
+  }
+}
@@ -0,0 +1,124 @@
+#ifndef CURSOR_H_
+#define CURSOR_H_
+#pragma warning(disable: 4251)
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "exception.h"
+#include "record.h"
+#include "schema.h"
+#include "table.h"
+#include "where_matcher.h"
+
+/**
+ * A forward-only stream of records.
+ *
+ * Records are produced one at a time as next() is called, so a cursor can
+ * be abandoned after the first few without computing the rest.
+ *
+ * ~~~{.cpp}
+ * Cursor *cursor = db.query_cursor("name", "students", "age > 21");
+ * Record record;
+ * while (cursor->next(record))
+ *   cout << record.get<string>("name") << endl;
+ * delete cursor;
+ * ~~~
+ */
+class EXPORT Cursor {
+public:
+  virtual ~Cursor();
+
+  /**
+   * Moves to the next record and stores it in \a record.
+   * Returns false, leaving \a record alone, once there are no more records.
+   */
+  virtual bool next(Record& record) = 0;
+};
+
+/**
+ * A cursor over the rows of a table that match a where clause.
+ *
+ * Rows are matched a batch at a time (see WhereMatcher), so memory use does
+ * not grow with the number of matches.
+ *
+ * The cursor reads from the table as it goes, so the table must outlive it.
+ * Calling next() after the table has changed throws an
+ * \a InvalidOperationError.
+ */
+class EXPORT QueryCursor : public Cursor {
+public:
+  /**
+   * Creates a cursor over the rows of \a source matching \a where, with the
+   * columns in \a column_names. Subqueries in \a where name tables in
+   * \a database.
+   *
+   * Throws a \a ColumnDoesNotExistError if any of the \a column_names don't exist.
+   * Throws a \a QuerySyntaxError if \a where has a syntax error.
+   */
+  QueryCursor(const Table& source, const vector<string>& column_names, string where, Database* database = NULL);
+
+  bool next(Record& record);
+
+private:
+  const Table* source_;
+  unsigned version_;
+  WhereMatcher matcher_;
+  vector<unsigned> columns_;
+  SchemaPtr schema_;
+
+  // Matching rows of the current batch, and where the next batch starts
+  vector<unsigned> selection_;
+  unsigned position_;
+  unsigned next_row_;
+};
+
+/**
+ * A cursor over the cross join of two tables, optionally filtered by a where
+ * clause.
+ *
+ * Combined rows are built a batch at a time in a small scratch table and
+ * matched there, so the full product is never held in memory. The records
+ * have the columns of the first table followed by those of the second, in
+ * the same order as Table::cross_join().
+ *
+ * Both tables must outlive the cursor. Calling next() after either table has
+ * changed throws an \a InvalidOperationError.
+ */
+class EXPORT CrossJoinCursor : public Cursor {
+public:
+  /**
+   * Creates a cursor over the rows of \a left x \a right that match
+   * \a where. An empty \a where matches every row. If \a max_rows is not 0,
+   * it limits the size of the cross join before filtering.
+   *
+   * Throws an \a InvalidOperationError if the cross join would have more than
+   * \a max_rows rows.
+   * Throws a \a QuerySyntaxError if \a where has a syntax error.
+   * Throws a \a ColumnDoesNotExistError if \a where refers to a column that
+   * is in neither table.
+   */
+  CrossJoinCursor(const Table& left, const Table& right, string where, uint64_t max_rows = 0);
+
+  bool next(Record& record);
+
+private:
+  void fill_block();
+
+  const Table* left_;
+  const Table* right_;
+  unsigned left_version_, right_version_;
+
+  // Holds the current batch of combined rows; matcher_ is compiled against it
+  Table block_;
+  WhereMatcher matcher_;
+
+  // The next combination to put in the block
+  unsigned left_row_, right_row_;
+
+  vector<unsigned> selection_;
+  unsigned position_;
+};
+
+#endif  // CURSOR_H_
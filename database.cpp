@@ -1,97 +1,250 @@
 #include "database.h"
 #include "where_matcher.h"
+#include "snapshot.h"
+#include "csv_loader.h"
+#include "write_ahead_log.h"
 
 #include <sstream>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
 
 Database::Database() {
+  log_ = NULL;
+  log_sequence_ = 0;
 }
 
 Database::~Database() {
   for (auto name_table : tables_)
     delete name_table.second;
+  delete log_;
 }
 
 void Database::add_table(string table_name, Table* table) {
-  if (tables_.find(table_name) != tables_.end())
+  if (tables_.find(table_name) != tables_.end() || mapped_tables_.count(table_name) != 0)
     throw InvalidOperationError("Table " + table_name + " already exists in the database");
-  tables_[table_name] = table;
+  tables_[table_name] = attach(table_name, table);
+  if (log_ != NULL)
+    log_->table_added(table_name, *table);
 }
 
 void Database::drop_table(string table_name) {
-  TableMap::iterator it = tables_.find(table_name);
-  if (it == tables_.end())
-    throw TableDoesNotExistError("Table " + table_name + " could not be found");
-  delete it->second;
-  tables_.erase(it);
+  if (mapped_tables_.erase(table_name) == 0) {
+    TableMap::iterator it = tables_.find(table_name);
+    if (it == tables_.end())
+      throw TableDoesNotExistError("Table " + table_name + " could not be found");
+    delete it->second;
+    tables_.erase(it);
+  }
+  if (log_ != NULL)
+    log_->table_dropped(table_name);
 }
 
 vector<string> Database::table_names() {
   vector<string> ret;
   for (auto name_table : tables_)
     ret.push_back(name_table.first);
+  for (auto name_snapshot : mapped_tables_)
+    ret.push_back(name_snapshot.first);
+  sort(ret.begin(), ret.end());
   return ret;
 }
 
 Table* Database::table(string table_name) {
-  TableMap::iterator it = tables_.find(table_name);
-  if (it == tables_.end())
+  Table* found = table_if_exists(table_name);
+  if (found == NULL)
     throw TableDoesNotExistError("Table " + table_name + " could not be found");
-  return it->second;
+  return found;
 }
 
 Table* Database::table_if_exists(string table_name) {
   TableMap::iterator it = tables_.find(table_name);
-  if (it == tables_.end())
+  if (it != tables_.end())
+    return it->second;
+
+  // Set up mapped tables the first time they are used
+  MappedTableMap::iterator entry = mapped_tables_.find(table_name);
+  if (entry == mapped_tables_.end())
     return 0;
-  return it->second;
+  Table* table = entry->second->read_table(table_name);
+  mapped_tables_.erase(entry);
+  tables_[table_name] = attach(table_name, table);
+  return table;
+}
+
+// Has the changes to table logged as changes to name, if a log is open
+Table* Database::attach(const string& name, Table* table) {
+  table->log_.attach(log_, name);
+  return table;
 }
 
 Table* Database::query(string select, string from, string where) {
   Table *source = table(from);
-  Table *results = source->clone_structure();
+  vector<string> projection;
+  vector<unsigned> selection;
+  plan_query(*source, select, where, projection, selection);
+  return source->project(projection, selection);
+}
 
-  Table::TableIterator it;
-  WhereMatcher matcher(where);
-  for (it = source->begin(); it != source->end(); it++) {
-    if (matcher.does_match(*it))
-      results->insert(*it);
-  }
+ResultView* Database::query_view(string select, string from, string where) {
+  Table *source = table(from);
+  vector<string> projection;
+  vector<unsigned> selection;
+  plan_query(*source, select, where, projection, selection);
+  return new ResultView(*source, projection, selection);
+}
 
-  Table::ColumnList all_columns = results->columns();
-  vector<string> columns_to_select = split_select(select);
-  if (columns_to_select[0] != "*")
-    for (unsigned int i = 0; i < all_columns.size(); i++) {
-      // if column in table is not in selected columns, remove it from query
-      if (find(columns_to_select.begin(), columns_to_select.end(), all_columns[i].first) == columns_to_select.end())
-        results->del_column(all_columns[i].first);
-    }
+Cursor* Database::query_cursor(string select, string from, string where) {
+  Table *source = table(from);
+  return new QueryCursor(*source, select_columns(*source, select), where, this);
+}
+
+// Returns the columns of source named in select. Names that aren't in the
+// table are ignored, and the columns keep the table's order.
+vector<string> Database::select_columns(const Table& source, string select) {
+  Table::ColumnList all_columns = source.columns();
+  vector<string> columns_to_select = split_select(select), result;
+  for (unsigned int i = 0; i < all_columns.size(); i++) {
+    if (columns_to_select[0] == "*" ||
+        find(columns_to_select.begin(), columns_to_select.end(), all_columns[i].first) != columns_to_select.end())
+      result.push_back(all_columns[i].first);
+  }
+  return result;
+}
 
-  return results;
+// Works out the projected columns and the matching rows of a query, without
+// copying anything
+void Database::plan_query(const Table& source, string select, string where,
+                          vector<string>& projection, vector<unsigned>& selection) {
+  projection = select_columns(source, select);
+  WhereMatcher matcher(where, source, this);
+  matcher.select(0, source.size(), selection);
 }
 
 void Database::delete_from(string from, string where) {
 	Table *source = table(from);
-  source->drop_where(where);
+  source->drop_where(where, this);
 }
 
 void Database::update(string table_name, string where, string set) {
   Table *source = table(table_name);
-  source->update(where, set);
+  source->update(where, set, this);
+}
+
+void Database::import_csv(string table_name, string path, const CsvOptions& options) {
+  CsvLoader loader(path, options);
+  Table *existing = table_if_exists(table_name);
+  if (existing != NULL) {
+    loader.append_to(*existing);
+    return;
+  }
+
+  Table *created = new Table(loader.columns());
+  try {
+    loader.append_to(*created);
+  } catch (...) {
+    delete created;
+    throw;
+  }
+  add_table(table_name, created);
 }
 
 void Database::save(string filename) {
+  read_mapped_tables();
+  Snapshot::save(tables_, filename, log_ != NULL ? log_->sequence() : log_sequence_);
+}
+
+void Database::load(string filename, LoadMode mode) {
+  if (log_ != NULL)
+    throw InvalidOperationError("Cannot load a snapshot while a log is open");
 
+  // Read everything before dropping the current tables, so a failed load
+  // leaves the database as it was
+  TableMap loaded;
+  MappedTableMap still_mapped;
+  uint64_t sequence;
+  if (mode == mapped) {
+    shared_ptr<MappedSnapshot> snapshot = make_shared<MappedSnapshot>(filename);
+    for (string name : snapshot->table_names())
+      still_mapped[name] = snapshot;
+    sequence = snapshot->log_sequence();
+  } else {
+    sequence = Snapshot::load(filename, loaded);
+  }
+
+  for (auto name_table : tables_)
+    delete name_table.second;
+  tables_.swap(loaded);
+  mapped_tables_.swap(still_mapped);
+  log_sequence_ = sequence;
 }
 
-void Database::load(string filename) {
+void Database::open_log(string path, const LogOptions& options) {
+  if (log_ != NULL)
+    throw InvalidOperationError("A log is already open");
+  log_ = new WriteAheadLog(path, options, log_sequence_);
+  for (auto name_table : tables_)
+    attach(name_table.first, name_table.second);
+}
 
+void Database::close_log() {
+  if (log_ == NULL)
+    return;
+  for (auto name_table : tables_)
+    name_table.second->log_.detach();
+  log_sequence_ = log_->sequence();
+  delete log_;
+  log_ = NULL;
+}
+
+void Database::checkpoint(string filename) {
+  if (log_ == NULL)
+    throw InvalidOperationError("No log is open");
+  save(filename);
+  log_->truncate();
+}
+
+void Database::recover(string filename, string log_path, LoadMode mode) {
+  if (log_ != NULL)
+    throw InvalidOperationError("Cannot recover while a log is open");
+
+  if (ifstream(filename.c_str()).good()) {
+    load(filename, mode);
+  } else {
+    for (auto name_table : tables_)
+      delete name_table.second;
+    tables_.clear();
+    mapped_tables_.clear();
+    log_sequence_ = 0;
+  }
+  log_sequence_ = WriteAheadLog::replay(log_path, log_sequence_, *this);
+}
+
+bool Database::has_table(const string& name) const {
+  return tables_.count(name) != 0 || mapped_tables_.count(name) != 0;
+}
+
+// Sets up every table that is still only mapped
+void Database::read_mapped_tables() {
+  while (!mapped_tables_.empty())
+    table(mapped_tables_.begin()->first);
 }
 
 void Database::merge(const Database& database) {
   for (auto name_table : database.tables_) {
-    delete tables_[name_table.first];  // returns NULL if it doesn't exist, and delete does nothing
-    tables_[name_table.first] = new Table(*name_table.second);
+    if (has_table(name_table.first))
+      drop_table(name_table.first);
+    add_table(name_table.first, new Table(*name_table.second));
+  }
+  for (auto name_snapshot : database.mapped_tables_) {
+    if (has_table(name_snapshot.first))
+      drop_table(name_snapshot.first);
+    // Tables still only mapped in database stay that way here, unless their
+    // rows have to be logged
+    if (log_ != NULL)
+      add_table(name_snapshot.first, name_snapshot.second->read_table(name_snapshot.first));
+    else
+      mapped_tables_[name_snapshot.first] = name_snapshot.second;
   }
 }
 
@@ -100,6 +253,7 @@ Database* Database::copy() {
   
   for (auto name_table : tables_)
     clone->add_table(name_table.first, new Table(*name_table.second));
+  clone->mapped_tables_ = mapped_tables_;
 
   return clone;
 }
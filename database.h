@@ -5,16 +5,88 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 
 #include "record.h"
 #include "table.h"
+#include "result_view.h"
+#include "cursor.h"
 #include "exception.h"
 
+class MappedSnapshot;
+class WriteAheadLog;
+
+/** Options for Database::import_csv(). */
+struct EXPORT CsvOptions {
+  /** Creates options that detect the delimiter, read a header and infer types. */
+  CsvOptions();
+
+  /**
+   * The character between fields. 0 picks a tab if the first line has one,
+   * and a comma if not.
+   */
+  char delimiter;
+
+  /** Whether the first line holds the column names. */
+  bool header;
+
+  /**
+   * Whether a new table gets the narrowest type that fits every value of a
+   * column: integer, floating, date, time, and varchar otherwise. If false,
+   * every column of a new table is varchar.
+   */
+  bool infer_types;
+};
+
+/** Options for Database::open_log(). */
+struct EXPORT LogOptions {
+  /** When logged changes are flushed to disk. */
+  enum SyncPolicy {
+    /**
+      Every change is on disk before the call making it returns. Changes made
+      at the same time on several threads share one flush.
+     */
+    sync_always,
+    /**
+      Changes are written to the file as they are made, and flushed to disk
+      every \a sync_interval_ms milliseconds. A crash of the machine loses at
+      most the changes since the last flush.
+     */
+    sync_interval,
+    /**
+      Changes are written to the file as they are made, and the OS flushes
+      them when it sees fit.
+     */
+    sync_never
+  };
+
+  /** Creates options that flush every change, or every 100 ms. */
+  LogOptions();
+
+  SyncPolicy sync;
+
+  /** How often sync_interval flushes, in milliseconds. */
+  unsigned sync_interval_ms;
+};
+
 /** The entry point for creating tables, deleting records,
     and running queries.
  */
 class EXPORT Database {
 public:
+  /** How load() reads a snapshot. */
+  enum LoadMode {
+    /** Read every table into memory. */
+    read_all,
+    /**
+      Map the file into memory, and read only its catalog. A table is set up
+      the first time it is used, and its columns are read in by the OS as
+      queries touch them. Changing a column copies it into memory first, so
+      the file is never written to.
+     */
+    mapped
+  };
+
   /** Creates an empty database */
   Database();
 
@@ -83,7 +155,11 @@ public:
     myDatabase.query("*", "students", "EXISTS(good_students)");
     ~~~
 
-    Throws a \a TableDoesNotExistError if \a from does not exist.
+    IN, ANY, ALL and EXISTS refer to other tables in the database, and are
+    worked out once per query (see WhereMatcher).
+
+    Throws a \a TableDoesNotExistError if \a from, or a table named in
+    \a where, does not exist.
     Throws a \a QuerySyntaxError if \a select or \a where have a syntax error.
 
     \param select which columns to include in the returned Table
@@ -93,6 +169,37 @@ public:
    */
   Table* query(string select, string from, string where);
 
+  /**
+    Perform a query like query(), but return a view of the matching rows in
+    the source table instead of a copy of them.
+
+    Nothing is copied until the view is changed through ResultView::table()
+    or the source table is changed. The caller owns the view and must
+    destroy it with *delete*.
+
+    Throws a \a TableDoesNotExistError if \a from does not exist.
+    Throws a \a QuerySyntaxError if \a select or \a where have a syntax error.
+
+    \sa ResultView
+   */
+  ResultView* query_view(string select, string from, string where);
+
+  /**
+    Perform a query like query(), but return a cursor that finds the matching
+    rows as they are read instead of building a result table.
+
+    The cursor reads from the table named \a from, which must not be dropped
+    while the cursor is in use. Reading from the cursor after the table has
+    changed throws an \a InvalidOperationError. The caller owns the cursor
+    and must destroy it with *delete*.
+
+    Throws a \a TableDoesNotExistError if \a from does not exist.
+    Throws a \a QuerySyntaxError if \a select or \a where have a syntax error.
+
+    \sa Cursor
+   */
+  Cursor* query_cursor(string select, string from, string where);
+
   /**
     Delete all records that match the query.
 
@@ -124,8 +231,42 @@ public:
    */
   void update(string table_name, string where, string set);
 
+  /**
+    Import the rows of a CSV or tab-separated file into a table.
+
+    ~~~{.cpp}
+    myDatabase.import_csv("places", "appdata/geoplaces2.csv");
+    ~~~
+
+    If \a table_name doesn't exist, it is created with the columns named in
+    the header ("column1", "column2", ... without one), typed as set out in
+    \a options. Otherwise the rows are appended to it: its columns are
+    matched to the header by name, and columns missing from the file are
+    NULL. Without a header, the fields must be in the order of its columns.
+
+    Fields may be quoted with double quotes, with "" for a quote inside
+    them. "?", "NULL" and empty fields of typed columns are NULL. The file
+    is mapped into memory and parsed on all cores, and the values are
+    appended straight to the columns; no rows are added if any fail.
+
+    Throws an \a IOError if \a path cannot be read, or a line has the wrong
+    number of fields.
+    Throws a \a ColumnDoesNotExistError if the header names a column that
+    \a table_name doesn't have.
+    Throws an \a InvalidTypeError if a value doesn't fit its column.
+    Throws a \a KeyConflictError if a row has the key of another row.
+
+    \param table_name the table to add the rows to
+    \param path the file to read
+    \param options how to read the file
+   */
+  void import_csv(string table_name, string path, const CsvOptions& options = CsvOptions());
+
   /**
     Save the database to a file
+    The tables are written as a binary snapshot of their columns (see
+    snapshot.h), which load() reads back without parsing. The file is only
+    replaced once the new snapshot is complete.
     Throws an \a IOError on failture.
     \param filename the output file
    */
@@ -133,10 +274,72 @@ public:
 
   /**
     Load a database from a file, this will clear any existing records
-    Throws an \a IOError on failture.
+    The database is left as it was if loading fails.
+    Throws an \a InvalidOperationError if a log is open (see recover()).
+    Throws an \a IOError on failture, or if the file is damaged or was saved
+    by another version of the snapshot format. In mapped mode, only the
+    catalog of the file is checked for damage.
     \param filename the input file
+    \param mode whether to read the tables now, or map them (see LoadMode)
+   */
+  void load(string filename, LoadMode mode = read_all);
+
+  /**
+    Log every later change to the database to the write-ahead log at
+    \a path, so that recover() can redo them after a crash.
+
+    ~~~{.cpp}
+    Database db;
+    db.recover("data.db", "data.log");
+    db.open_log("data.log");
+    // ... change the database ...
+    db.checkpoint("data.db");
+    ~~~
+
+    Inserts, updates, deletes, CSV imports, and changes to tables, columns
+    and keys are logged once they have been made, whether through the
+    Database or through a Table in it. Whether a change is on disk when the
+    call returns depends on \a options (see LogOptions). If the change
+    cannot be logged, an \a IOError is thrown after it has been made, and
+    the log takes no more changes. Changes to a table that refer to other
+    tables (such as IN) are redone in the order they were logged, so they
+    should not race with changes to those tables.
+
+    The log carries on from the last snapshot loaded or saved. Recover
+    from an existing log before opening it again, or its entries are lost.
+
+    Throws an \a InvalidOperationError if a log is already open.
+    Throws an \a IOError if \a path cannot be opened or is not a log.
    */
-  void load(string filename);
+  void open_log(string path, const LogOptions& options = LogOptions());
+
+  /**
+    Flush and close the log opened by open_log(). Later changes are not
+    logged. Does nothing if no log is open.
+   */
+  void close_log();
+
+  /**
+    Save the database to \a filename like save(), then empty the log, since
+    the snapshot now holds every change in it. Must not run at the same time
+    as changes to the database.
+    Throws an \a InvalidOperationError if no log is open.
+    Throws an \a IOError on failure.
+   */
+  void checkpoint(string filename);
+
+  /**
+    Load the snapshot \a filename like load(), or start empty if it doesn't
+    exist, then redo the changes in the log at \a log_path that the snapshot
+    doesn't include. A change cut short by a crash at the end of the log is
+    left out.
+    Throws an \a InvalidOperationError if a log is open.
+    Throws an \a IOError if either file is damaged or cannot be read.
+    \param filename the snapshot saved by checkpoint()
+    \param log_path the log opened by open_log()
+    \param mode whether to read the tables of the snapshot now, or map them
+   */
+  void recover(string filename, string log_path, LoadMode mode = read_all);
 
   /**
     Merge another database into this one.
@@ -154,8 +357,24 @@ public:
 private:
   typedef map<string, Table*> TableMap;
   TableMap tables_;
+  // Tables of mapped snapshots that haven't been used yet, and so aren't in
+  // tables_
+  typedef map<string, shared_ptr<MappedSnapshot> > MappedTableMap;
+  MappedTableMap mapped_tables_;
+
+  // The open log, or NULL, and the last log entry included in the tables
+  // when no log is open
+  WriteAheadLog* log_;
+  uint64_t log_sequence_;
+
+  bool has_table(const string& name) const;
+  void read_mapped_tables();
+  Table* attach(const string& name, Table* table);
 
   vector<string> split_select(string select);
+  vector<string> select_columns(const Table& source, string select);
+  void plan_query(const Table& source, string select, string where,
+                  vector<string>& projection, vector<unsigned>& selection);
 };
 
 #endif
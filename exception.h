@@ -12,6 +12,8 @@
 #define EXPORT __declspec(dllexport)
 
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 using namespace std;
 
@@ -43,6 +45,17 @@ class EXPORT KeyConflictError : public InvalidOperationError {
 public:
   KeyConflictError(const string& what)
     : InvalidOperationError(what) {}
+  KeyConflictError(const string& what, const vector<unsigned>& records)
+    : InvalidOperationError(what), records_(records) {}
+
+  /**
+   * The positions of the conflicting records in a batch passed to
+   * Table::insert_batch(). Empty for other inserts.
+   */
+  const vector<unsigned>& records() const { return records_; }
+
+private:
+  vector<unsigned> records_;
 };
 
 /** Thrown when the specified value cannot be converted to the requested type. */
@@ -0,0 +1,68 @@
+#include "group_table.h"
+
+#include <functional>
+#include <cstdint>
+
+static const unsigned initial_slots = 16;
+
+GroupTable::GroupTable() {
+  slots_.assign(initial_slots, 0);
+  slot_hashes_.assign(initial_slots, 0);
+  mask_ = initial_slots - 1;
+}
+
+// Mixes the hash before masking, since only its low bits pick the slot
+unsigned GroupTable::slot_for(size_t hash) const {
+  uint64_t mixed = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL;
+  return static_cast<unsigned>(mixed >> 32) & mask_;
+}
+
+unsigned GroupTable::find_or_add(const string& key, bool& added) {
+  size_t hash = std::hash<string>()(key);
+  unsigned slot = slot_for(hash);
+  while (slots_[slot] != 0) {
+    unsigned group = slots_[slot] - 1;
+    if (slot_hashes_[slot] == hash && keys_[group] == key) {
+      added = false;
+      return group;
+    }
+    slot = (slot + 1) & mask_;
+  }
+
+  added = true;
+  keys_.push_back(key);
+  slots_[slot] = keys_.size();
+  slot_hashes_[slot] = hash;
+  // Keep the table at most half full, so probe sequences stay short
+  if (keys_.size() * 2 > slots_.size())
+    grow();
+  return keys_.size() - 1;
+}
+
+unsigned GroupTable::size() const {
+  return keys_.size();
+}
+
+const string& GroupTable::key(unsigned group) const {
+  return keys_[group];
+}
+
+void GroupTable::grow() {
+  vector<unsigned> old_slots;
+  vector<size_t> old_hashes;
+  old_slots.swap(slots_);
+  old_hashes.swap(slot_hashes_);
+
+  slots_.assign(old_slots.size() * 2, 0);
+  slot_hashes_.assign(old_slots.size() * 2, 0);
+  mask_ = slots_.size() - 1;
+  for (unsigned i = 0; i < old_slots.size(); ++i) {
+    if (old_slots[i] == 0)
+      continue;
+    unsigned slot = slot_for(old_hashes[i]);
+    while (slots_[slot] != 0)
+      slot = (slot + 1) & mask_;
+    slots_[slot] = old_slots[i];
+    slot_hashes_[slot] = old_hashes[i];
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef GROUP_TABLE_H_
+#define GROUP_TABLE_H_
+#pragma warning(disable: 4251)
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "exception.h"
+
+/**
+ * Numbers the distinct keys it is given, in the order they are first seen.
+ * Used by Table::group_by() with keys encoded by Column::append_key().
+ *
+ * Keys live in one open-addressing table with linear probing. Each slot
+ * keeps the key's hash next to its group, so most probes that don't match
+ * are ruled out without comparing strings.
+ */
+class EXPORT GroupTable {
+public:
+  GroupTable();
+
+  /**
+   * Returns the group of \a key, adding a new group for it if there isn't
+   * one yet. \a added tells which happened.
+   */
+  unsigned find_or_add(const string& key, bool& added);
+
+  /** Returns the number of groups. */
+  unsigned size() const;
+
+  /** Returns the key of \a group. */
+  const string& key(unsigned group) const;
+
+private:
+  void grow();
+  unsigned slot_for(size_t hash) const;
+
+  // Group number + 1 for each slot, or 0 if the slot is empty
+  vector<unsigned> slots_;
+  vector<size_t> slot_hashes_;
+  unsigned mask_;
+
+  vector<string> keys_;
+};
+
+#endif  // GROUP_TABLE_H_
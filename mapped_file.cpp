@@ -0,0 +1,94 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const string& filename) {
+  data_ = NULL;
+  size_ = 0;
+  mapping_ = NULL;
+  // Sharing delete access lets a new snapshot be renamed over the file while
+  // tables still point into it
+  file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                      NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file_ == INVALID_HANDLE_VALUE)
+    throw IOError("Could not open " + filename);
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size)) {
+    CloseHandle(file_);
+    throw IOError("Could not read the size of " + filename);
+  }
+  size_ = size.QuadPart;
+  // Empty files can't be mapped, and have nothing to map anyway
+  if (size_ == 0)
+    return;
+
+  mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping_ != NULL)
+    data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (data_ == NULL) {
+    if (mapping_ != NULL)
+      CloseHandle(mapping_);
+    CloseHandle(file_);
+    throw IOError("Could not map " + filename);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != NULL)
+    UnmapViewOfFile(data_);
+  if (mapping_ != NULL)
+    CloseHandle(mapping_);
+  CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(const string& filename) {
+  data_ = NULL;
+  size_ = 0;
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw IOError("Could not open " + filename);
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw IOError("Could not read the size of " + filename);
+  }
+  size_ = info.st_size;
+  if (size_ != 0) {
+    void* data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED)
+      data_ = static_cast<const char*>(data);
+  }
+  // The mapping keeps the file open by itself
+  close(fd);
+  if (size_ != 0 && data_ == NULL)
+    throw IOError("Could not map " + filename);
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != NULL)
+    munmap(const_cast<char*>(data_), size_);
+}
+
+#endif
+
+const char* MappedFile::data() const {
+  return data_;
+}
+
+uint64_t MappedFile::size() const {
+  return size_;
+}
@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <string>
+#include <cstdint>
+using namespace std;
+
+#include "exception.h"
+
+/**
+ * A file mapped read-only into memory. Nothing is read when it is opened;
+ * the OS reads pages in as they are first touched, and may drop them again
+ * under memory pressure.
+ *
+ * The mapping stays valid until the MappedFile is destroyed. Columns that
+ * point into it share it through a shared_ptr (see ColumnArray).
+ */
+class MappedFile {
+public:
+  /** Throws an \a IOError if \a filename cannot be opened or mapped. */
+  MappedFile(const string& filename);
+  ~MappedFile();
+
+  /** The contents of the file. NULL if the file is empty. */
+  const char* data() const;
+  uint64_t size() const;
+
+private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const char* data_;
+  uint64_t size_;
+#ifdef _WIN32
+  void* file_;
+  void* mapping_;
+#endif
+};
+
+#endif  // MAPPED_FILE_H_
@@ -1,34 +1,122 @@
 #include "record.h"
 
-#include <sstream>
+Record::RecordIterator::RecordIterator() {
+  record_ = 0;
+  field_ = 0;
+  loaded_ = false;
+}
+
+Record::RecordIterator::RecordIterator(const Record* record, unsigned field) {
+  record_ = record;
+  field_ = field;
+  loaded_ = false;
+}
+
+const pair<string, string>& Record::RecordIterator::operator*() const {
+  if (!loaded_) {
+    current_ = make_pair(record_->schema_->name(field_), record_->values_[field_].to_string());
+    loaded_ = true;
+  }
+  return current_;
+}
+
+const pair<string, string>* Record::RecordIterator::operator->() const {
+  return &**this;
+}
+
+Record::RecordIterator& Record::RecordIterator::operator++() {
+  ++field_;
+  loaded_ = false;
+  return *this;
+}
+
+Record::RecordIterator Record::RecordIterator::operator++(int) {
+  RecordIterator old(record_, field_);
+  ++*this;
+  return old;
+}
+
+bool Record::RecordIterator::operator==(const RecordIterator& other) const {
+  return record_ == other.record_ && field_ == other.field_;
+}
+
+bool Record::RecordIterator::operator!=(const RecordIterator& other) const {
+  return !(*this == other);
+}
 
 Record::Record() {
-  values_ = vector<pair<string, string > >();
+  schema_ = make_shared<Schema>();
 }
 
 Record::Record(vector<pair<string, string> > entries) {
-  values_ = entries;
+  Schema::FieldList fields;
+  fields.reserve(entries.size());
+  values_.reserve(entries.size());
+  for (unsigned i = 0; i < entries.size(); ++i) {
+    fields.push_back(make_pair(entries[i].first, Schema::varchar));
+    values_.push_back(Value(entries[i].second));
+  }
+  schema_ = make_shared<Schema>(fields);
+}
+
+Record::Record(const SchemaPtr& schema) {
+  schema_ = schema;
+  values_.reserve(schema->size());
 }
 
 Record::~Record() {
 }
 
 Record::RecordIterator Record::begin() const {
-  return values_.begin();
+  return RecordIterator(this, 0);
 }
 
 Record::RecordIterator Record::end() const {
-  return values_.end();
+  return RecordIterator(this, values_.size());
+}
+
+unsigned Record::index_for(string field) const {
+  int index = schema_->find(field);
+  if (index < 0)
+    throw ColumnDoesNotExistError(field);
+  return index;
+}
+
+bool Record::is_null(string field) const {
+  return values_[index_for(field)].is_null();
+}
+
+unsigned Record::size() const {
+  return values_.size();
 }
 
 void Record::join(const Record& other) {
+  schema_ = schema_->joined(*other.schema_);
   values_.insert(values_.end(), other.values_.begin(), other.values_.end());
 }
 
 void Record::erase(string field) {
-  for (RecordIterator it = begin(); it != end(); it++)
-    if (it->first == field) {
-      values_.erase(it);
-      return;
-    }
-}
\ No newline at end of file
+  int index = schema_->find(field);
+  if (index < 0)
+    return;
+  schema_ = schema_->without_field(index);
+  values_.erase(values_.begin() + index);
+}
+
+void Record::set_value(const string& field, const Value& value) {
+  int index = schema_->find(field);
+  if (index >= 0) {
+    values_[index] = value;
+    return;
+  }
+
+  // Schemas are shared and never change, so adding a field makes a new one
+  schema_ = schema_->with_field(field, value.type());
+  values_.push_back(value);
+}
+
+const Value& Record::value(unsigned index) const {
+  if (index >= values_.size())
+    throw ColumnDoesNotExistError("Field index out of range");
+  return values_[index];
+}
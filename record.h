@@ -5,17 +5,25 @@
 #include <map>
 #include <string>
 #include <vector>
-#include <sstream>
+#include <iterator>
 
 using namespace std;
 
 #include "exception.h"
+#include "value.h"
+#include "schema.h"
 
 /**
  * Allows for read and write access of field values.
  *
  * In the context of a table, fields are known as columns, but within a record
  * they are called fields.
+ *
+ * Values are stored in their native type (see Value), so reading a number
+ * from a record that came out of a table does not parse any strings.
+ *
+ * Field names are kept in a Schema. Records that come out of a table all
+ * share the table's schema, so they only store their values.
  */
 class EXPORT Record {
 public:
@@ -26,7 +34,25 @@ public:
    * field name, the second is the value (in string form.)
    * \sa begin(), end()
    */
-  typedef vector<pair<string, string> >::const_iterator RecordIterator;
+  class EXPORT RecordIterator : public iterator<forward_iterator_tag, pair<string, string>, ptrdiff_t,
+                                                const pair<string, string>*, const pair<string, string>&> {
+  public:
+    RecordIterator();
+    RecordIterator(const Record* record, unsigned field);
+
+    const pair<string, string>& operator*() const;
+    const pair<string, string>* operator->() const;
+    RecordIterator& operator++();
+    RecordIterator operator++(int);
+    bool operator==(const RecordIterator& other) const;
+    bool operator!=(const RecordIterator& other) const;
+
+  private:
+    const Record* record_;
+    unsigned field_;
+    mutable pair<string, string> current_;
+    mutable bool loaded_;
+  };
 
   /**
     Create a record with no fields and no data.
@@ -74,8 +100,31 @@ public:
   template <typename T>
   T get(string field) const;
 
-  template <>
-  string get<string>(string field) const;
+  /**
+    Get the value of a field by its position in the record. Use index_for to
+    look up the position once when reading the same field from many records.
+
+    Throws a \a ColumnDoesNotExistError if \a index is out of range.
+   */
+  template <typename T>
+  T get(unsigned index) const;
+
+  /**
+    Returns true if \a field is NULL. get() returns T() for NULL fields, the
+    same as for a stored 0 or empty string, so this tells them apart.
+
+    Throws a \a ColumnDoesNotExistError if \a field doesn't exist.
+   */
+  bool is_null(string field) const;
+
+  /**
+    Returns the position of \a field in the record.
+    Throws a \a ColumnDoesNotExistError if \a field doesn't exist.
+   */
+  unsigned index_for(string field) const;
+
+  /** Returns the number of fields in the record. */
+  unsigned size() const;
 
   /**
     Set the value of a field by column name. The field is converted from the
@@ -93,82 +142,39 @@ public:
   template <typename T>
   void set(string field, T new_value);
 
-  template <>
-  void set<string>(string field, string new_value);
-
 protected:
   friend class Table;
+  friend class WriteAheadLog;
+  Record(const SchemaPtr& schema);
   void join(const Record& other);
   void erase(string field);
+  void set_value(const string& field, const Value& value);
+  const Value& value(unsigned index) const;
 
 private:
-  vector<pair<string, string> > values_;
+  SchemaPtr schema_;
+  vector<Value> values_;
 };
 
 template <typename T>
 T Record::get(string field) const {
-  // This does not work for strings, because stringstream will only give you the
-  // first word.
-  for (unsigned i = 0; i < values_.size(); i++) {
-    if (values_[i].first == field) {
-      if (values_[i].second == "")
-        return T();
-
-      stringstream ss;
-      ss << values_[i].second;
-
-      T value;
-      ss >> value;
-
-      return value;
-    }
-  }
-
-  throw ColumnDoesNotExistError(field);
+  int index = schema_->find(field);
+  if (index < 0)
+    throw ColumnDoesNotExistError(field);
+  return values_[index].get<T>();
 }
 
-template <>
-string Record::get<string>(string field) const {
-  for (unsigned i = 0; i < values_.size(); i++) {
-    if (values_[i].first == field) {
-      return values_[i].second;
-    }
-  }
-  throw ColumnDoesNotExistError(field);
+template <typename T>
+T Record::get(unsigned index) const {
+  return value(index).get<T>();
 }
 
 template <typename T>
 void Record::set(string field, T new_value) {
-  // This does not work for strings, because stringstream will only give you the
-  // first word.
   if (!TypeIsValid<T>::value)
     throw InvalidTypeError("Invalid type conversion: " + field);
 
-  stringstream ss;
-  ss << new_value;
-  string string_value;
-  ss >> string_value;
-
-  for (unsigned i = 0; i < values_.size(); i++) {
-    if (values_[i].first == field) {
-      values_[i].second = string_value;
-      return;
-    }
-  }
-
-  values_.push_back(make_pair(field, string_value));
-}
-
-template <>
-void Record::set<string>(string field, string new_value) {
-  for (unsigned i = 0; i < values_.size(); i++) {
-    if (values_[i].first == field) {
-      values_[i].second = new_value;
-      return;
-    }
-  }
-
-  values_.push_back(make_pair(field, new_value));
+  set_value(field, Value(new_value));
 }
 
 template< typename T >
@@ -0,0 +1,127 @@
+#include "result_view.h"
+
+#include <algorithm>
+
+ResultView::ViewIterator::ViewIterator() {
+  view_ = 0;
+  row_ = 0;
+  loaded_ = false;
+}
+
+ResultView::ViewIterator::ViewIterator(const ResultView* view, unsigned row) {
+  view_ = view;
+  row_ = row;
+  loaded_ = false;
+}
+
+const Record& ResultView::ViewIterator::operator*() const {
+  if (!loaded_) {
+    record_ = view_->at(row_);
+    loaded_ = true;
+  }
+  return record_;
+}
+
+const Record* ResultView::ViewIterator::operator->() const {
+  return &**this;
+}
+
+ResultView::ViewIterator& ResultView::ViewIterator::operator++() {
+  ++row_;
+  loaded_ = false;
+  return *this;
+}
+
+ResultView::ViewIterator ResultView::ViewIterator::operator++(int) {
+  ViewIterator old(view_, row_);
+  ++*this;
+  return old;
+}
+
+bool ResultView::ViewIterator::operator==(const ViewIterator& other) const {
+  return view_ == other.view_ && row_ == other.row_;
+}
+
+bool ResultView::ViewIterator::operator!=(const ViewIterator& other) const {
+  return !(*this == other);
+}
+
+ResultView::ResultView(const Table& source, const vector<string>& column_names, const vector<unsigned>& rows) {
+  Schema::FieldList fields;
+  for (unsigned i = 0; i < column_names.size(); ++i) {
+    columns_.push_back(source.index_for(column_names[i]));
+    fields.push_back(source.schema_->fields()[columns_.back()]);
+  }
+  unsigned source_rows = source.size();
+  for (unsigned i = 0; i < rows.size(); ++i)
+    if (rows[i] >= source_rows)
+      throw RowDoesNotExistError("Index out of Range");
+
+  source_ = &source;
+  column_names_ = column_names;
+  rows_ = rows;
+  schema_ = make_shared<Schema>(fields);
+  table_ = NULL;
+  source.views_.views.push_back(this);
+}
+
+ResultView::~ResultView() {
+  if (source_) {
+    vector<ResultView*>& views = source_->views_.views;
+    views.erase(find(views.begin(), views.end(), this));
+  }
+  delete table_;
+}
+
+int ResultView::size() const {
+  return table_ ? table_->size() : rows_.size();
+}
+
+Table::ColumnList ResultView::columns() const {
+  return table_ ? table_->columns() : schema_->fields();
+}
+
+Record ResultView::at(unsigned int i) const {
+  if (table_)
+    return table_->at(i);
+
+  if (i >= rows_.size())
+    throw RowDoesNotExistError("Index out of Range");
+  return source_->make_record(rows_[i], schema_, columns_);
+}
+
+ResultView::ViewIterator ResultView::begin() const {
+  return ViewIterator(this, 0);
+}
+
+ResultView::ViewIterator ResultView::end() const {
+  return ViewIterator(this, size());
+}
+
+bool ResultView::is_materialized() const {
+  return table_ != NULL;
+}
+
+Table* ResultView::table() {
+  if (!table_) {
+    vector<ResultView*>& views = source_->views_.views;
+    views.erase(find(views.begin(), views.end(), this));
+    detach();
+  }
+  return table_;
+}
+
+Table* ResultView::materialize() const {
+  if (table_)
+    return new Table(*table_);
+  return source_->project(column_names_, rows_);
+}
+
+// Takes a copy of the rows and forgets the source. The caller takes care of
+// removing the view from the source's list.
+void ResultView::detach() {
+  table_ = source_->project(column_names_, rows_);
+  source_ = NULL;
+  rows_.clear();
+  columns_.clear();
+}
@@ -0,0 +1,112 @@
+#ifndef RESULT_VIEW_H_
+#define RESULT_VIEW_H_
+#pragma warning(disable: 4251)
+
+#include <iterator>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "exception.h"
+#include "record.h"
+#include "schema.h"
+#include "table.h"
+
+/**
+ * The result of a query that refers to the rows of its source table instead
+ * of copying them.
+ *
+ * A view holds the source table, the numbers of the matching rows and the
+ * projected columns. Records are assembled from the source when rows are
+ * read.
+ *
+ * The view is materialized, i.e. takes its own copy of the rows, when
+ * table() is called so that the caller can change it, or just before the
+ * source table is changed or destroyed. Reading the view gives the same
+ * records either way.
+ *
+ * \sa Database::query_view()
+ */
+class EXPORT ResultView {
+public:
+  /**
+   * A const iterator over the records in a view. Like Table::TableIterator,
+   * the record is assembled when the iterator is dereferenced.
+   */
+  class EXPORT ViewIterator : public iterator<forward_iterator_tag, Record, ptrdiff_t, const Record*, const Record&> {
+  public:
+    ViewIterator();
+    ViewIterator(const ResultView* view, unsigned row);
+
+    const Record& operator*() const;
+    const Record* operator->() const;
+    ViewIterator& operator++();
+    ViewIterator operator++(int);
+    bool operator==(const ViewIterator& other) const;
+    bool operator!=(const ViewIterator& other) const;
+
+  private:
+    const ResultView* view_;
+    unsigned row_;
+    mutable Record record_;
+    mutable bool loaded_;
+  };
+
+  /**
+   * Creates a view of \a rows of \a source, with the columns in
+   * \a column_names (in that order).
+   *
+   * Throws a \a ColumnDoesNotExistError if any of the \a column_names don't exist.
+   * Throws a \a RowDoesNotExistError if any of the \a rows are out of range.
+   */
+  ResultView(const Table& source, const vector<string>& column_names, const vector<unsigned>& rows);
+
+  ~ResultView();
+
+  /** Returns the number of rows in the view. */
+  int size() const;
+
+  /** Returns a list of columns and their types. */
+  Table::ColumnList columns() const;
+
+  /**
+   * Returns the *i*th record in the view, starting at 0.
+   * Throws a \a RowDoesNotExistError if \a i is out of range.
+   */
+  Record at(unsigned int i) const;
+
+  ViewIterator begin() const;
+  ViewIterator end() const;
+
+  /** Returns true once the view holds its own copy of the rows. */
+  bool is_materialized() const;
+
+  /**
+   * Returns the rows of the view as a table that may be changed. The first
+   * call materializes the view. The table is owned by the view.
+   */
+  Table* table();
+
+  /** Returns a new table with a copy of the rows, owned by the caller. */
+  Table* materialize() const;
+
+private:
+  friend class Table;
+
+  // Views register themselves with their source, so they can't be copied
+  ResultView(const ResultView&);
+  ResultView& operator=(const ResultView&);
+
+  void detach();
+
+  // Until the view is materialized, rows are read from source_; afterwards
+  // source_ is NULL and table_ holds the rows
+  const Table* source_;
+  vector<string> column_names_;
+  vector<unsigned> columns_;
+  vector<unsigned> rows_;
+  SchemaPtr schema_;
+  Table* table_;
+};
+
+#endif  // RESULT_VIEW_H_
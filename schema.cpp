@@ -0,0 +1,75 @@
+#include "schema.h"
+
+Schema::Schema() {
+}
+
+Schema::Schema(const FieldList& fields) {
+  fields_ = fields;
+  for (unsigned i = 0; i < fields_.size(); ++i)
+    index_.insert(make_pair(fields_[i].first, i));
+}
+
+unsigned Schema::size() const {
+  return fields_.size();
+}
+
+const Schema::FieldList& Schema::fields() const {
+  return fields_;
+}
+
+const string& Schema::name(unsigned index) const {
+  return fields_[index].first;
+}
+
+Schema::RecordType Schema::type(unsigned index) const {
+  return fields_[index].second;
+}
+
+int Schema::find(const string& name) const {
+  unordered_map<string, unsigned>::const_iterator it = index_.find(name);
+  if (it == index_.end())
+    return -1;
+  return it->second;
+}
+
+unsigned Schema::index_for(const string& name) const {
+  int index = find(name);
+  if (index < 0)
+    throw ColumnDoesNotExistError("Could not find column " + name);
+  return index;
+}
+
+bool Schema::same_names(const Schema& other) const {
+  if (this == &other)
+    return true;
+  if (fields_.size() != other.fields_.size())
+    return false;
+  for (unsigned i = 0; i < fields_.size(); ++i)
+    if (fields_[i].first != other.fields_[i].first)
+      return false;
+  return true;
+}
+
+shared_ptr<const Schema> Schema::with_field(const string& name, RecordType type) const {
+  FieldList fields(fields_);
+  fields.push_back(make_pair(name, type));
+  return make_shared<Schema>(fields);
+}
+
+shared_ptr<const Schema> Schema::without_field(unsigned index) const {
+  FieldList fields(fields_);
+  fields.erase(fields.begin() + index);
+  return make_shared<Schema>(fields);
+}
+
+shared_ptr<const Schema> Schema::with_name(unsigned index, const string& name) const {
+  FieldList fields(fields_);
+  fields[index].first = name;
+  return make_shared<Schema>(fields);
+}
+
+shared_ptr<const Schema> Schema::joined(const Schema& other) const {
+  FieldList fields(fields_);
+  fields.insert(fields.end(), other.fields_.begin(), other.fields_.end());
+  return make_shared<Schema>(fields);
+}
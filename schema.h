@@ -0,0 +1,67 @@
+#ifndef SCHEMA_H_
+#define SCHEMA_H_
+#pragma warning(disable: 4251)
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+using namespace std;
+
+#include "exception.h"
+#include "column_type.h"
+
+/**
+ * An immutable list of field names and types, shared between a Table and
+ * every Record that comes out of it.
+ *
+ * Records keep a pointer to their schema instead of a copy of every field
+ * name, and look fields up by position. Name lookups go through a hash map.
+ *
+ * Because schemas never change, code that changes the fields (adding a
+ * column, setting a new field on a record) makes a new schema.
+ */
+class EXPORT Schema : public ColumnType {
+public:
+  typedef vector<pair<string, RecordType> > FieldList;
+
+  /** Creates a schema with no fields. */
+  Schema();
+  Schema(const FieldList& fields);
+
+  /** Returns the number of fields. */
+  unsigned size() const;
+
+  const FieldList& fields() const;
+  const string& name(unsigned index) const;
+  RecordType type(unsigned index) const;
+
+  /** Returns the position of the field \a name, or -1 if there is no such field. */
+  int find(const string& name) const;
+
+  /**
+   * Returns the position of the field \a name.
+   * Throws a \a ColumnDoesNotExistError if there is no such field.
+   */
+  unsigned index_for(const string& name) const;
+
+  /** Returns true if \a other has the same field names in the same order. */
+  bool same_names(const Schema& other) const;
+
+  /** Returns a copy of this schema with a field added at the end. */
+  shared_ptr<const Schema> with_field(const string& name, RecordType type) const;
+  /** Returns a copy of this schema without the field at \a index. */
+  shared_ptr<const Schema> without_field(unsigned index) const;
+  /** Returns a copy of this schema with the field at \a index renamed. */
+  shared_ptr<const Schema> with_name(unsigned index, const string& name) const;
+  /** Returns a schema with the fields of this schema followed by those of \a other. */
+  shared_ptr<const Schema> joined(const Schema& other) const;
+
+private:
+  FieldList fields_;
+  unordered_map<string, unsigned> index_;
+};
+
+typedef shared_ptr<const Schema> SchemaPtr;
+
+#endif  // SCHEMA_H_
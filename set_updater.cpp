@@ -9,8 +9,8 @@ SetUpdater::SetUpdater(string set_clause) {
   set_ = vector<Token>(set_.rbegin(), set_.rend());
 }
 
-void SetUpdater::update(deque<Record>::iterator record) {
-  record_ = record;
+void SetUpdater::update(Record& record) {
+  record_ = &record;
   tokens_ = set_;
   return parse_update();
 }
@@ -7,17 +7,16 @@
 
 #include <vector>
 #include <string>
-#include <deque>
 using namespace std;
 
 class EXPORT SetUpdater {
 public:
   SetUpdater(string set_clause);
-  void update(deque<Record>::iterator record);
+  void update(Record& record);
 private:
   vector<Token> tokens_;
   vector<Token> set_;
-  deque<Record>::iterator record_;
+  Record* record_;
 
   void parse_update();
 
@@ -0,0 +1,53 @@
+#include "simd.h"
+
+#ifdef SIMD_X86
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// Reads cpuid leaf `leaf` (subleaf 0) into registers eax, ebx, ecx, edx
+static void cpuid(unsigned leaf, unsigned registers[4]) {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuidex(info, leaf, 0);
+  for (int i = 0; i < 4; ++i)
+    registers[i] = info[i];
+#else
+  __cpuid_count(leaf, 0, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+bool has_sse2() {
+  unsigned registers[4];
+  cpuid(1, registers);
+  return (registers[3] & (1 << 26)) != 0;
+}
+
+bool has_avx2() {
+  unsigned registers[4];
+  cpuid(0, registers);
+  if (registers[0] < 7)
+    return false;
+
+  // The OS must save the YMM registers (OSXSAVE, then XCR0 bits 1 and 2)
+  cpuid(1, registers);
+  if ((registers[2] & (1 << 27)) == 0 || (registers[2] & (1 << 28)) == 0)
+    return false;
+#ifdef _MSC_VER
+  unsigned long long xcr0 = _xgetbv(0);
+#else
+  unsigned xcr0_low, xcr0_high;
+  __asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+  unsigned long long xcr0 = xcr0_low;
+#endif
+  if ((xcr0 & 6) != 6)
+    return false;
+
+  cpuid(7, registers);
+  return (registers[1] & (1 << 5)) != 0;
+}
+
+#endif  // SIMD_X86
@@ -0,0 +1,53 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include <cstdint>
+using namespace std;
+
+/**
+ * What the SIMD kernels (compare_kernels.h, aggregate_kernels.h) need to pick
+ * an implementation for the processor at hand, and bit counting for the
+ * bitmaps they work with.
+ *
+ * SIMD_X86 is defined when building for x86 or x64, together with the
+ * intrinsics. Functions using AVX2 or SSE2 intrinsics are marked TARGET_AVX2
+ * or TARGET_SSE2, and must only be called once has_avx2() or has_sse2() said
+ * so.
+ */
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// GCC only emits AVX2 instructions in functions marked for it; MSVC emits
+// whatever intrinsics are used
+#ifdef __GNUC__
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define TARGET_AVX2
+#define TARGET_SSE2
+#endif
+
+/** Returns the number of set bits in \a word. */
+inline unsigned popcount64(uint64_t word) {
+#ifdef __GNUC__
+  return __builtin_popcountll(word);
+#else
+  // POPCNT isn't on every processor SSE2 runs on, so add up the bits in ever
+  // wider fields
+  word -= (word >> 1) & 0x5555555555555555ULL;
+  word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+  word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return static_cast<unsigned>((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+#ifdef SIMD_X86
+bool has_sse2();
+/** Also checks that the OS saves the YMM registers. */
+bool has_avx2();
+#endif
+
+#endif  // SIMD_H_
@@ -0,0 +1,458 @@
+#include "snapshot.h"
+#include "table.h"
+#include "column.h"
+#include "mapped_file.h"
+#include "binary_io.h"
+#include "write_ahead_log.h"
+
+#include <fstream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+static const char magic[8] = { 'D', 'B', 'T', 'E', 'A', 'M', '0', '7' };
+static const unsigned block_alignment = 64;
+// magic, version, table count, catalog offset, size and checksum, and the
+// last log entry included
+static const unsigned header_bytes = 8 + 4 + 4 + 8 + 8 + 8 + 8;
+
+// Reads fields back out of the header or catalog, throwing if they run past
+// the end
+class FieldReader {
+public:
+  FieldReader(const string& data, size_t pos = 0) : data_(data), pos_(pos) {}
+
+  template <typename T>
+  T get() {
+    T value;
+    memcpy(&value, take(sizeof(value)), sizeof(value));
+    return value;
+  }
+
+  string get_string() {
+    uint32_t size = get<uint32_t>();
+    return string(take(size), size);
+  }
+
+  void skip(size_t bytes) {
+    take(bytes);
+  }
+
+  size_t position() const {
+    return pos_;
+  }
+
+private:
+  const char* take(size_t bytes) {
+    if (bytes > data_.size() - pos_)
+      throw IOError("Snapshot catalog is truncated");
+    const char* p = data_.data() + pos_;
+    pos_ += bytes;
+    return p;
+  }
+
+  const string& data_;
+  size_t pos_;
+};
+
+// Writes blocks on aligned offsets and records them in the catalog
+class BlockWriter {
+public:
+  BlockWriter(ofstream& out, string& catalog) : out_(out), catalog_(catalog), offset_(header_bytes) {}
+
+  void write(const void* data, size_t bytes) {
+    static const char padding[block_alignment] = { 0 };
+    unsigned pad = (block_alignment - offset_ % block_alignment) % block_alignment;
+    out_.write(padding, pad);
+    offset_ += pad;
+
+    put<uint64_t>(catalog_, offset_);
+    put<uint64_t>(catalog_, bytes);
+    put<uint64_t>(catalog_, checksum(data, bytes));
+    out_.write(static_cast<const char*>(data), bytes);
+    offset_ += bytes;
+  }
+
+  uint64_t offset() const {
+    return offset_;
+  }
+
+private:
+  ofstream& out_;
+  string& catalog_;
+  uint64_t offset_;
+};
+
+
+// Reads the blocks described in the catalog, checking each against the size
+// of the file. Blocks are either read from a stream and checked against their
+// checksum, or, for a mapped snapshot, pointed at where they are in the
+// mapping. Checking a mapped block would read all of it, so it isn't.
+class BlockReader {
+public:
+  BlockReader(ifstream& in, uint64_t file_size) : in_(&in), file_size_(file_size) {}
+
+  BlockReader(const shared_ptr<const MappedFile>& file) : in_(NULL), file_(file), file_size_(file->size()) {}
+
+  // Returns the size in bytes of the next block in the catalog
+  uint64_t next(FieldReader& catalog) {
+    offset_ = catalog.get<uint64_t>();
+    bytes_ = catalog.get<uint64_t>();
+    checksum_ = catalog.get<uint64_t>();
+    if (offset_ > file_size_ || bytes_ > file_size_ - offset_)
+      throw IOError("Snapshot is truncated");
+    return bytes_;
+  }
+
+  // Makes `values` the block last returned by next(), which holds `size`
+  // values
+  template <typename T>
+  void read(ColumnArray<T>& values, size_t size) {
+    if (file_) {
+      values.map(file_, size == 0 ? NULL : reinterpret_cast<const T*>(file_->data() + offset_), size);
+      return;
+    }
+
+    values.resize(size);
+    if (size == 0)
+      return;
+    in_->seekg(offset_);
+    in_->read(reinterpret_cast<char*>(&values[0]), bytes_);
+    if (!*in_)
+      throw IOError("Snapshot could not be read");
+    if (checksum(&values[0], bytes_) != checksum_)
+      throw IOError("Snapshot fails its checksum");
+  }
+
+private:
+  ifstream* in_;
+  shared_ptr<const MappedFile> file_;
+  uint64_t file_size_;
+  uint64_t offset_;
+  uint64_t bytes_;
+  uint64_t checksum_;
+};
+
+template <typename T>
+static void write_array(BlockWriter& writer, const ColumnArray<T>& values) {
+  writer.write(values.data(), values.size() * sizeof(T));
+}
+
+template <typename T>
+static void read_array(BlockReader& reader, FieldReader& catalog, ColumnArray<T>& values, unsigned size) {
+  if (reader.next(catalog) != static_cast<uint64_t>(size) * sizeof(T))
+    throw IOError("Snapshot block has the wrong size");
+  reader.read(values, size);
+}
+
+// Where the catalog is, as given by the header
+struct CatalogInfo {
+  uint32_t table_count;
+  uint64_t offset;
+  uint64_t bytes;
+  uint64_t checksum;
+  uint64_t log_sequence;
+};
+
+// Checks the magic and version in `header`, and returns where the catalog is
+static CatalogInfo read_header(const string& header, uint64_t file_size, const string& filename) {
+  if (header.size() < header_bytes || header.compare(0, sizeof(magic), magic, sizeof(magic)) != 0)
+    throw IOError(filename + " is not a database snapshot");
+  FieldReader fields(header);
+  fields.get<uint64_t>();  // the magic
+  if (fields.get<uint32_t>() != Snapshot::version)
+    throw IOError(filename + " is a snapshot from another version of the database");
+
+  CatalogInfo info;
+  info.table_count = fields.get<uint32_t>();
+  info.offset = fields.get<uint64_t>();
+  info.bytes = fields.get<uint64_t>();
+  info.checksum = fields.get<uint64_t>();
+  info.log_sequence = fields.get<uint64_t>();
+  if (info.offset > file_size || info.bytes != file_size - info.offset)
+    throw IOError("Snapshot is truncated");
+  return info;
+}
+
+static void check_catalog(const string& catalog, const CatalogInfo& info) {
+  if (checksum(catalog.data(), catalog.size()) != info.checksum)
+    throw IOError("Snapshot catalog fails its checksum");
+}
+
+// Moves `catalog` past the entry of a table, after its name
+static void skip_table(FieldReader& catalog) {
+  vector<uint32_t> types;
+  uint32_t column_count = catalog.get<uint32_t>();
+  for (uint32_t i = 0; i < column_count; ++i) {
+    catalog.get_string();
+    types.push_back(catalog.get<uint32_t>());
+  }
+  uint32_t key_size = catalog.get<uint32_t>();
+  for (uint32_t i = 0; i < key_size; ++i)
+    catalog.get_string();
+  catalog.get<uint32_t>();  // the number of rows
+
+  // The bitmap and the values, or the bitmap, offsets, lengths and blob
+  unsigned blocks = 0;
+  for (uint32_t type : types)
+    blocks += type == Table::varchar ? 4 : 2;
+  catalog.skip(blocks * 3 * sizeof(uint64_t));
+}
+
+void Snapshot::save(const TableMap& tables, const string& filename, uint64_t log_sequence) {
+  string temp = filename + ".tmp";
+  ofstream out(temp.c_str(), ios::binary | ios::trunc);
+  if (!out)
+    throw IOError("Could not open " + temp + " for writing");
+
+  // The header is written last, once the catalog has been
+  string catalog;
+  out.write(string(header_bytes, '\0').data(), header_bytes);
+  BlockWriter writer(out, catalog);
+  for (auto name_table : tables)
+    write_table(writer, catalog, name_table.first, *name_table.second);
+
+  string header(magic, sizeof(magic));
+  put<uint32_t>(header, version);
+  put<uint32_t>(header, tables.size());
+  put<uint64_t>(header, writer.offset());
+  put<uint64_t>(header, catalog.size());
+  put<uint64_t>(header, checksum(catalog.data(), catalog.size()));
+  put<uint64_t>(header, log_sequence);
+  out.write(catalog.data(), catalog.size());
+  out.seekp(0);
+  out.write(header.data(), header.size());
+  out.close();
+  if (out.fail()) {
+    remove(temp.c_str());
+    throw IOError("Could not write " + temp);
+  }
+
+  // The snapshot has to be on disk before it replaces the old one, and the
+  // rename has to be before a checkpoint empties the log
+  try {
+    sync_file(temp);
+  } catch (...) {
+    remove(temp.c_str());
+    throw;
+  }
+#ifdef _WIN32
+  DWORD flags = MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH;
+  bool replaced = MoveFileExA(temp.c_str(), filename.c_str(), flags) != 0;
+  // Windows may refuse to replace a file that is still mapped, as it is when
+  // the tables were loaded from it in mapped mode
+  if (!replaced) {
+    for (auto name_table : tables)
+      unmap_table(*name_table.second);
+    replaced = MoveFileExA(temp.c_str(), filename.c_str(), flags) != 0;
+  }
+#else
+  bool replaced = rename(temp.c_str(), filename.c_str()) == 0;
+#endif
+  if (!replaced) {
+    remove(temp.c_str());
+    throw IOError("Could not replace " + filename);
+  }
+#ifndef _WIN32
+  size_t slash = filename.rfind('/');
+  sync_file(slash == string::npos ? "." : filename.substr(0, slash + 1));
+#endif
+}
+
+void Snapshot::unmap_table(Table& table) {
+  for (Column& column : table.data_) {
+    column.valid_.unmap();
+    column.ints_.unmap();
+    column.floats_.unmap();
+    column.offsets_.unmap();
+    column.lengths_.unmap();
+    column.blob_.unmap();
+  }
+}
+
+void Snapshot::write_table(BlockWriter& writer, string& catalog, const string& name, const Table& table) {
+  put_string(catalog, name);
+  put<uint32_t>(catalog, table.schema_->size());
+  for (unsigned i = 0; i < table.schema_->size(); ++i) {
+    put_string(catalog, table.schema_->name(i));
+    put<uint32_t>(catalog, table.schema_->type(i));
+  }
+  put<uint32_t>(catalog, table.key_.size());
+  for (const string& column : table.key_)
+    put_string(catalog, column);
+
+  put<uint32_t>(catalog, table.size());
+  for (const Column& column : table.data_)
+    write_column(writer, column);
+}
+
+void Snapshot::write_column(BlockWriter& writer, const Column& column) {
+  if (column.garbage_ != 0) {
+    // Leave overwritten strings out of the snapshot
+    Column compacted(column);
+    compacted.compact_blob();
+    write_column(writer, compacted);
+    return;
+  }
+
+  write_array(writer, column.valid_);
+  switch (column.type_) {
+  case Column::floating:
+    write_array(writer, column.floats_);
+    break;
+  case Column::varchar:
+    write_array(writer, column.offsets_);
+    write_array(writer, column.lengths_);
+    writer.write(column.blob_.data(), column.blob_.size());
+    break;
+  default:
+    write_array(writer, column.ints_);
+  }
+}
+
+uint64_t Snapshot::load(const string& filename, TableMap& tables) {
+  ifstream in(filename.c_str(), ios::binary);
+  if (!in)
+    throw IOError("Could not open " + filename);
+  in.seekg(0, ios::end);
+  uint64_t file_size = in.tellg();
+  in.seekg(0);
+
+  string header(header_bytes, '\0');
+  in.read(&header[0], header_bytes);
+  header.resize(static_cast<size_t>(in.gcount()));
+  CatalogInfo info = read_header(header, file_size, filename);
+
+  string catalog_data(static_cast<size_t>(info.bytes), '\0');
+  in.clear();
+  in.seekg(info.offset);
+  in.read(&catalog_data[0], catalog_data.size());
+  if (!in)
+    throw IOError("Snapshot could not be read");
+  check_catalog(catalog_data, info);
+
+  FieldReader catalog(catalog_data);
+  BlockReader reader(in, file_size);
+  TableMap loaded;
+  try {
+    for (uint32_t i = 0; i < info.table_count; ++i) {
+      string name = catalog.get_string();
+      Table* table = read_table(reader, catalog);
+      if (!loaded.insert(make_pair(name, table)).second) {
+        delete table;
+        throw IOError("Snapshot has two tables named " + name);
+      }
+    }
+    for (auto name_table : loaded) {
+      if (tables.count(name_table.first) != 0)
+        throw IOError("Table " + name_table.first + " is already loaded");
+    }
+  } catch (...) {
+    for (auto name_table : loaded)
+      delete name_table.second;
+    throw;
+  }
+  tables.insert(loaded.begin(), loaded.end());
+  return info.log_sequence;
+}
+
+Table* Snapshot::read_table(BlockReader& reader, FieldReader& catalog) {
+  Table::ColumnList columns;
+  uint32_t column_count = catalog.get<uint32_t>();
+  for (uint32_t i = 0; i < column_count; ++i) {
+    string name = catalog.get_string();
+    uint32_t type = catalog.get<uint32_t>();
+    if (type < Table::integer || type > Table::time)
+      throw IOError("Snapshot has a column of unknown type");
+    columns.push_back(make_pair(name, static_cast<Table::RecordType>(type)));
+  }
+
+  Table* table = new Table(columns);
+  try {
+    vector<string> key;
+    uint32_t key_size = catalog.get<uint32_t>();
+    for (uint32_t i = 0; i < key_size; ++i)
+      key.push_back(catalog.get_string());
+    table->set_key(key);
+
+    uint32_t rows = catalog.get<uint32_t>();
+    for (Column& column : table->data_)
+      read_column(reader, catalog, column, rows);
+    // The key index is rebuilt from the columns rather than stored
+    table->rebuild_key_index();
+  } catch (...) {
+    delete table;
+    throw;
+  }
+  return table;
+}
+
+void Snapshot::read_column(BlockReader& reader, FieldReader& catalog, Column& column, unsigned rows) {
+  read_array(reader, catalog, column.valid_, (rows + 63) / 64);
+  switch (column.type_) {
+  case Column::floating:
+    read_array(reader, catalog, column.floats_, rows);
+    break;
+  case Column::varchar: {
+    read_array(reader, catalog, column.offsets_, rows);
+    read_array(reader, catalog, column.lengths_, rows);
+    reader.read(column.blob_, static_cast<size_t>(reader.next(catalog)));
+    // Checked so a damaged file can't make reads run off the blob. Reads
+    // through the const column, so mapped arrays aren't copied.
+    const Column& loaded = column;
+    for (unsigned row = 0; row < rows; ++row) {
+      if (loaded.offsets_[row] > loaded.blob_.size() ||
+          loaded.lengths_[row] > loaded.blob_.size() - loaded.offsets_[row])
+        throw IOError("Snapshot has a string outside its column");
+    }
+    break;
+  }
+  default:
+    read_array(reader, catalog, column.ints_, rows);
+  }
+}
+
+MappedSnapshot::MappedSnapshot(const string& filename) {
+  file_ = make_shared<MappedFile>(filename);
+  const char* data = file_->data();
+  uint64_t file_size = file_->size();
+  string header(data, static_cast<size_t>(min<uint64_t>(header_bytes, file_size)));
+  CatalogInfo info = read_header(header, file_size, filename);
+  catalog_.assign(data + info.offset, static_cast<size_t>(info.bytes));
+  check_catalog(catalog_, info);
+  log_sequence_ = info.log_sequence;
+
+  FieldReader catalog(catalog_);
+  for (uint32_t i = 0; i < info.table_count; ++i) {
+    string name = catalog.get_string();
+    if (!table_positions_.insert(make_pair(name, catalog.position())).second)
+      throw IOError("Snapshot has two tables named " + name);
+    skip_table(catalog);
+  }
+}
+
+vector<string> MappedSnapshot::table_names() const {
+  vector<string> names;
+  for (auto name_position : table_positions_)
+    names.push_back(name_position.first);
+  return names;
+}
+
+uint64_t MappedSnapshot::log_sequence() const {
+  return log_sequence_;
+}
+
+Table* MappedSnapshot::read_table(const string& name) const {
+  map<string, size_t>::const_iterator it = table_positions_.find(name);
+  if (it == table_positions_.end())
+    throw TableDoesNotExistError("Table " + name + " could not be found");
+  FieldReader catalog(catalog_, it->second);
+  BlockReader reader(file_);
+  return Snapshot::read_table(reader, catalog);
+}
@@ -0,0 +1,123 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+#pragma warning(disable: 4251)
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <cstdint>
+using namespace std;
+
+#include "exception.h"
+
+class Table;
+class Column;
+class MappedFile;
+class BlockWriter;
+class BlockReader;
+class FieldReader;
+
+/**
+ * Reads and writes the binary snapshots behind Database::save() and
+ * Database::load().
+ *
+ * A snapshot stores the typed arrays of each Column as they are in memory,
+ * so loading one is a few bulk reads instead of parsing text. A file holds:
+ *   - a fixed header: the magic "DBTEAM07", the format version, where the
+ *     catalog is, how long it is and its checksum, and the sequence number
+ *     of the last write-ahead log entry the snapshot includes
+ *   - the data blocks, one per array of each column (the validity bitmap,
+ *     the ints or floats, and for varchar the offsets, lengths and blob),
+ *     each starting on a 64-byte boundary
+ *   - the catalog: the name, columns, key and number of rows of each table,
+ *     and the position, size and checksum of each of its blocks
+ *
+ * Numbers are stored in the byte order of the machine, which is little-endian
+ * on every platform the database is built for. The catalog and every block
+ * carry a 64-bit checksum, so a truncated or damaged file is reported rather
+ * than loaded.
+ *
+ * A snapshot can also be mapped into memory instead (see MappedSnapshot).
+ */
+class Snapshot {
+public:
+  typedef map<string, Table*> TableMap;
+
+  /** The format version written by save(). load() only reads this version. */
+  static const uint32_t version = 2;
+
+  /**
+   * Writes \a tables to \a filename, noting that they include the log
+   * entries up to \a log_sequence (see WriteAheadLog). The snapshot is
+   * written to "filename.tmp" and flushed to disk first, and only replaces
+   * \a filename once it is complete. If \a filename is mapped by some of
+   * \a tables and can't be replaced while it is (as on older Windows), their
+   * columns are copied out of the mapping first.
+   * Throws an \a IOError if the file cannot be written.
+   */
+  static void save(const TableMap& tables, const string& filename, uint64_t log_sequence);
+
+  /**
+   * Reads the tables in \a filename and adds them to \a tables, which takes
+   * ownership of them, and returns the sequence number of the last log entry
+   * they include. Nothing is added if loading fails.
+   * Throws an \a IOError if the file cannot be read, is not a snapshot of
+   * this version, or fails a checksum.
+   */
+  static uint64_t load(const string& filename, TableMap& tables);
+
+private:
+  friend class MappedSnapshot;
+
+  Snapshot();
+
+  static void write_table(BlockWriter& writer, string& catalog, const string& name, const Table& table);
+  static void write_column(BlockWriter& writer, const Column& column);
+  static void unmap_table(Table& table);
+  static Table* read_table(BlockReader& reader, FieldReader& catalog);
+  static void read_column(BlockReader& reader, FieldReader& catalog, Column& column, unsigned rows);
+};
+
+/**
+ * A snapshot mapped into memory, for Database::load() in mapped mode.
+ *
+ * Opening it reads only the header and the catalog. A table is set up when
+ * read_table() asks for it, and its columns then point into the mapping
+ * (see ColumnArray), so the OS reads a column's pages in when a query first
+ * touches them. Blocks read this way aren't checked against their checksums,
+ * since that would read them in full; the catalog still is.
+ */
+class MappedSnapshot {
+public:
+  /**
+   * Throws an \a IOError if \a filename cannot be mapped, is not a snapshot
+   * of this version, or its catalog fails its checksum.
+   */
+  MappedSnapshot(const string& filename);
+
+  vector<string> table_names() const;
+
+  /** The sequence number of the last log entry the snapshot includes. */
+  uint64_t log_sequence() const;
+
+  /**
+   * Returns a new table whose columns point into the mapping. The caller
+   * owns it, and it keeps the mapping open for as long as it needs it.
+   * Throws a \a TableDoesNotExistError if the snapshot has no table \a name.
+   * Throws an \a IOError if its entry in the catalog doesn't fit the file.
+   */
+  Table* read_table(const string& name) const;
+
+private:
+  MappedSnapshot(const MappedSnapshot&);
+  MappedSnapshot& operator=(const MappedSnapshot&);
+
+  shared_ptr<const MappedFile> file_;
+  string catalog_;
+  uint64_t log_sequence_;
+  // Where the entry of each table starts in catalog_, after its name
+  map<string, size_t> table_positions_;
+};
+
+#endif  // SNAPSHOT_H_
@@ -3,19 +3,95 @@
 #include "record.h"
 #include "where_matcher.h"
 #include "set_updater.h"
+#include "result_view.h"
+#include "group_table.h"
 
 #include <regex>
+#include <algorithm>
+
+Table::TableIterator::TableIterator() {
+  table_ = 0;
+  row_ = 0;
+  loaded_ = false;
+}
+
+Table::TableIterator::TableIterator(const Table* table, unsigned row) {
+  table_ = table;
+  row_ = row;
+  loaded_ = false;
+}
+
+const Record& Table::TableIterator::operator*() const {
+  if (!loaded_) {
+    record_ = table_->make_record(row_);
+    loaded_ = true;
+  }
+  return record_;
+}
+
+const Record* Table::TableIterator::operator->() const {
+  return &**this;
+}
+
+Table::TableIterator& Table::TableIterator::operator++() {
+  ++row_;
+  loaded_ = false;
+  return *this;
+}
+
+Table::TableIterator Table::TableIterator::operator++(int) {
+  TableIterator old(table_, row_);
+  ++*this;
+  return old;
+}
+
+bool Table::TableIterator::operator==(const TableIterator& other) const {
+  return table_ == other.table_ && row_ == other.row_;
+}
+
+bool Table::TableIterator::operator!=(const TableIterator& other) const {
+  return !(*this == other);
+}
+
+unsigned Table::TableIterator::row() const {
+  return row_;
+}
 
 Table::Table() {
-	records_ = deque<Record> ();
-	columns_ = ColumnList ();
+  schema_ = make_shared<Schema>();
+  version_ = 0;
 }
 
 Table::Table(const ColumnList& columns) {
-	columns_ = columns;
+  schema_ = make_shared<Schema>(columns);
+  version_ = 0;
+  for (unsigned i = 0; i < columns.size(); ++i)
+    data_.push_back(Column(columns[i].second));
+}
+
+Table::Table(const Table& other)
+  : version_(other.version_), data_(other.data_), schema_(other.schema_),
+    key_(other.key_), key_columns_(other.key_columns_),
+    key_index_(other.key_index_) {
 }
 
 Table::~Table() {
+  views_.detach_all();
+}
+
+Table& Table::operator=(const Table& other) {
+  if (this == &other)
+    return *this;
+  // Open cursors and views are of the old contents
+  before_change();
+  data_ = other.data_;
+  schema_ = other.schema_;
+  key_ = other.key_;
+  key_columns_ = other.key_columns_;
+  key_index_ = other.key_index_;
+  // The table keeps its own log
+  log_.replaced(*this);
+  return *this;
 }
 
 Table* Table::clone_structure() {
@@ -26,58 +102,62 @@ Table* Table::clone_structure() {
 }
 
 void Table::add_column(string column_name, RecordType type) {
-	columns_.push_back(make_pair(column_name, type));
-  for (deque<Record>::iterator it = records_.begin(); it != records_.end(); it++)
-    it->set(column_name, "");
+  before_change();
+  schema_ = schema_->with_field(column_name, type);
+  data_.push_back(Column(type));
+  Column& added = data_.back();
+  unsigned rows = size();
+  added.reserve(rows);
+  for (unsigned i = 0; i < rows; ++i)
+    added.append_null();
+  log_.column_added(column_name, type);
 }
 
 void Table::del_column(string column_name) {
-  for (ColumnList::iterator it = columns_.begin(); it != columns_.end(); ++it) {
-	  if (it->first == column_name) {
-		  columns_.erase(it);
-      for (deque<Record>::iterator itt = records_.begin(); itt != records_.end(); itt++)
-        itt->erase(column_name);
-      return;
-     }
-	}
-  throw ColumnDoesNotExistError("Could not find column " + column_name);
+  unsigned index = index_for(column_name);
+  before_change();
+  schema_ = schema_->without_field(index);
+  data_.erase(data_.begin() + index);
+
+  // The remaining key columns may not be unique on their own
+  if (std::find(key_.begin(), key_.end(), column_name) != key_.end()) {
+    key_.clear();
+    key_columns_.clear();
+    key_index_.clear();
+  } else {
+    for (unsigned i = 0; i < key_columns_.size(); ++i)
+      if (key_columns_[i] > index)
+        --key_columns_[i];
+  }
+  log_.column_deleted(column_name);
 }
 
 void Table::rename_column(string from, string to) {
-	for (unsigned i = 0; i < columns_.size(); i++) {
-		if (columns_[i].first == from) {
-      columns_[i].first = to;
-      return;
-    }
-	}
-  throw ColumnDoesNotExistError("Could not find column " + from);
+  before_change();
+  schema_ = schema_->with_name(index_for(from), to);
+  replace(key_.begin(), key_.end(), from, to);
+  log_.column_renamed(from, to);
 }
 
 Table::ColumnList Table::columns() const {
-  return columns_;
+  return schema_->fields();
 }
 
 unsigned int Table::index_for(string column_name) const {
-  for (unsigned int i = 0; i < columns_.size(); ++i)
-    if (columns_[i].first == column_name)
-      return i;
-  throw ColumnDoesNotExistError("Could not find column " + column_name);
+  return schema_->index_for(column_name);
 }
 
 void Table::set_key(vector<string> column_names) {
   if (size() != 0)
     throw InvalidOperationError("Cannot add key to non-empty table");
 	// TODO needs to check for duplicates within row
-  bool key_found;
-	for (string col : column_names) {
-    key_found = false;
-    for (ColumnList::iterator it = columns_.begin(); it != columns_.end(); it++)
-      if (it->first == col)
-        key_found = true;
-    if (!key_found)
-      throw ColumnDoesNotExistError("Could not find column " + col);
-  }
+  vector<unsigned> key_columns;
+	for (string col : column_names)
+    key_columns.push_back(index_for(col));  // throws if the column doesn't exist
 	key_ = column_names;
+  key_columns_ = key_columns;
+  key_index_.clear();
+  log_.key_set(column_names);
 }
 
 vector<string> Table::key() const {
@@ -85,159 +165,935 @@ vector<string> Table::key() const {
 }
 
 int Table::size() const {
-  return records_.size();
+  return data_.empty() ? 0 : data_[0].size();
+}
+
+// Checks column names and order. Records that came out of this table share
+// its schema, so usually only the pointers need to be compared.
+void Table::check_schema(const Record& record) const {
+  if (record.schema_ != schema_ && !record.schema_->same_names(*schema_)) {
+    if (record.size() != schema_->size())
+      throw ColumnDoesNotExistError("Number of columns in record does not match number of columns in table");
+    for (unsigned i = 0; i < record.size(); ++i) {
+      if (record.schema_->name(i) != schema_->name(i)) {
+        throw ColumnDoesNotExistError("Column " + record.schema_->name(i) + " in record does not match column in table (" + schema_->name(i) + ")");
+      }
+    }
+  }
 }
 
 void Table::insert(const Record& record) {
-  // Check column names and order
-  if (record.values_.size() != columns_.size()) {
-    throw ColumnDoesNotExistError("Number of columns in record does not match number of columns in table");
+  check_schema(record);
+
+  // If there is a key, check for conflicts
+  string key;
+  if (!key_.empty()) {
+    key = key_for_record(record);
+    if (key_index_.count(key))
+      throw KeyConflictError("Already a record with this key");
+  }
+
+  before_change();
+
+  // Append each field to its column, undoing the partial row if a value has
+  // the wrong type
+  unsigned appended = 0;
+  try {
+    for (; appended < data_.size(); ++appended)
+      data_[appended].append(record.values_[appended]);
+  } catch (const InvalidTypeError&) {
+    while (appended > 0)
+      data_[--appended].pop_back();
+    throw;
   }
-  for (unsigned i = 0; i < record.values_.size(); ++i) {
-    if (record.values_[i].first != columns_[i].first) {
-      throw ColumnDoesNotExistError("Column " + record.values_[i].first + " in record does not match column in table (" + columns_[i].first + ")");
+
+  if (!key_.empty())
+    key_index_.insert(make_pair(key, size() - 1));
+  log_.inserted(*this, size() - 1);
+}
+
+void Table::insert_batch(const vector<Record>& records) {
+  // Records of one batch mostly share a schema, so it is usually checked once
+  const Schema* checked = NULL;
+  for (const Record& record : records) {
+    if (record.schema_.get() != checked) {
+      check_schema(record);
+      checked = record.schema_.get();
     }
   }
 
-  // If there is a key, check for conflicts
-	if (!key().empty()) {
-		for (unsigned i = 0; i < records_.size(); i++) {
-      bool unequal = false;
-			for (unsigned j = 0; j < key_.size(); j++) {
-				if (records_[i].get<string>(key_[j]) != record.get<string>(key_[j])) {
-          unequal = true;
-          break;
-				}
-			}
-      if (!unequal) {
-        throw KeyConflictError("Already a record with this key");
+  // Encode the keys (which throws if a key value has the wrong type), then
+  // index them in one pass, noting the records whose key is already in the
+  // table or earlier in the batch
+  unsigned old_rows = size();
+  vector<string> keys;
+  vector<bool> indexed;
+  vector<unsigned> conflicts;
+  if (!key_.empty()) {
+    keys.reserve(records.size());
+    for (const Record& record : records)
+      keys.push_back(key_for_record(record));
+    indexed.assign(records.size(), false);
+    key_index_.reserve(old_rows + records.size());
+    for (unsigned i = 0; i < records.size(); ++i) {
+      indexed[i] = key_index_.insert(make_pair(keys[i], old_rows + i)).second;
+      if (!indexed[i])
+        conflicts.push_back(i);
+    }
+  }
+
+  // Takes the batch's keys out of the index again
+  auto unindex = [&]() {
+    for (unsigned i = 0; i < keys.size(); ++i)
+      if (indexed[i])
+        key_index_.erase(keys[i]);
+  };
+  if (!conflicts.empty()) {
+    unindex();
+    ostringstream message;
+    message << conflicts.size() << " records of the batch have the key of another record, the first at position " << conflicts[0];
+    throw KeyConflictError(message.str(), conflicts);
+  }
+
+  before_change();
+
+  // Fill one column at a time, with room made for the whole batch up front,
+  // and take the batch out again if a value has the wrong type
+  try {
+    for (unsigned i = 0; i < data_.size(); ++i) {
+      Column& column = data_[i];
+      column.reserve(old_rows + records.size());
+      if (column.type() == varchar) {
+        size_t text_bytes = 0;
+        for (const Record& record : records)
+          text_bytes += record.values_[i].text().size();
+        column.reserve_text(text_bytes);
       }
-		}
-	}
+      for (const Record& record : records)
+        column.append(record.values_[i]);
+    }
+  } catch (const InvalidTypeError&) {
+    for (Column& column : data_)
+      while (column.size() > old_rows)
+        column.pop_back();
+    unindex();
+    throw;
+  }
+  log_.inserted(*this, old_rows);
+}
+
+Table::TableIterator Table::find(const vector<string>& key_values) const {
+  if (key_.empty())
+    throw InvalidOperationError("Table has no key");
+  if (key_values.size() != key_columns_.size())
+    throw InvalidOperationError("Number of values does not match the key");
+
+  string key;
+  for (unsigned i = 0; i < key_columns_.size(); ++i)
+    data_[key_columns_[i]].append_key(Value(key_values[i]), key);
 
-	records_.push_back(record);
+  unordered_map<string, unsigned>::const_iterator it = key_index_.find(key);
+  if (it == key_index_.end())
+    return end();
+  return TableIterator(this, it->second);
+}
+
+Table::ViewList::ViewList() {
+}
+
+Table::ViewList::ViewList(const ViewList&) {
+}
+
+Table::ViewList& Table::ViewList::operator=(const ViewList&) {
+  detach_all();
+  return *this;
+}
+
+void Table::ViewList::detach_all() {
+  vector<ResultView*> detached;
+  detached.swap(views);
+  for (unsigned i = 0; i < detached.size(); ++i)
+    detached[i]->detach();
 }
 
 Table::TableIterator Table::begin() const {
-  return records_.begin();
+  return TableIterator(this, 0);
 }
 
 Table::TableIterator Table::end() const {
-  return records_.end();
+  return TableIterator(this, size());
 }
 
-const Record& Table::first() const {
-  return records_.front();
+Record Table::first() const {
+  return at(0);
 }
 
-const Record& Table::last() const {
-  return records_.back();
+Record Table::last() const {
+  return at(size() - 1);
 }
 
-const Record& Table::at(unsigned int i) const {
-  if (i >= records_.size())
+Record Table::at(unsigned int i) const {
+  if (i >= (unsigned)size())
     throw RowDoesNotExistError("Index out of Range");
-  return records_.at(i);
+  return make_record(i);
 }
 
-Table Table::cross_join(const Table& other) const {
-  ColumnList join_columns(columns_);
-  join_columns.insert(join_columns.end(), other.columns_.begin(), other.columns_.end());
-  Table join(join_columns);
+Table* Table::project(const vector<string>& column_names, const vector<unsigned>& rows) const {
+  ColumnList columns;
+  vector<unsigned> indices;
+  for (unsigned i = 0; i < column_names.size(); ++i) {
+    indices.push_back(index_for(column_names[i]));
+    columns.push_back(schema_->fields()[indices.back()]);
+  }
+  unsigned table_rows = size();
+  for (unsigned i = 0; i < rows.size(); ++i)
+    if (rows[i] >= table_rows)
+      throw RowDoesNotExistError("Index out of Range");
 
-  for (const Record& record1 : records_) {
-    for (const Record& record2 : other.records_) {
-      Record join_record(record1);
-      join_record.join(record2);
-      join.insert(join_record);
-    }
+  Table *result = new Table(columns);
+  bool keep_key = !key_.empty();
+  for (string key_col : key_)
+    if (std::find(column_names.begin(), column_names.end(), key_col) == column_names.end())
+      keep_key = false;
+  if (keep_key)
+    result->set_key(key_);
+
+  for (unsigned i = 0; i < indices.size(); ++i) {
+    const Column& from = data_[indices[i]];
+    Column& to = result->data_[i];
+    to.reserve(rows.size());
+    for (unsigned j = 0; j < rows.size(); ++j)
+      to.append(from, rows[j]);
+  }
+  result->rebuild_key_index();
+  return result;
+}
+
+uint64_t Table::check_cross_join_size(const Table& table, const Table& other, uint64_t max_rows) {
+  uint64_t rows = static_cast<uint64_t>(table.size()) * other.size();
+  if (max_rows != 0 && rows > max_rows)
+    throw InvalidOperationError("Cross join would have " + to_string(rows) +
+                                " rows, more than the limit of " + to_string(max_rows));
+  return rows;
+}
+
+Table Table::cross_join(const Table& other, uint64_t max_rows) const {
+  // Rows are counted in unsigned, so a bigger result can't be built at all
+  uint64_t join_rows = check_cross_join_size(*this, other, max_rows);
+  if (join_rows > numeric_limits<unsigned>::max())
+    throw InvalidOperationError("Cross join would have " + to_string(join_rows) +
+                                " rows, more than a table can hold");
+  Table join(schema_->joined(*other.schema_)->fields());
+
+  unsigned rows = size(), other_rows = other.size();
+  for (unsigned i = 0; i < join.data_.size(); ++i)
+    join.data_[i].reserve(static_cast<unsigned>(join_rows));
+
+  // Fill the output column by column; each column only reads one input column
+  for (unsigned i = 0; i < data_.size(); ++i)
+    for (unsigned row = 0; row < rows; ++row)
+      for (unsigned other_row = 0; other_row < other_rows; ++other_row)
+        join.data_[i].append(data_[i], row);
+
+  for (unsigned i = 0; i < other.data_.size(); ++i) {
+    Column& out = join.data_[data_.size() + i];
+    for (unsigned row = 0; row < rows; ++row)
+      for (unsigned other_row = 0; other_row < other_rows; ++other_row)
+        out.append(other.data_[i], other_row);
   }
   return join;
 }
 
-Table Table::natural_join(const Table& other) const {
+JoinOptions::JoinOptions() {
+  strategy = automatic;
+}
+
+Table Table::natural_join(const Table& other, const JoinOptions& options) const {
   if (other.key_.empty())
     throw InvalidOperationError("Second table in natural join should have a key");
 
-  ColumnList join_columns(columns_);
-  ColumnList other_columns(other.columns_);
-  for (string key_col : other.key_) {
+  ColumnList join_columns(columns());
+  vector<unsigned> key_columns, other_kept;
+  bool same_types = true;
+  for (unsigned k = 0; k < other.key_.size(); ++k) {
+    const string& key_col = other.key_[k];
     if (!has_column(key_col))
       throw InvalidOperationError("Could not find key column "+key_col+" from second table in first table");
-
-    // Remove from other_columns to avoid duplicates
-    for (ColumnList::iterator it = other_columns.begin(); it < other_columns.end(); ++it) {
-      if (it->first == key_col) {
-        other_columns.erase(it);
-        break;
-      }
+    key_columns.push_back(index_for(key_col));
+    if (data_[key_columns.back()].type() != other.data_[other.key_columns_[k]].type())
+      same_types = false;
+  }
+  // Key columns of the other table are left out to avoid duplicates
+  const ColumnList& other_columns = other.schema_->fields();
+  for (unsigned i = 0; i < other_columns.size(); ++i) {
+    if (std::find(other.key_.begin(), other.key_.end(), other_columns[i].first) == other.key_.end()) {
+      join_columns.push_back(other_columns[i]);
+      other_kept.push_back(i);
     }
   }
-  join_columns.insert(join_columns.end(), other_columns.begin(), other_columns.end());
 
+  // Merging compares values directly, so it needs the same types on both sides
+  JoinOptions::Strategy strategy = options.strategy;
+  if (!same_types) {
+    strategy = JoinOptions::hash;
+  } else if (strategy == JoinOptions::automatic) {
+    if (is_sorted_on(key_columns) && other.is_sorted_on(other.key_columns_))
+      strategy = JoinOptions::sort_merge;
+    else
+      strategy = JoinOptions::hash;
+  }
+
+  // Pairs of matching rows, in the order of this table
+  vector<unsigned> rows, other_rows;
+  if (strategy == JoinOptions::sort_merge)
+    merge_join(other, key_columns, rows, other_rows);
+  else if (strategy == JoinOptions::partitioned_hash)
+    partitioned_hash_join(other, key_columns, rows, other_rows);
+  else
+    hash_join(other, key_columns, rows, other_rows);
+
+  // Copy the matched rows column by column; the output has no key to check
   Table join(join_columns);
-  for (const Record& record1 : records_) {
-    for (Record record2 : other.records_) {
-      bool is_match = true;
-      for (string key_col : other.key_) {
-        if (record1.get<string>(key_col) != record2.get<string>(key_col)) {
-          is_match = false;
-          break;
-        }
+  for (unsigned i = 0; i < data_.size(); ++i) {
+    Column& out = join.data_[i];
+    out.reserve(rows.size());
+    for (unsigned j = 0; j < rows.size(); ++j)
+      out.append(data_[i], rows[j]);
+  }
+  for (unsigned i = 0; i < other_kept.size(); ++i) {
+    Column& out = join.data_[data_.size() + i];
+    out.reserve(other_rows.size());
+    for (unsigned j = 0; j < other_rows.size(); ++j)
+      out.append(other.data_[other_kept[i]], other_rows[j]);
+  }
+  return join;
+}
+
+// The key index of the other table is a hash table on exactly the join
+// columns, so each row of this table is matched with a single lookup. Every
+// row matches at most one row of the other table, since its keys are unique.
+// The index is only read, so morsels are probed in parallel and their matches
+// joined in order.
+void Table::hash_join(const Table& other, const vector<unsigned>& key_columns,
+                      vector<unsigned>& rows, vector<unsigned>& other_rows) const {
+  unsigned row_count = size();
+  unsigned morsels = ThreadPool::morsel_count(0, row_count);
+  if (morsels <= 1) {
+    probe_key_index(other, key_columns, 0, row_count, rows, other_rows);
+    return;
+  }
+
+  vector<vector<unsigned> > morsel_rows(morsels), morsel_other_rows(morsels);
+  ThreadPool::instance().parallel_for(0, row_count, [&](unsigned morsel, unsigned begin, unsigned end) {
+    probe_key_index(other, key_columns, begin, end, morsel_rows[morsel], morsel_other_rows[morsel]);
+  });
+  for (unsigned i = 0; i < morsels; ++i) {
+    rows.insert(rows.end(), morsel_rows[i].begin(), morsel_rows[i].end());
+    other_rows.insert(other_rows.end(), morsel_other_rows[i].begin(), morsel_other_rows[i].end());
+  }
+}
+
+void Table::probe_key_index(const Table& other, const vector<unsigned>& key_columns, unsigned begin, unsigned end,
+                            vector<unsigned>& rows, vector<unsigned>& other_rows) const {
+  string key;
+  for (unsigned row = begin; row < end; ++row) {
+    if (!join_key(row, key_columns, other, key))
+      continue;
+    unordered_map<string, unsigned>::const_iterator match = other.key_index_.find(key);
+    if (match != other.key_index_.end()) {
+      rows.push_back(row);
+      other_rows.push_back(match->second);
+    }
+  }
+}
+
+// Walks both tables in key order. The other table's keys are unique, so its
+// position only moves forward once this table has passed its key.
+void Table::merge_join(const Table& other, const vector<unsigned>& key_columns,
+                       vector<unsigned>& rows, vector<unsigned>& other_rows) const {
+  vector<unsigned> order = sorted_rows(key_columns);
+  vector<unsigned> other_order = other.sorted_rows(other.key_columns_);
+
+  // Matches are found in key order; match[row] puts them back in row order
+  const unsigned no_match = numeric_limits<unsigned>::max();
+  vector<unsigned> match(size(), no_match);
+  unsigned i = 0, j = 0;
+  while (i < order.size() && j < other_order.size()) {
+    int cmp = compare_rows(order[i], key_columns, other, other_order[j], other.key_columns_);
+    if (cmp < 0)
+      ++i;
+    else if (cmp > 0)
+      ++j;
+    else
+      match[order[i++]] = other_order[j];
+  }
+  for (unsigned row = 0; row < match.size(); ++row) {
+    if (match[row] != no_match) {
+      rows.push_back(row);
+      other_rows.push_back(match[row]);
+    }
+  }
+}
+
+static const char* function_names[] = { "count", "sum", "min", "max", "avg" };
+
+Aggregate::Aggregate(Function function, string column, string name) {
+  this->function = function;
+  this->column = column;
+  this->name = name.empty() ? string(function_names[function]) + "(" + column + ")" : name;
+}
+
+// Running values of one aggregate over the rows of one group seen so far
+struct AggregateState {
+  long long count;
+  long long int_sum;
+  double float_sum;
+  // The row holding the min or max, or -1 if there is none yet
+  int best_row;
+};
+
+// The groups found in part of a table: the encoded keys, the first row of
+// each group, and the state of every aggregate of every group
+struct GroupSet {
+  GroupTable groups;
+  vector<unsigned> first_rows;
+  vector<AggregateState> states;
+};
 
-        // Remove column from record2 to avoid duplicates
-        record2.erase(key_col);
+// What group_by needs to know about an aggregate once its column is found
+struct AggregateInput {
+  Aggregate::Function function;
+  const Column* column;  // NULL for count(*)
+};
+
+static void add_value(const AggregateInput& input, AggregateState& state, unsigned row) {
+  const Column* column = input.column;
+  if (!column) {
+    ++state.count;
+    return;
+  }
+  if (column->is_null(row))
+    return;
+  ++state.count;
+
+  switch (input.function) {
+  case Aggregate::sum:
+  case Aggregate::avg:
+    if (column->type() == ColumnType::floating)
+      state.float_sum += column->float_data()[row];
+    else
+      state.int_sum += column->int_data()[row];
+    break;
+  case Aggregate::min:
+    if (state.best_row < 0 || column->compare(row, *column, state.best_row) < 0)
+      state.best_row = row;
+    break;
+  case Aggregate::max:
+    if (state.best_row < 0 || column->compare(row, *column, state.best_row) > 0)
+      state.best_row = row;
+    break;
+  default:
+    break;
+  }
+}
+
+static void add_row(const vector<AggregateInput>& inputs, AggregateState* states, unsigned row) {
+  for (unsigned a = 0; a < inputs.size(); ++a)
+    add_value(inputs[a], states[a], row);
+}
+
+// Adds the state of a later part of the table to that of an earlier one.
+// Ties in min and max keep the earlier row, as a single pass would.
+static void merge_state(const AggregateInput& input, AggregateState& into, const AggregateState& from) {
+  into.count += from.count;
+  into.int_sum += from.int_sum;
+  into.float_sum += from.float_sum;
+  if (from.best_row < 0)
+    return;
+  int cmp = into.best_row < 0 ? 0 : input.column->compare(from.best_row, *input.column, into.best_row);
+  if (into.best_row < 0 ||
+      (input.function == Aggregate::min && cmp < 0) ||
+      (input.function == Aggregate::max && cmp > 0))
+    into.best_row = from.best_row;
+}
+
+static void merge_states(const vector<AggregateInput>& inputs, AggregateState* into, const AggregateState* from) {
+  for (unsigned a = 0; a < inputs.size(); ++a)
+    merge_state(inputs[a], into[a], from[a]);
+}
+
+// Adds rows [begin, end) to the state of one aggregate, a whole array at a
+// time through Column::summarize() where the column type allows it
+static void add_rows(const AggregateInput& input, AggregateState& state, unsigned begin, unsigned end) {
+  const Column* column = input.column;
+  if (!column) {
+    state.count += end - begin;
+    return;
+  }
+
+  bool extremes = input.function == Aggregate::min || input.function == Aggregate::max;
+  ColumnSummary summary;
+  if (!column->summarize(begin, end, extremes, summary)) {
+    for (unsigned row = begin; row < end; ++row)
+      add_value(input, state, row);
+    return;
+  }
+
+  AggregateState rows = { summary.count, summary.int_sum, summary.float_sum,
+                          input.function == Aggregate::min ? summary.min_row : summary.max_row };
+  merge_state(input, state, rows);
+}
+
+static unsigned add_group(GroupSet& set, const string& key, unsigned row, unsigned aggregates) {
+  bool added;
+  unsigned group = set.groups.find_or_add(key, added);
+  if (added) {
+    set.first_rows.push_back(row);
+    AggregateState empty = { 0, 0, 0.0, -1 };
+    set.states.resize(set.states.size() + aggregates, empty);
+  }
+  return group;
+}
+
+Table Table::group_by(const vector<string>& key_columns, const vector<Aggregate>& aggregates) const {
+  ColumnList result_columns;
+  vector<unsigned> keys;
+  for (unsigned k = 0; k < key_columns.size(); ++k) {
+    keys.push_back(index_for(key_columns[k]));
+    result_columns.push_back(schema_->fields()[keys.back()]);
+  }
+
+  vector<AggregateInput> inputs;
+  for (unsigned a = 0; a < aggregates.size(); ++a) {
+    const Aggregate& aggregate = aggregates[a];
+    AggregateInput input;
+    input.function = aggregate.function;
+    input.column = NULL;
+    RecordType type = integer;
+    if (!(aggregate.function == Aggregate::count && aggregate.column == "*")) {
+      input.column = &column(aggregate.column);
+      type = input.column->type();
+    }
+    if ((aggregate.function == Aggregate::sum || aggregate.function == Aggregate::avg) &&
+        !input.column->is_numeric())
+      throw InvalidOperationError("Column " + aggregate.column + " is not numeric");
+    if (aggregate.function == Aggregate::count)
+      type = integer;
+    else if (aggregate.function == Aggregate::avg)
+      type = floating;
+    inputs.push_back(input);
+    result_columns.push_back(make_pair(aggregate.name, type));
+  }
+  for (unsigned i = 0; i < result_columns.size(); ++i)
+    for (unsigned j = 0; j < i; ++j)
+      if (result_columns[i].first == result_columns[j].first)
+        throw InvalidOperationError("Column " + result_columns[i].first + " appears twice in the result");
+
+  // Phase one: each morsel groups its own rows
+  unsigned rows = size();
+  unsigned count = inputs.size();
+  vector<GroupSet> parts(ThreadPool::morsel_count(0, rows));
+  ThreadPool::instance().parallel_for(0, rows, [&](unsigned morsel, unsigned begin, unsigned end) {
+    GroupSet& part = parts[morsel];
+    if (keys.empty()) {
+      // A single group, so there's nothing to look up, and each aggregate
+      // can take the morsel a column at a time
+      add_group(part, "", begin, count);
+      for (unsigned a = 0; a < count; ++a)
+        add_rows(inputs[a], part.states[a], begin, end);
+      return;
+    }
+
+    string key;
+    for (unsigned row = begin; row < end; ++row) {
+      key.clear();
+      for (unsigned k = 0; k < keys.size(); ++k)
+        data_[keys[k]].append_key(row, key);
+      unsigned group = add_group(part, key, row, count);
+      add_row(inputs, &part.states[group * count], row);
+    }
+  });
+
+  // Phase two: merge the morsels' groups in order
+  GroupSet all_parts;
+  GroupSet& merged = parts.size() == 1 ? parts[0] : all_parts;
+  if (parts.size() > 1) {
+    for (unsigned p = 0; p < parts.size(); ++p) {
+      const GroupSet& part = parts[p];
+      for (unsigned g = 0; g < part.groups.size(); ++g) {
+        unsigned group = add_group(merged, part.groups.key(g), part.first_rows[g], count);
+        merge_states(inputs, &merged.states[group * count], &part.states[g * count]);
       }
+    }
+  }
+  if (keys.empty() && merged.groups.size() == 0)
+    add_group(merged, "", 0, count);
 
-      if (is_match) {
-        Record join_record(record1);
-        join_record.join(record2);
-        join.insert(join_record);
+  Table result(result_columns);
+  unsigned groups = merged.groups.size();
+  for (unsigned k = 0; k < keys.size(); ++k) {
+    Column& out = result.data_[k];
+    out.reserve(groups);
+    for (unsigned g = 0; g < groups; ++g)
+      out.append(data_[keys[k]], merged.first_rows[g]);
+  }
+  for (unsigned a = 0; a < count; ++a) {
+    Column& out = result.data_[keys.size() + a];
+    out.reserve(groups);
+    for (unsigned g = 0; g < groups; ++g) {
+      const AggregateState& state = merged.states[g * count + a];
+      const Column* column = inputs[a].column;
+      if (inputs[a].function == Aggregate::count) {
+        out.append(Value(static_cast<int>(state.count)));
+      } else if (state.count == 0) {
+        out.append_null();
+      } else if (inputs[a].function == Aggregate::min || inputs[a].function == Aggregate::max) {
+        out.append(*column, state.best_row);
+      } else {
+        bool floats = column->type() == floating;
+        double total = floats ? state.float_sum : static_cast<double>(state.int_sum);
+        if (inputs[a].function == Aggregate::avg) {
+          out.append(Value(total / state.count));
+        } else if (floats) {
+          out.append(Value(static_cast<float>(total)));
+        } else {
+          if (state.int_sum > numeric_limits<int>::max() || state.int_sum <= numeric_limits<int>::min())
+            throw InvalidTypeError("Sum of column " + aggregates[a].column + " does not fit in an integer");
+          out.append(Value(static_cast<int>(state.int_sum)));
+        }
       }
     }
   }
-  return join;
+
+  if (!keys.empty()) {
+    result.key_ = key_columns;
+    for (unsigned k = 0; k < keys.size(); ++k)
+      result.key_columns_.push_back(k);
+    result.rebuild_key_index();
+  }
+  return result;
+}
+
+Record Table::aggregate(const vector<Aggregate>& aggregates) const {
+  return group_by(vector<string>(), aggregates).at(0);
 }
 
 int Table::count(string column_name) const {
-  if (!has_column(column_name))
-    throw ColumnDoesNotExistError("Could not find column " + column_name);
-
-  int ret = 0;
-  for (const Record& record : records_)
-    if (record.get<string>(column_name) != "NULL")
-      ++ret;
-  return ret;
-}
-
-void Table::drop_where(string where) {
-  deque<Record>::iterator it = records_.begin();
-  WhereMatcher matcher(where);
-  while (it != records_.end()) {
-    if (matcher.does_match(*it))
-      it = drop(it);
-    else
-      it++;
-  }
+  // A popcount of the validity bitmap, so not worth splitting into morsels
+  const Column& col = column(column_name);
+  return col.count(0, col.size());
 }
 
-void Table::update(string where, string set) {
-  deque<Record>::iterator it;
-  WhereMatcher matcher(where);
+void Table::drop_where(string where, Database* database) {
+  WhereMatcher matcher(where, *this, database);
+  vector<unsigned> selection;
+  matcher.select(0, size(), selection);
+  if (selection.empty())
+    return;
+
+  vector<bool> keep_rows(size(), true);
+  for (unsigned i = 0; i < selection.size(); ++i)
+    keep_rows[selection[i]] = false;
+  drop(keep_rows);
+  log_.deleted(where);
+}
+
+void Table::update(string where, string set, Database* database) {
+  WhereMatcher matcher(where, *this, database);
   SetUpdater updater(set);
-  for (it = records_.begin(); it != records_.end(); it++)
-    if (matcher.does_match(*it))
-      updater.update(it);
+
+  // Work out every change before writing any of them, so that a key conflict
+  // or a value of the wrong type leaves the table as it was
+  vector<pair<unsigned, Record> > changes;
+  vector<unsigned> selection;
+  matcher.select(0, size(), selection);
+  for (unsigned i = 0; i < selection.size(); ++i) {
+    unsigned row = selection[i];
+    Record record(make_record(row));
+    updater.update(record);
+    if (record.size() != schema_->size())
+      throw ColumnDoesNotExistError("Set clause refers to a column that is not in the table");
+    // The set clause gives values as text, so convert them now
+    for (unsigned c = 0; c < data_.size(); ++c)
+      record.values_[c] = data_[c].coerce(record.values_[c]);
+    changes.push_back(make_pair(row, record));
+  }
+
+  // Rows whose key changes give up their old key, then claim the new one
+  vector<unsigned> moved_rows;
+  vector<string> old_keys, new_keys;
+  if (!key_.empty()) {
+    vector<bool> key_changed(size(), false);
+    for (unsigned i = 0; i < changes.size(); ++i) {
+      string old_key = key_for_row(changes[i].first);
+      string new_key = key_for_record(changes[i].second);
+      if (new_key != old_key) {
+        key_changed[changes[i].first] = true;
+        moved_rows.push_back(changes[i].first);
+        old_keys.push_back(old_key);
+        new_keys.push_back(new_key);
+      }
+    }
+
+    unordered_map<string, unsigned> claimed;
+    for (unsigned i = 0; i < new_keys.size(); ++i) {
+      unordered_map<string, unsigned>::const_iterator owner = key_index_.find(new_keys[i]);
+      if ((owner != key_index_.end() && !key_changed[owner->second]) ||
+          !claimed.insert(make_pair(new_keys[i], moved_rows[i])).second)
+        throw KeyConflictError("Already a record with this key");
+    }
+  }
+
+  if (!changes.empty())
+    before_change();
+  for (unsigned c = 0; c < changes.size(); ++c) {
+    // Only write back the fields that changed
+    unsigned row = changes[c].first;
+    const Record& record = changes[c].second;
+    for (unsigned i = 0; i < data_.size(); ++i)
+      if (!data_[i].equals(row, record.values_[i]))
+        data_[i].set(row, record.values_[i]);
+  }
+
+  for (unsigned i = 0; i < old_keys.size(); ++i)
+    key_index_.erase(old_keys[i]);
+  for (unsigned i = 0; i < new_keys.size(); ++i)
+    key_index_.insert(make_pair(new_keys[i], moved_rows[i]));
+  if (!changes.empty())
+    log_.updated(where, set);
 }
 
 bool Table::has_column(string column_name) const {
-  for (auto name_type : columns_)
-    if (name_type.first == column_name) return true;
-  return false;
+  return schema_->find(column_name) >= 0;
+}
+
+const Column& Table::column(string column_name) const {
+  return data_[index_for(column_name)];
+}
+
+Record Table::make_record(unsigned row, const SchemaPtr& schema, const vector<unsigned>& columns) const {
+  Record record(schema);
+  for (unsigned i = 0; i < columns.size(); ++i)
+    record.values_.push_back(data_[columns[i]].get_value(row));
+  return record;
+}
+
+Record Table::make_record(unsigned row) const {
+  Record record(schema_);
+  for (unsigned i = 0; i < data_.size(); ++i)
+    record.values_.push_back(data_[i].get_value(row));
+  return record;
+}
+
+void Table::drop(const vector<bool>& keep_rows) {
+  before_change();
+  for (unsigned i = 0; i < data_.size(); ++i)
+    data_[i].keep(keep_rows);
+  // Rows after a dropped row have moved, so their index entries are stale
+  rebuild_key_index();
+}
+
+string Table::key_for_row(unsigned row) const {
+  string key;
+  for (unsigned i = 0; i < key_columns_.size(); ++i)
+    data_[key_columns_[i]].append_key(row, key);
+  return key;
+}
+
+// Encodes the values of key_columns at row the way other encodes its key, so
+// the result can be looked up in other.key_index_. Columns of a different
+// type are converted through their string form. Returns false if a value
+// can't be converted, in which case it can't match.
+bool Table::join_key(unsigned row, const vector<unsigned>& key_columns, const Table& other, string& key) const {
+  key.clear();
+  for (unsigned k = 0; k < key_columns.size(); ++k) {
+    const Column& column = data_[key_columns[k]];
+    const Column& other_column = other.data_[other.key_columns_[k]];
+    if (column.type() == other_column.type()) {
+      column.append_key(row, key);
+      continue;
+    }
+    try {
+      other_column.append_key(Value(column.get_string(row)), key);
+    } catch (const InvalidTypeError&) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Picks a partition from the top bits of a hash, after mixing it, so the
+// hash tables inside a partition still see varied low bits
+static unsigned partition_of(size_t hash, unsigned bits) {
+  if (bits == 0)
+    return 0;
+  uint64_t mixed = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL;
+  return static_cast<unsigned>(mixed >> (64 - bits));
+}
+
+// Splits rows [0, count) into 2^bits partitions by the hash that hash_row
+// gives each row; rows for which it returns false are left out. rows receives
+// the row numbers grouped by partition, in row order within each, and
+// partition p is rows[starts[p]] to rows[starts[p + 1]]. Both passes run in
+// parallel morsels: the first counts rows per partition and morsel, the
+// second copies each morsel's rows to its slots.
+static void radix_partition(unsigned count, unsigned bits,
+                            const function<bool (unsigned, size_t&)>& hash_row,
+                            vector<unsigned>& rows, vector<unsigned>& starts) {
+  unsigned partitions = 1u << bits;
+  unsigned morsels = ThreadPool::morsel_count(0, count);
+  vector<unsigned> partition_of_row(count);
+  vector<unsigned> histogram(morsels * partitions, 0);
+  const unsigned skipped = numeric_limits<unsigned>::max();
+
+  ThreadPool& pool = ThreadPool::instance();
+  pool.parallel_for(0, count, [&](unsigned morsel, unsigned begin, unsigned end) {
+    unsigned* counts = &histogram[morsel * partitions];
+    for (unsigned row = begin; row < end; ++row) {
+      size_t hash;
+      if (hash_row(row, hash)) {
+        partition_of_row[row] = partition_of(hash, bits);
+        ++counts[partition_of_row[row]];
+      } else {
+        partition_of_row[row] = skipped;
+      }
+    }
+  });
+
+  // Turn the counts into where each morsel's rows for a partition start
+  starts.assign(partitions + 1, 0);
+  unsigned offset = 0;
+  for (unsigned p = 0; p < partitions; ++p) {
+    starts[p] = offset;
+    for (unsigned morsel = 0; morsel < morsels; ++morsel) {
+      unsigned rows_here = histogram[morsel * partitions + p];
+      histogram[morsel * partitions + p] = offset;
+      offset += rows_here;
+    }
+  }
+  starts[partitions] = offset;
+
+  rows.resize(offset);
+  pool.parallel_for(0, count, [&](unsigned morsel, unsigned begin, unsigned end) {
+    unsigned* next = &histogram[morsel * partitions];
+    for (unsigned row = begin; row < end; ++row)
+      if (partition_of_row[row] != skipped)
+        rows[next[partition_of_row[row]]++] = row;
+  });
+}
+
+// Radix-partitions both tables on the hash of the join key, then builds a
+// hash table for each partition of the other table and probes it with the
+// same partition of this table. Partitions are independent, so they run in
+// parallel; each one writes the matches of its own rows.
+void Table::partitioned_hash_join(const Table& other, const vector<unsigned>& key_columns,
+                                  vector<unsigned>& rows, vector<unsigned>& other_rows) const {
+  // Aim for partitions of about 2048 keys, whose tables fit in L2, and at
+  // least a few partitions per thread
+  const unsigned keys_per_partition = 2048;
+  unsigned other_size = other.size();
+  unsigned threads = ThreadPool::instance().size();
+  unsigned bits = 0;
+  while (bits < 14 && ((other_size >> bits) > keys_per_partition || (1u << bits) < 4 * threads))
+    ++bits;
+
+  hash<string> hasher;
+  vector<unsigned> partitioned, starts;
+  radix_partition(size(), bits, [&](unsigned row, size_t& row_hash) -> bool {
+    string key;
+    if (!join_key(row, key_columns, other, key))
+      return false;
+    row_hash = hasher(key);
+    return true;
+  }, partitioned, starts);
+
+  vector<unsigned> other_partitioned, other_starts;
+  radix_partition(other.size(), bits, [&](unsigned row, size_t& row_hash) -> bool {
+    row_hash = hasher(other.key_for_row(row));
+    return true;
+  }, other_partitioned, other_starts);
+
+  const unsigned no_match = numeric_limits<unsigned>::max();
+  vector<unsigned> match(size(), no_match);
+  ThreadPool::instance().parallel_for(0, 1u << bits, 1, [&](unsigned p, unsigned, unsigned) {
+    unordered_map<string, unsigned> table;
+    table.reserve(other_starts[p + 1] - other_starts[p]);
+    for (unsigned i = other_starts[p]; i < other_starts[p + 1]; ++i)
+      table.insert(make_pair(other.key_for_row(other_partitioned[i]), other_partitioned[i]));
+
+    string key;
+    for (unsigned i = starts[p]; i < starts[p + 1]; ++i) {
+      unsigned row = partitioned[i];
+      join_key(row, key_columns, other, key);
+      unordered_map<string, unsigned>::const_iterator found = table.find(key);
+      if (found != table.end())
+        match[row] = found->second;
+    }
+  });
+
+  for (unsigned row = 0; row < match.size(); ++row) {
+    if (match[row] != no_match) {
+      rows.push_back(row);
+      other_rows.push_back(match[row]);
+    }
+  }
+}
+
+// Compares the values of columns at row with those of other_columns at
+// other_row, column by column. The column types must match.
+int Table::compare_rows(unsigned row, const vector<unsigned>& columns,
+                        const Table& other, unsigned other_row, const vector<unsigned>& other_columns) const {
+  for (unsigned k = 0; k < columns.size(); ++k) {
+    int cmp = data_[columns[k]].compare(row, other.data_[other_columns[k]], other_row);
+    if (cmp != 0)
+      return cmp;
+  }
+  return 0;
+}
+
+bool Table::is_sorted_on(const vector<unsigned>& columns) const {
+  unsigned row_count = size();
+  for (unsigned row = 1; row < row_count; ++row)
+    if (compare_rows(row - 1, columns, *this, row, columns) > 0)
+      return false;
+  return true;
+}
+
+// Returns the row numbers in the order of columns, skipping the sort if the
+// rows are already in that order
+vector<unsigned> Table::sorted_rows(const vector<unsigned>& columns) const {
+  vector<unsigned> order(size());
+  for (unsigned row = 0; row < order.size(); ++row)
+    order[row] = row;
+  if (!is_sorted_on(columns)) {
+    stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+      return compare_rows(a, columns, *this, b, columns) < 0;
+    });
+  }
+  return order;
+}
+
+string Table::key_for_record(const Record& record) const {
+  string key;
+  for (unsigned i = 0; i < key_columns_.size(); ++i)
+    data_[key_columns_[i]].append_key(record.values_[key_columns_[i]], key);
+  return key;
+}
+
+// Called before any change to the table's rows or columns
+void Table::before_change() {
+  views_.detach_all();
+  ++version_;
 }
 
-deque<Record>::iterator Table::drop(deque<Record>::iterator record) {
-  return records_.erase(record);
+void Table::rebuild_key_index() {
+  key_index_.clear();
+  if (key_.empty())
+    return;
+  unsigned rows = size();
+  key_index_.reserve(rows);
+  for (unsigned row = 0; row < rows; ++row)
+    key_index_.insert(make_pair(key_for_row(row), row));
 }
 
 bool Table::is_valid(RecordType type, string str) {
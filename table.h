@@ -2,16 +2,87 @@
 #define TABLE_H_
 #pragma warning(disable: 4251)
 
-#include <deque>
+#include <iterator>
 #include <string>
 #include <vector>
 #include <sstream>
 #include <utility>
 #include <limits>
+#include <unordered_map>
+#include <cstdint>
 using namespace std;
 
 #include "exception.h"
 #include "record.h"
+#include "column_type.h"
+#include "column.h"
+#include "schema.h"
+#include "thread_pool.h"
+#include "table_log.h"
+
+class ResultView;
+class Database;
+
+/** Options for Table::natural_join(). */
+struct EXPORT JoinOptions {
+  /** How the rows of the two tables are matched. */
+  enum Strategy {
+    /**
+     * Use sort_merge if both tables are already sorted on the join columns,
+     * and hash if not.
+     */
+    automatic,
+    /**
+     * Look up each row of the first table in the key index of the second.
+     * A first table spanning several morsels (see ThreadPool) is probed on
+     * all cores.
+     */
+    hash,
+    /**
+     * Sort both tables on the join columns, unless they already are, and
+     * merge them. Both tables are read in order.
+     */
+    sort_merge,
+    /**
+     * Split both tables into partitions by the hash of the join key, small
+     * enough for a partition's hash table to stay in cache, then build and
+     * probe the partitions in parallel. This builds its own hash tables
+     * instead of using the key index of the second table.
+     */
+    partitioned_hash
+  };
+
+  /** Creates options with the automatic strategy. */
+  JoinOptions();
+
+  Strategy strategy;
+};
+
+/** An aggregate computed over the rows of each group by Table::group_by(). */
+struct EXPORT Aggregate {
+  enum Function {
+    /** The number of non-NULL values, or of rows if the column is "*". */
+    count,
+    /** The sum of the non-NULL values. */
+    sum,
+    /** The smallest non-NULL value, ordered by the column type. */
+    min,
+    /** The largest non-NULL value, ordered by the column type. */
+    max,
+    /** The mean of the non-NULL values. */
+    avg
+  };
+
+  /**
+   * Aggregates \a column with \a function into a result column named
+   * \a name, or "function(column)" (e.g. "avg(rating)") if \a name is empty.
+   */
+  Aggregate(Function function, string column, string name = "");
+
+  Function function;
+  string column;
+  string name;
+};
 
 /**
  * A table.
@@ -20,27 +91,45 @@ using namespace std;
  *
  * A table may or may not be inside a database. Often it is used for result sets
  * from queries on a larger table.
+ *
+ * Internally the table is stored by column (see Column). Records are built on
+ * demand when rows are accessed through at() or an iterator.
+ *
+ * The column types (Table::RecordType) are defined in ColumnType.
  */
-class EXPORT Table
+class EXPORT Table : public ColumnType
 {
 public:
-  /** An enum specifying the type of a column. */
-  enum RecordType {
-    undefined_type = 0, ///< Not for normal use
-    integer        = 1, ///< 32-bit signed integer
-    floating       = 2, ///< 32-bit floating point
-    varchar        = 3, ///< Variable-length string
-    date           = 4, ///< Date with no time
-    time           = 5  ///< Time without time zone
-  };
-
   /**
    * A const iterator over the records in a table.
    *
    * Do not depend on the underlying type of TableIterator in your code, but
    * rather a generic iterator interface.
+   *
+   * The record for a row is assembled from the columns when the iterator is
+   * dereferenced, and the reference stays valid until the iterator moves.
    */
-  typedef deque<Record>::const_iterator TableIterator;
+  class EXPORT TableIterator : public iterator<forward_iterator_tag, Record, ptrdiff_t, const Record*, const Record&> {
+  public:
+    TableIterator();
+    TableIterator(const Table* table, unsigned row);
+
+    const Record& operator*() const;
+    const Record* operator->() const;
+    TableIterator& operator++();
+    TableIterator operator++(int);
+    bool operator==(const TableIterator& other) const;
+    bool operator!=(const TableIterator& other) const;
+
+    /** Returns the index of the row the iterator points to. */
+    unsigned row() const;
+
+  private:
+    const Table* table_;
+    unsigned row_;
+    mutable Record record_;
+    mutable bool loaded_;
+  };
 
   typedef vector<pair<string, RecordType> > ColumnList;
 
@@ -59,8 +148,21 @@ public:
    */
   Table(const ColumnList& columns);
 
+  /**
+   * Creates a copy of the columns, rows and key of \a other. The copy has no
+   * views and is not logged until it is added to a Database.
+   */
+  Table(const Table& other);
+
   ~Table();
 
+  /**
+   * Replaces the columns, rows and key of this table with those of
+   * \a other. Views and cursors of the old contents are invalidated, and if
+   * the table is in a Database with a log open, the replacement is logged.
+   */
+  Table& operator=(const Table& other);
+
   /**
    * Returns a pointer to a new table with the same columns and keys
    */
@@ -75,6 +177,7 @@ public:
 
   /**
    * Deletes a column, erasing any associated data.
+   * Deleting a column that is part of the key removes the key.
    *
    * Throws a \a ColumnDoesNotExistError if \a column_name doesn't exist.
    */
@@ -104,6 +207,9 @@ public:
    * Every row in the table must have a unique key. If a new row is inserted
    * with a key that already exists in the table, insertion will fail.
    *
+   * The key is backed by a hash index, so conflicts are found without
+   * scanning the table and rows can be looked up by key with find().
+   *
    * Throws a \a ColumnDoesNotExistError if any of the \a column_names don't exist.
    * Throws an \a InvalidOperationError if called on a table with rows.
    */
@@ -125,6 +231,34 @@ public:
    */
   void insert(const Record& record);
 
+  /**
+   * Inserts rows at the end of the table, in the order of \a records.
+   *
+   * Either every record is inserted or, if an exception is thrown, none.
+   * The column names are checked once for each schema in the batch rather
+   * than for each record, the keys are checked in a single pass over a hash
+   * index, and room is made in the columns for the whole batch at once.
+   *
+   * Throws a \a KeyConflictError if any records have the key of a row in
+   * the table or of an earlier record in the batch. KeyConflictError::records()
+   * lists all of them.
+   * Throws a \a ColumnDoesNotExistError if a record's columns don't match.
+   * Throws an \a InvalidTypeError if a value cannot be converted to the type
+   * of its column.
+   */
+  void insert_batch(const vector<Record>& records);
+
+  /**
+   * Returns an iterator to the record whose key columns hold \a key_values,
+   * given in the same order as key(). Returns end() if there is no such record.
+   *
+   * Throws an \a InvalidOperationError if the table has no key or the number
+   * of values does not match the key.
+   * Throws an \a InvalidTypeError if a value cannot be converted to the type
+   * of its key column.
+   */
+  TableIterator find(const vector<string>& key_values) const;
+
   /**
    * Returns an iterator to the first record in the table.
    *
@@ -145,26 +279,40 @@ public:
    * Returns the first record in the table.
    * \sa last(), at()
    */
-  const Record& first() const;
+  Record first() const;
   /**
    * Returns the last record in the table.
    * \sa first(), at()
    */
-  const Record& last() const;
+  Record last() const;
   /**
    * Returns the *i*th record in the table, starting at 0.
    * Throws a \a RowDoesNotExistError if \a i is out of range (< 0 or >= size().)
    * \sa first(), last(), begin(), end()
    */
-  const Record& at(unsigned int i) const;
+  Record at(unsigned int i) const;
+
+  /**
+   * Returns a new table with the given rows of this table, keeping only the
+   * columns in \a column_names (in that order). Only the listed columns are
+   * read. The key is kept if all of its columns are included.
+   *
+   * Throws a \a ColumnDoesNotExistError if any of the \a column_names don't exist.
+   * Throws a \a RowDoesNotExistError if any of the \a rows are out of range.
+   */
+  Table* project(const vector<string>& column_names, const vector<unsigned>& rows) const;
 
   /**
    * Computes a cross join with another table.
    *
    * A cross join contains every possible combination of rows in the two
-   * tables.
+   * tables. If \a max_rows is not 0, it limits the size of the result.
+   * CrossJoinCursor produces the rows one at a time instead.
+   *
+   * Throws an \a InvalidOperationError if the result would have more than
+   * \a max_rows rows, or more rows than a table can hold.
    */
-  Table cross_join(const Table& other) const;
+  Table cross_join(const Table& other, uint64_t max_rows = 0) const;
 
   /**
    * Computes a natural join with another table.
@@ -172,9 +320,61 @@ public:
    * The other table should have a key, and this table should have columns
    * matching that key.
    *
+   * By default, rows are matched through the key index of the other table,
+   * so the join takes time proportional to the size of this table. \a options
+   * can ask for a sort-merge join instead (see JoinOptions). Join columns
+   * whose types differ between the tables are always matched through the key
+   * index. Either way the result keeps the order of the rows in this table.
+   *
    * Throws an \a InvalidOperationError if the above conditions are not met.
    */
-  Table natural_join(const Table& other) const;
+  Table natural_join(const Table& other, const JoinOptions& options = JoinOptions()) const;
+
+  /**
+   * Groups the rows by the values of \a key_columns and computes
+   * \a aggregates for each group, in a single pass over the table.
+   *
+   * The result has the key columns followed by one column per aggregate, and
+   * one row per group in the order the groups first appear. The key columns
+   * are its key. NULL key values form a group of their own. With no key
+   * columns the whole table is one group, so the result has one row even if
+   * the table is empty.
+   *
+   * count gives an integer column and avg a floating one. sum, min and max
+   * keep the type of the column. Aggregates of a group with no non-NULL
+   * values are NULL, except count, which is 0.
+   *
+   * Groups are looked up in an open-addressing hash table (see GroupTable).
+   * Tables larger than a morsel are grouped in parallel: each morsel builds
+   * its own groups, which are then merged in morsel order, so the result is
+   * the same however the morsels were scheduled.
+   *
+   * Throws a \a ColumnDoesNotExistError if a key column or an aggregated
+   * column doesn't exist.
+   * Throws an \a InvalidOperationError if sum or avg is asked of a column
+   * that isn't numeric, or two result columns have the same name.
+   * Throws an \a InvalidTypeError if a sum of an integer column doesn't fit
+   * in an integer.
+   */
+  Table group_by(const vector<string>& key_columns, const vector<Aggregate>& aggregates) const;
+
+  /**
+   * Computes all of \a aggregates over the whole table in one pass, and
+   * returns them as a record with one field per aggregate, named as in
+   * group_by(). This costs one scan where separate calls to count(), sum(),
+   * min() and max() cost one each.
+   *
+   * ~~~{.cpp}
+   * vector<Aggregate> aggregates;
+   * aggregates.push_back(Aggregate(Aggregate::count, "rating"));
+   * aggregates.push_back(Aggregate(Aggregate::max, "rating"));
+   * Record result = table.aggregate(aggregates);
+   * int best = result.get<int>("max(rating)");
+   * ~~~
+   *
+   * Throws the same exceptions as group_by().
+   */
+  Record aggregate(const vector<Aggregate>& aggregates) const;
 
   /**
    * Computes the number of non-NULL values in the given column in the table.
@@ -183,8 +383,9 @@ public:
   int count(string column_name) const;
 
   /**
-   * Computes the sum of all values in the given column in the table.
-   * Works for numeric column types only.
+   * Computes the sum of all non-NULL values in the given column in the table.
+   * Works for numeric column types only. Integers are added in 64 bits and
+   * floats in double precision, and the total is then converted to T.
    *
    * Throws a \a ColumnDoesNotExistError if \a column_name doesn't exist.
    * Throws an \a InvalidOperationError if the column is not numeric.
@@ -193,8 +394,9 @@ public:
   T sum(string column_name) const;
 
   /**
-   * Computes the smallest value of all values in the given column in the table.
-   * Works for all column types.
+   * Computes the smallest non-NULL value in the given column in the table.
+   * Works for all column types. Values are ordered by the column type, so
+   * dates and times compare chronologically.
    *
    * Throws a \a ColumnDoesNotExistError if \a column_name doesn't exist.
    * Throws an \a InvalidTypeError if the column cannot be converted to type T.
@@ -203,8 +405,9 @@ public:
   T min(string column_name) const;
 
   /**
-   * Computes the largest value of all values in the given column in the table.
-   * Works for all column types.
+   * Computes the largest non-NULL value in the given column in the table.
+   * Works for all column types. Values are ordered by the column type, so
+   * dates and times compare chronologically.
    *
    * Throws a \a ColumnDoesNotExistError if \a column_name doesn't exist.
    * Throws an \a InvalidTypeError if the column cannot be converted to type T.
@@ -212,64 +415,133 @@ public:
   template<typename T>
   T max(string column_name) const;
 
-  void drop_where(string where);
-  void update(string where, string set);
+  /**
+   * Removes the rows matching \a where. Subqueries in \a where name tables
+   * in \a database.
+   */
+  void drop_where(string where, Database* database = NULL);
+  /**
+   * Subqueries in \a where name tables in \a database.
+   *
+   * Throws a \a KeyConflictError if the update would give two rows the same
+   * key. The table is left unchanged in that case.
+   */
+  void update(string where, string set, Database* database = NULL);
 
   static bool is_valid(RecordType type, string str);
 
 private:
-  bool has_column(string column_name) const;
-  deque<Record>::iterator drop(deque<Record>::iterator record);
+  friend class WhereMatcher;
+  friend class ResultView;
+  friend class QueryCursor;
+  friend class CrossJoinCursor;
+  friend class Snapshot;
+  friend class CsvLoader;
+  friend class Database;
+  friend class WriteAheadLog;
+  friend class TableLog;
+
+  // The views reading from a table. A copy of a table starts without views,
+  // and assigning to a table first detaches the views of the old contents.
+  struct ViewList {
+    ViewList();
+    ViewList(const ViewList& other);
+    ViewList& operator=(const ViewList& other);
+    void detach_all();
+    vector<ResultView*> views;
+  };
 
-  deque<Record> records_;
-  ColumnList columns_;
+  bool has_column(string column_name) const;
+  const Column& column(string column_name) const;
+  Record make_record(unsigned row) const;
+  Record make_record(unsigned row, const SchemaPtr& schema, const vector<unsigned>& columns) const;
+  void check_schema(const Record& record) const;
+  void drop(const vector<bool>& keep_rows);
+  string key_for_row(unsigned row) const;
+  string key_for_record(const Record& record) const;
+  bool join_key(unsigned row, const vector<unsigned>& key_columns, const Table& other, string& key) const;
+  void hash_join(const Table& other, const vector<unsigned>& key_columns,
+                 vector<unsigned>& rows, vector<unsigned>& other_rows) const;
+  void probe_key_index(const Table& other, const vector<unsigned>& key_columns, unsigned begin, unsigned end,
+                       vector<unsigned>& rows, vector<unsigned>& other_rows) const;
+  void merge_join(const Table& other, const vector<unsigned>& key_columns,
+                  vector<unsigned>& rows, vector<unsigned>& other_rows) const;
+  void partitioned_hash_join(const Table& other, const vector<unsigned>& key_columns,
+                             vector<unsigned>& rows, vector<unsigned>& other_rows) const;
+  int compare_rows(unsigned row, const vector<unsigned>& columns,
+                   const Table& other, unsigned other_row, const vector<unsigned>& other_columns) const;
+  bool is_sorted_on(const vector<unsigned>& columns) const;
+  vector<unsigned> sorted_rows(const vector<unsigned>& columns) const;
+  void rebuild_key_index();
+  void before_change();
+  static uint64_t check_cross_join_size(const Table& table, const Table& other, uint64_t max_rows);
+
+  // Declared first so that it is assigned before the data it refers to
+  mutable ViewList views_;
+  // Counts changes to the table, so that cursors can tell it changed
+  unsigned version_;
+
+  // One Column per field in schema_, in the same order
+  vector<Column> data_;
+  SchemaPtr schema_;
   vector<string> key_;
+
+  // Positions of the key columns, and a map from the encoded key of each row
+  // (see Column::append_key) to the row
+  vector<unsigned> key_columns_;
+  unordered_map<string, unsigned> key_index_;
+
+  // Where changes to the table are logged, if its database has a log open
+  TableLog log_;
 };
 
 template<typename T>
 T Table::sum(string column_name) const {
-  if (!has_column(column_name))
-    throw ColumnDoesNotExistError("Could not find column " + column_name);
-  for (const pair<string, RecordType>& col : columns_)
-    if (col.first == column_name && !(col.second == integer || col.second == floating))
-      throw InvalidOperationError("Column " + column_name + " is not numeric");
-
-  T sum = 0;
-  for (const Record& record : records_)
-    sum += record.get<T>(column_name);
-  return sum;
+  const Column& col = column(column_name);
+  if (!col.is_numeric())
+    throw InvalidOperationError("Column " + column_name + " is not numeric");
+
+  // Each morsel is summarized separately and the partial sums are added in
+  // order, so the result doesn't depend on how the morsels were scheduled
+  unsigned rows = col.size();
+  vector<ColumnSummary> partial(ThreadPool::morsel_count(0, rows));
+  ThreadPool::instance().parallel_for(0, rows, [&](unsigned morsel, unsigned begin, unsigned end) {
+    col.summarize(begin, end, false, partial[morsel]);
+  });
+
+  int64_t int_sum = 0;
+  double float_sum = 0.0;
+  for (unsigned i = 0; i < partial.size(); ++i) {
+    int_sum += partial[i].int_sum;
+    float_sum += partial[i].float_sum;
+  }
+  if (col.type() == Column::integer)
+    return static_cast<T>(int_sum);
+  return static_cast<T>(float_sum);
 }
 
 template<typename T>
 T Table::min(string column_name) const {
-  if (!has_column(column_name))
-    throw ColumnDoesNotExistError("Could not find column " + column_name);
+  const Column& col = column(column_name);
   if (!TypeIsValid<T>::value)
     throw InvalidTypeError("Invalid type conversion in column: " + column_name);
 
-  if (records_.size() == 0)
-    return 0;
-
-  T min = records_[0].get<T>(column_name);
-  for (const Record& record : records_)
-    min = std::min(min, record.get<T>(column_name));
-  return min;
+  int row = col.min_row();
+  if (row < 0)
+    return T();
+  return col.get<T>(row);
 }
 
 template<typename T>
 T Table::max(string column_name) const {
-  if (!has_column(column_name))
-    throw ColumnDoesNotExistError("Could not find column " + column_name);
+  const Column& col = column(column_name);
   if (!TypeIsValid<T>::value)
     throw InvalidTypeError("Invalid type conversion in column: " + column_name);
 
-  if (records_.size() == 0)
+  int row = col.max_row();
+  if (row < 0)
     return T();
-
-  T max = records_[0].get<T>(column_name);
-  for (const Record& record : records_)
-    max = std::max(max, record.get<T>(column_name));
-  return max;
+  return col.get<T>(row);
 }
 
 #endif  // TABLE_H_
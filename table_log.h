@@ -0,0 +1,50 @@
+#ifndef TABLE_LOG_H_
+#define TABLE_LOG_H_
+#pragma warning(disable: 4251)
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "column_type.h"
+
+class Table;
+class WriteAheadLog;
+
+/**
+ * Logs the changes made to one table to the WriteAheadLog of its Database,
+ * if the database has one open (see Database::open_log()). Each change is
+ * logged once it has been made, and nothing is logged while the table has
+ * no log.
+ *
+ * A copy of a table starts out without a log, and assigning to a table
+ * keeps the log it had (Table::operator= logs the new contents with
+ * replaced()). The entries themselves are written in write_ahead_log.cpp.
+ */
+class TableLog : public ColumnType {
+public:
+  TableLog();
+  TableLog(const TableLog&);
+  TableLog& operator=(const TableLog&);
+
+  /** Logs later changes to \a log as changes to the table \a name. */
+  void attach(WriteAheadLog* log, const string& name);
+  void detach();
+
+  /** Logs that the contents of the table were replaced by \a table. */
+  void replaced(const Table& table);
+  /** Logs that the rows of \a table from \a begin on were inserted. */
+  void inserted(const Table& table, unsigned begin);
+  void deleted(const string& where);
+  void updated(const string& where, const string& set);
+  void column_added(const string& name, RecordType type);
+  void column_deleted(const string& name);
+  void column_renamed(const string& from, const string& to);
+  void key_set(const vector<string>& column_names);
+
+private:
+  WriteAheadLog* log_;
+  string name_;
+};
+
+#endif  // TABLE_LOG_H_
@@ -562,4 +562,218 @@ BOOST_AUTO_TEST_CASE(naturaljoins_test5)
 					9		r			aeeeee
 	*/
 }
+
+BOOST_AUTO_TEST_CASE(naturaljoin_mixed_types)
+{
+	// Join columns are matched by value, even when their types differ
+	Table a;
+	a.add_column("id", Table::varchar);
+	a.add_column("x", Table::integer);
+	Table b;
+	b.add_column("id", Table::integer);
+	b.add_column("y", Table::varchar);
+	vector<string> key;
+	key.push_back("id");
+	b.set_key(key);
+	for (int i = 0; i < 5; ++i) {
+		Record ra;
+		ra.set("id", to_string(static_cast<long long>(4 - i)));
+		ra.set("x", to_string(static_cast<long long>(i)));
+		a.insert(ra);
+		Record rb;
+		rb.set("id", to_string(static_cast<long long>(i * 2)));
+		rb.set("y", "y" + to_string(static_cast<long long>(i)));
+		b.insert(rb);
+	}
+	Record bad;
+	bad.set("id", "abc");
+	bad.set("x", "9");
+	a.insert(bad);
+
+	Table c = a.natural_join(b);
+	BOOST_CHECK(c.size() == 3);
+	BOOST_CHECK(c.columns().size() == 3);
+	BOOST_CHECK(c.at(0).get<string>("id") == "4");
+	BOOST_CHECK(c.at(0).get<string>("y") == "y2");
+	BOOST_CHECK(c.at(2).get<int>("x") == 4);
+}
+
+BOOST_AUTO_TEST_CASE(naturaljoin_sort_merge)
+{
+	// Every strategy gives the same rows, in the order of the first table
+	Table a;
+	a.add_column("id", Table::integer);
+	a.add_column("x", Table::varchar);
+	Table b;
+	b.add_column("id", Table::integer);
+	b.add_column("y", Table::floating);
+	vector<string> key;
+	key.push_back("id");
+	b.set_key(key);
+	for (int i = 0; i < 20; ++i) {
+		Record ra;
+		ra.set("id", to_string(static_cast<long long>((i * 7) % 20)));
+		ra.set("x", "x" + to_string(static_cast<long long>(i)));
+		a.insert(ra);
+		Record rb;
+		rb.set("id", to_string(static_cast<long long>(30 - i * 3)));
+		rb.set("y", to_string(static_cast<long long>(i)));
+		b.insert(rb);
+	}
+	Record null_id;
+	null_id.set("id", "NULL");
+	null_id.set("x", "none");
+	a.insert(null_id);
+
+	JoinOptions options;
+	Table automatic = a.natural_join(b, options);
+	options.strategy = JoinOptions::sort_merge;
+	Table merged = a.natural_join(b, options);
+	options.strategy = JoinOptions::hash;
+	Table hashed = a.natural_join(b, options);
+
+	// ids 0, 3, ..., 18 in the first table match
+	BOOST_CHECK(hashed.size() == 7);
+	BOOST_CHECK(hashed.at(0).get<string>("x") == "x0");
+	BOOST_CHECK(hashed.at(1).get<int>("id") == 15);
+	BOOST_CHECK(hashed.at(1).get<float>("y") == 5);
+	BOOST_CHECK(merged.size() == 7 && automatic.size() == 7);
+	for (int i = 0; i < 7; ++i) {
+		BOOST_CHECK(merged.at(i).get<string>("x") == hashed.at(i).get<string>("x"));
+		BOOST_CHECK(automatic.at(i).get<string>("x") == hashed.at(i).get<string>("x"));
+		BOOST_CHECK(merged.at(i).get<float>("y") == hashed.at(i).get<float>("y"));
+	}
+
+	// Sorted inputs are merged without sorting them first
+	Table sorted_a;
+	sorted_a.add_column("id", Table::integer);
+	for (int i = 0; i < 10; ++i) {
+		Record r;
+		r.set("id", to_string(static_cast<long long>(i / 2)));
+		sorted_a.insert(r);
+	}
+	options.strategy = JoinOptions::sort_merge;
+	Table c = sorted_a.natural_join(b, options);
+	BOOST_CHECK(c.size() == 4);
+	BOOST_CHECK(c.at(0).get<int>("id") == 0);
+	BOOST_CHECK(c.at(3).get<int>("id") == 3);
+}
+
+BOOST_AUTO_TEST_CASE(crossjoin_cursor)
+{
+	Table a;
+	a.add_column("a", Table::integer);
+	a.add_column("name", Table::varchar);
+	Table b;
+	b.add_column("b", Table::integer);
+	for (int i = 0; i < 50; ++i) {
+		if (i < 40) {
+			Record ra;
+			ra.set("a", to_string(static_cast<long long>(i)));
+			ra.set("name", "n" + to_string(static_cast<long long>(i)));
+			a.insert(ra);
+		}
+		Record rb;
+		rb.set("b", to_string(static_cast<long long>(i)));
+		b.insert(rb);
+	}
+
+	// The product spans more than one batch
+	CrossJoinCursor all(a, b, "");
+	Record record;
+	int count = 0;
+	while (all.next(record)) {
+		if (count == 51) {
+			BOOST_CHECK(record.get<int>("a") == 1);
+			BOOST_CHECK(record.get<int>("b") == 1);
+		}
+		++count;
+	}
+	BOOST_CHECK(count == 2000);
+	BOOST_CHECK(!all.next(record));
+
+	CrossJoinCursor equal(a, b, "a = b");
+	count = 0;
+	while (equal.next(record)) {
+		BOOST_CHECK(record.get<int>("a") == record.get<int>("b"));
+		BOOST_CHECK(record.get<string>("name") == "n" + to_string(static_cast<long long>(count)));
+		++count;
+	}
+	BOOST_CHECK(count == 40);
+
+	CrossJoinCursor some(a, b, "a < 3 AND b >= 48");
+	count = 0;
+	while (some.next(record))
+		++count;
+	BOOST_CHECK(count == 6);
+
+	// Changing a table invalidates the cursor
+	CrossJoinCursor changed(a, b, "a = b");
+	Record extra;
+	extra.set("b", "50");
+	b.insert(extra);
+	BOOST_CHECK_THROW(changed.next(record), InvalidOperationError);
+
+	// The limit applies to the product, before filtering
+	BOOST_CHECK_THROW(CrossJoinCursor(a, b, "a = b", 2000), InvalidOperationError);
+	BOOST_CHECK_THROW(a.cross_join(b, 2000), InvalidOperationError);
+	BOOST_CHECK(a.cross_join(b, 2040).size() == 2040);
+	BOOST_CHECK_THROW(CrossJoinCursor(a, b, "c = 1"), ColumnDoesNotExistError);
+
+	// Without a limit, a result too big for a table is refused before it is
+	// allocated
+	Table big;
+	big.add_column("x", Table::integer);
+	vector<Record> rows(70000);
+	for (unsigned i = 0; i < rows.size(); ++i)
+		rows[i].set("x", "1");
+	big.insert_batch(rows);
+	BOOST_CHECK_THROW(big.cross_join(big), InvalidOperationError);
+}
+
+BOOST_AUTO_TEST_CASE(naturaljoin_partitioned_hash)
+{
+	// Large enough to span several morsels and partitions
+	Table a;
+	a.add_column("id", Table::integer);
+	a.add_column("x", Table::integer);
+	Table b;
+	b.add_column("id", Table::integer);
+	b.add_column("y", Table::varchar);
+	vector<string> key;
+	key.push_back("id");
+	b.set_key(key);
+	unsigned rows = 3 * ThreadPool::morsel_size + 100;
+	for (unsigned i = 0; i < rows; ++i) {
+		Record ra;
+		ra.set("id", to_string(static_cast<long long>((i * 7919) % rows)));
+		ra.set("x", to_string(static_cast<long long>(i)));
+		a.insert(ra);
+		if (i % 3 == 0) {
+			Record rb;
+			rb.set("id", to_string(static_cast<long long>(i)));
+			rb.set("y", "y" + to_string(static_cast<long long>(i)));
+			b.insert(rb);
+		}
+	}
+
+	JoinOptions options;
+	options.strategy = JoinOptions::hash;
+	Table hashed = a.natural_join(b, options);
+	options.strategy = JoinOptions::partitioned_hash;
+	Table partitioned = a.natural_join(b, options);
+	options.strategy = JoinOptions::automatic;
+	Table automatic = a.natural_join(b, options);
+
+	BOOST_CHECK(hashed.size() > 0);
+	BOOST_CHECK(partitioned.size() == hashed.size());
+	BOOST_CHECK(automatic.size() == hashed.size());
+	bool same = true;
+	for (int i = 0; i < hashed.size(); ++i) {
+		Record h = hashed.at(i), p = partitioned.at(i);
+		if (h.get<int>("x") != p.get<int>("x") || h.get<string>("y") != p.get<string>("y"))
+			same = false;
+	}
+	BOOST_CHECK(same);
+}
 BOOST_AUTO_TEST_SUITE_END()
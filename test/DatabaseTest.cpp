@@ -1,5 +1,8 @@
 #include <boost/test/unit_test.hpp>
 #include <iostream>
+#include <fstream>
+#include <thread>
+#include <cstdio>
 #include "database.h"
 
 BOOST_AUTO_TEST_SUITE(database_test)
@@ -140,6 +143,466 @@ BOOST_AUTO_TEST_CASE(load_except_test)
 	BOOST_CHECK_THROW(a.load("fileshouldnotexist.eeee"), IOError);
 }
 
+BOOST_AUTO_TEST_CASE(save_load_data_test)
+{
+	Database a;
+	Table* t = new Table();
+	t->add_column("id", Table::integer);
+	t->add_column("score", Table::floating);
+	t->add_column("name", Table::varchar);
+	t->add_column("born", Table::date);
+	vector<string> key;
+	key.push_back("id");
+	t->set_key(key);
+	for (int i = 0; i < 200; ++i) {
+		Record r;
+		r.set("id", to_string(static_cast<long long>(i)));
+		r.set("score", i % 4 == 0 ? "NULL" : "2.5");
+		r.set("name", i % 7 == 0 ? "NULL" : "name" + to_string(static_cast<long long>(i)));
+		r.set("born", "2013/04/01");
+		t->insert(r);
+	}
+	// Leaves overwritten strings behind in the column
+	t->update("id < 10", "name = 'changed'");
+	a.add_table("people", t);
+	a.add_table("empty", new Table());
+	a.save("Test.b");
+
+	Database b;
+	b.add_table("replaced", new Table());
+	b.load("Test.b");
+	BOOST_REQUIRE(a.table_names() == b.table_names());
+	Table* loaded = b.table("people");
+	BOOST_REQUIRE(loaded->size() == 200);
+	BOOST_CHECK(loaded->columns() == t->columns());
+	BOOST_CHECK(loaded->key() == key);
+	BOOST_CHECK(loaded->count("score") == 150);
+	BOOST_CHECK(loaded->count("name") == t->count("name"));
+	for (int i = 0; i < 200; ++i) {
+		BOOST_CHECK(loaded->at(i).get<int>("id") == i);
+		BOOST_CHECK(loaded->at(i).get<string>("name") == t->at(i).get<string>("name"));
+		BOOST_CHECK(loaded->at(i).is_null("score") == t->at(i).is_null("score"));
+		BOOST_CHECK(loaded->at(i).get<string>("born") == "2013/04/01");
+	}
+	// The key index comes back with the table
+	vector<string> key_values;
+	key_values.push_back("3");
+	BOOST_CHECK(loaded->find(key_values)->get<string>("name") == "changed");
+}
+
+BOOST_AUTO_TEST_CASE(load_damaged_test)
+{
+	Database a;
+	Table* t = new Table();
+	t->add_column("id", Table::integer);
+	for (int i = 0; i < 100; ++i) {
+		Record r;
+		r.set("id", to_string(static_cast<long long>(i)));
+		t->insert(r);
+	}
+	a.add_table("numbers", t);
+	a.save("Test.c");
+
+	// Flip a byte inside the column data
+	{
+		fstream file("Test.c", ios::in | ios::out | ios::binary);
+		file.seekg(200);
+		char c = file.get();
+		file.seekp(200);
+		file.put(c ^ 1);
+	}
+	Database b;
+	b.add_table("kept", new Table());
+	BOOST_CHECK_THROW(b.load("Test.c"), IOError);
+	// A failed load leaves the database alone
+	BOOST_CHECK(b.table_if_exists("kept") != NULL);
+
+	{
+		ofstream file("Test.c", ios::binary | ios::trunc);
+		file << "not a snapshot";
+	}
+	BOOST_CHECK_THROW(b.load("Test.c"), IOError);
+}
+
+BOOST_AUTO_TEST_CASE(load_mapped_test)
+{
+	Database a;
+	Table* t = new Table();
+	t->add_column("id", Table::integer);
+	t->add_column("name", Table::varchar);
+	vector<string> key;
+	key.push_back("id");
+	t->set_key(key);
+	for (int i = 0; i < 100; ++i) {
+		Record r;
+		r.set("id", to_string(static_cast<long long>(i)));
+		r.set("name", i % 10 == 0 ? "NULL" : "name" + to_string(static_cast<long long>(i)));
+		t->insert(r);
+	}
+	a.add_table("people", t);
+	a.add_table("other", new Table(*t));
+	a.save("Test.d");
+
+	Database b;
+	b.load("Test.d", Database::mapped);
+	BOOST_REQUIRE(a.table_names() == b.table_names());
+	Table* result = b.query("name", "people", "id >= 90");
+	BOOST_CHECK(result->size() == 10);
+	BOOST_CHECK(result->count("name") == 9);
+	delete result;
+
+	// Changes are copied out of the mapping, and leave the file alone
+	b.update("people", "id = 5", "name = 'changed'");
+	b.delete_from("people", "id > 49");
+	Record r;
+	r.set("id", "200");
+	r.set("name", "new");
+	b.table("people")->insert(r);
+	BOOST_CHECK(b.table("people")->size() == 51);
+	BOOST_CHECK(b.table("people")->at(5).get<string>("name") == "changed");
+	BOOST_CHECK_THROW(b.table("people")->insert(r), KeyConflictError);
+
+	Database c;
+	c.load("Test.d", Database::mapped);
+	BOOST_CHECK(c.table("people")->size() == 100);
+	BOOST_CHECK(c.table("people")->at(5).get<string>("name") == "name5");
+	Database* copy = c.copy();
+	c.drop_table("other");
+	BOOST_CHECK(copy->table("other")->size() == 100);
+	delete copy;
+
+	// Saving sets up the tables that are still only mapped
+	b.save("Test.e");
+	Database d;
+	d.load("Test.e");
+	BOOST_CHECK(d.table("people")->size() == 51);
+	BOOST_CHECK(d.table("other")->size() == 100);
+
+	// A snapshot can be saved over the file it was mapped from
+	Database e;
+	e.load("Test.e", Database::mapped);
+	e.delete_from("people", "id > 9");
+	e.save("Test.e");
+	BOOST_CHECK(e.table("other")->at(99).get<int>("id") == 99);
+	Database f;
+	f.load("Test.e", Database::mapped);
+	BOOST_CHECK(f.table("people")->size() == 10);
+	BOOST_CHECK(f.table("other")->size() == 100);
+
+	BOOST_CHECK_THROW(d.load("fileshouldnotexist.eeee", Database::mapped), IOError);
+	BOOST_CHECK(d.table_if_exists("people") != NULL);
+}
+
+BOOST_AUTO_TEST_CASE(import_csv_test)
+{
+	{
+		ofstream file("Test.csv", ios::binary | ios::trunc);
+		file << "id,score,name,born,note\r\n";
+		file << "1,2.5,plain,2013/04/01,?\r\n";
+		file << "2,3,\"with, comma\",2013/04/02,x\r\n";
+		file << "\r\n";
+		file << "3,?,\"say \"\"hi\"\"\",?,\r\n";
+		file << "4,1e2,\"two\nlines\",2013/04/04,NULL";
+	}
+	Database a;
+	a.import_csv("t", "Test.csv");
+	Table* t = a.table("t");
+	Table::ColumnList columns = t->columns();
+	BOOST_REQUIRE(columns.size() == 5);
+	BOOST_CHECK(columns[0] == make_pair(string("id"), Table::integer));
+	BOOST_CHECK(columns[1] == make_pair(string("score"), Table::floating));
+	BOOST_CHECK(columns[2] == make_pair(string("name"), Table::varchar));
+	BOOST_CHECK(columns[3] == make_pair(string("born"), Table::date));
+	BOOST_CHECK(columns[4] == make_pair(string("note"), Table::varchar));
+	BOOST_REQUIRE(t->size() == 4);
+	BOOST_CHECK(t->at(1).get<string>("name") == "with, comma");
+	BOOST_CHECK(t->at(2).get<string>("name") == "say \"hi\"");
+	BOOST_CHECK(t->at(3).get<string>("name") == "two\nlines");
+	BOOST_CHECK(t->at(2).is_null("score"));
+	BOOST_CHECK(t->at(2).is_null("born"));
+	BOOST_CHECK(t->count("note") == 2);
+	BOOST_CHECK(t->sum<float>("score") == 105.5f);
+
+	// Without inference every column is varchar
+	CsvOptions options;
+	options.infer_types = false;
+	a.import_csv("text", "Test.csv", options);
+	BOOST_CHECK(a.table("text")->columns()[0].second == Table::varchar);
+
+	// Appending to an existing table matches the columns by name
+	{
+		ofstream file("Test.tsv", ios::binary | ios::trunc);
+		file << "name\tid\n";
+		file << "five\t5\n";
+	}
+	a.import_csv("t", "Test.tsv");
+	BOOST_REQUIRE(t->size() == 5);
+	BOOST_CHECK(t->at(4).get<int>("id") == 5);
+	BOOST_CHECK(t->at(4).is_null("score"));
+
+	{
+		ofstream file("Test.tsv", ios::binary | ios::trunc);
+		file << "id\tname\tmissing\n";
+		file << "6\tsix\tx\n";
+	}
+	BOOST_CHECK_THROW(a.import_csv("t", "Test.tsv"), ColumnDoesNotExistError);
+	{
+		ofstream file("Test.tsv", ios::binary | ios::trunc);
+		file << "id\tname\n";
+		file << "6\tsix\textra\n";
+	}
+	BOOST_CHECK_THROW(a.import_csv("t", "Test.tsv"), IOError);
+	{
+		ofstream file("Test.tsv", ios::binary | ios::trunc);
+		file << "id\tname\n";
+		file << "6\tsix\n";
+		file << "seven\tseven\n";
+	}
+	BOOST_CHECK_THROW(a.import_csv("t", "Test.tsv"), InvalidTypeError);
+	BOOST_CHECK(t->size() == 5);
+	BOOST_CHECK_THROW(a.import_csv("u", "fileshouldnotexist.eeee"), IOError);
+	BOOST_CHECK(a.table_if_exists("u") == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(import_csv_parallel_test)
+{
+	// Big enough to be split into several chunks, with newlines inside quotes
+	// along the way
+	const int rows = 60000;
+	{
+		ofstream file("Test.csv", ios::binary | ios::trunc);
+		file << "id,name,value\n";
+		for (int i = 0; i < rows; ++i) {
+			file << i << ",";
+			if (i % 1000 == 0)
+				file << "\"line\nbreak, " << i << "\"";
+			else
+				file << "name" << i;
+			file << "," << (i % 7 == 0 ? "?" : "1") << "\n";
+		}
+	}
+	Database a;
+	Table::ColumnList columns;
+	columns.push_back(make_pair("id", Table::integer));
+	columns.push_back(make_pair("name", Table::varchar));
+	columns.push_back(make_pair("value", Table::integer));
+	Table* t = new Table(columns);
+	vector<string> key;
+	key.push_back("id");
+	t->set_key(key);
+	a.add_table("t", t);
+	a.import_csv("t", "Test.csv");
+	BOOST_REQUIRE(t->size() == rows);
+	BOOST_CHECK(t->count("value") == rows - (rows + 6) / 7);
+	BOOST_CHECK(t->sum<double>("id") == rows * (rows - 1.0) / 2);
+	BOOST_CHECK(t->at(59999).get<int>("id") == 59999);
+	BOOST_CHECK(t->at(59999).get<string>("name") == "name59999");
+	BOOST_CHECK(t->at(3000).get<string>("name") == "line\nbreak, 3000");
+	vector<string> key_values;
+	key_values.push_back("12345");
+	BOOST_CHECK(t->find(key_values)->get<string>("name") == "name12345");
+
+	// The same keys again conflict, and none of the rows stay
+	BOOST_CHECK_THROW(a.import_csv("t", "Test.csv"), KeyConflictError);
+	BOOST_CHECK(t->size() == rows);
+	BOOST_CHECK(t->find(key_values)->get<string>("name") == "name12345");
+}
+
+BOOST_AUTO_TEST_CASE(log_recover_test)
+{
+	remove("Test.f");
+	remove("Test.log");
+	Database a;
+	a.open_log("Test.log");
+	Table* t = new Table();
+	t->add_column("id", Table::integer);
+	t->add_column("name", Table::varchar);
+	vector<string> key;
+	key.push_back("id");
+	t->set_key(key);
+	a.add_table("people", t);
+	for (int i = 0; i < 50; ++i) {
+		Record r;
+		r.set("id", to_string(static_cast<long long>(i)));
+		r.set("name", i % 5 == 0 ? "NULL" : "name" + to_string(static_cast<long long>(i)));
+		t->insert(r);
+	}
+	vector<Record> batch;
+	for (int i = 50; i < 60; ++i) {
+		Record r;
+		r.set("id", to_string(static_cast<long long>(i)));
+		r.set("name", "batch");
+		batch.push_back(r);
+	}
+	t->insert_batch(batch);
+	a.update("people", "id < 10", "name = 'changed'");
+	a.delete_from("people", "id >= 55");
+	t->add_column("born", Table::date);
+	a.update("people", "id = 3", "born = '2013/04/01'");
+	t->rename_column("name", "full_name");
+	a.add_table("dropped", new Table());
+	a.drop_table("dropped");
+
+	Database b;
+	b.recover("Test.f", "Test.log");
+	BOOST_REQUIRE(b.table_names() == a.table_names());
+	Table* recovered = b.table("people");
+	BOOST_REQUIRE(recovered->size() == 55);
+	BOOST_CHECK(recovered->columns() == t->columns());
+	BOOST_CHECK(recovered->key() == key);
+	BOOST_CHECK(recovered->count("full_name") == t->count("full_name"));
+	for (int i = 0; i < 55; ++i) {
+		BOOST_CHECK(recovered->at(i).get<int>("id") == t->at(i).get<int>("id"));
+		BOOST_CHECK(recovered->at(i).get<string>("full_name") == t->at(i).get<string>("full_name"));
+		BOOST_CHECK(recovered->at(i).get<string>("born") == t->at(i).get<string>("born"));
+	}
+
+	// After a checkpoint, recovery starts from the snapshot
+	a.checkpoint("Test.f");
+	a.delete_from("people", "id < 20");
+	Database c;
+	c.recover("Test.f", "Test.log");
+	BOOST_CHECK(c.table("people")->size() == 35);
+	BOOST_CHECK(c.table("people")->at(0).get<int>("id") == 20);
+
+	// Changes after recovering are numbered after those in the snapshot
+	a.close_log();
+	c.open_log("Test.log");
+	c.update("people", "id = 20", "full_name = 'again'");
+	c.close_log();
+	Database d;
+	d.recover("Test.f", "Test.log");
+	BOOST_CHECK(d.table("people")->size() == 35);
+	BOOST_CHECK(d.table("people")->at(0).get<string>("full_name") == "again");
+}
+
+BOOST_AUTO_TEST_CASE(log_assign_test)
+{
+	remove("Test.i");
+	remove("Test.log");
+	Database a;
+	a.open_log("Test.log");
+	Table* t = new Table();
+	t->add_column("id", Table::integer);
+	a.add_table("t", t);
+	Record first;
+	first.set("id", "1");
+	t->insert(first);
+
+	// Assigning replaces the table in the log as well
+	Table other;
+	other.add_column("id", Table::integer);
+	other.add_column("name", Table::varchar);
+	Record row;
+	row.set("id", "2");
+	row.set("name", "two");
+	other.insert(row);
+	Cursor* cursor = a.query_cursor("id", "t", "id >= 1");
+	*a.table("t") = other;
+	Record read;
+	BOOST_CHECK_THROW(cursor->next(read), InvalidOperationError);
+	delete cursor;
+	row.set("id", "3");
+	row.set("name", "three");
+	a.table("t")->insert(row);
+	a.close_log();
+
+	Database b;
+	b.recover("Test.i", "Test.log");
+	Table* recovered = b.table("t");
+	BOOST_CHECK(recovered->columns() == other.columns());
+	BOOST_REQUIRE(recovered->size() == 2);
+	BOOST_CHECK(recovered->at(0).get<string>("name") == "two");
+	BOOST_CHECK(recovered->at(1).get<int>("id") == 3);
+}
+
+BOOST_AUTO_TEST_CASE(log_torn_tail_test)
+{
+	remove("Test.g");
+	remove("Test.log");
+	{
+		Database a;
+		LogOptions options;
+		options.sync = LogOptions::sync_never;
+		a.open_log("Test.log", options);
+		Table* t = new Table();
+		t->add_column("id", Table::integer);
+		a.add_table("numbers", t);
+		for (int i = 0; i < 10; ++i) {
+			Record r;
+			r.set("id", to_string(static_cast<long long>(i)));
+			t->insert(r);
+		}
+	}
+	// An entry cut short by a crash
+	{
+		ofstream file("Test.log", ios::binary | ios::app);
+		file << "torn entry";
+	}
+
+	Database b;
+	b.recover("Test.g", "Test.log");
+	BOOST_REQUIRE(b.table("numbers")->size() == 10);
+	b.open_log("Test.log");
+	BOOST_CHECK_THROW(b.load("Test.g"), InvalidOperationError);
+	BOOST_CHECK_THROW(b.recover("Test.g", "Test.log"), InvalidOperationError);
+	Record r;
+	r.set("id", "10");
+	b.table("numbers")->insert(r);
+	b.close_log();
+
+	Database c;
+	c.recover("Test.g", "Test.log");
+	BOOST_CHECK(c.table("numbers")->size() == 11);
+	BOOST_CHECK(c.table("numbers")->at(10).get<int>("id") == 10);
+
+	{
+		ofstream file("Test.log", ios::binary | ios::trunc);
+		file << "not a log";
+	}
+	Database d;
+	BOOST_CHECK_THROW(d.recover("Test.g", "Test.log"), IOError);
+	BOOST_CHECK_THROW(d.open_log("Test.log"), IOError);
+}
+
+BOOST_AUTO_TEST_CASE(log_group_commit_test)
+{
+	remove("Test.h");
+	remove("Test.log");
+	const int writers = 4;
+	const int rows = 100;
+	Database a;
+	a.open_log("Test.log");
+	for (int w = 0; w < writers; ++w) {
+		Table* t = new Table();
+		t->add_column("id", Table::integer);
+		a.add_table("writer" + to_string(static_cast<long long>(w)), t);
+	}
+
+	// Each thread writes to a table of its own, and shares the log
+	vector<thread> threads;
+	for (int w = 0; w < writers; ++w) {
+		Table* t = a.table("writer" + to_string(static_cast<long long>(w)));
+		threads.push_back(thread([=]() {
+			for (int i = 0; i < rows; ++i) {
+				Record r;
+				r.set("id", to_string(static_cast<long long>(i)));
+				t->insert(r);
+			}
+		}));
+	}
+	for (thread& writer : threads)
+		writer.join();
+
+	Database b;
+	b.recover("Test.h", "Test.log");
+	for (int w = 0; w < writers; ++w) {
+		Table* t = b.table("writer" + to_string(static_cast<long long>(w)));
+		BOOST_REQUIRE(t->size() == rows);
+		BOOST_CHECK(t->sum<double>("id") == rows * (rows - 1.0) / 2);
+	}
+}
+
 BOOST_AUTO_TEST_CASE(merge_test)
 {
 	//First database
@@ -571,8 +571,8 @@ BOOST_AUTO_TEST_CASE( query_test5 )
 	Record q2_table1_r5 = q2_table1->at(4);
 	BOOST_CHECK(q2_table1_r5.get<string>("student") == "Joseph");
 
-	// now we want a table of students id's that NOT equal to ANY ids in the good_student table
-	Table* q3_table1 = d.query("id", "students", "id != ANY(good_students)");
+	// now we want a table of students id's that are NOT equal to ALL ids in the good_student table
+	Table* q3_table1 = d.query("id", "students", "id != ALL(good_students)");
 	// this should be Ruth, Mario, Johnny and Joseph's ids
 
 	Record q3_table1_r1 = q3_table1->at(0);
@@ -600,7 +600,7 @@ BOOST_AUTO_TEST_CASE( query_test5 )
 	the other table (good_gpa) contains gpas 3.9, 3.8, 3.7
 	*/
 	// first lets kick out all the students who aren't good_students
-	d.delete_from("students", "id NOT EXISTS(good_students)");
+	d.delete_from("students", "NOT (id IN good_students)");
 	BOOST_CHECK(d.table("students")->size() == 4);
 
 	// then lets kick out the students who dont have a good gpa
@@ -619,6 +619,384 @@ BOOST_AUTO_TEST_CASE( query_test5 )
 	BOOST_CHECK_THROW(d.update("good_gpa", "gpa >= 3.5", "gpa == 2.0"), QuerySyntaxError);
 }
 
+BOOST_AUTO_TEST_CASE( query_test_precedence )
+{
+	/*
+		AND binds tighter than OR, NOT tighter than both, and literals may be
+		written on either side of a comparison
+	*/
+	Database d;
+	Table* t1 = new Table();
+	t1->add_column("id", Table::integer);
+	t1->add_column("weight", Table::floating);
+	t1->add_column("born", Table::date);
+	for (int i = 1; i <= 4; i++) {
+		vector<pair<string, string> > ent;
+		ent.push_back(make_pair("id", to_string(static_cast<long long>(i))));
+		ent.push_back(make_pair("weight", to_string(static_cast<long long>(100 + 10 * i)) + ".5"));
+		ent.push_back(make_pair("born", "195" + to_string(static_cast<long long>(i)) + "/01/01"));
+		t1->insert(Record(ent));
+	}
+	d.add_table("table1", t1);
+
+	Table* q1 = d.query("id", "table1", "id = 1 OR id = 2 AND weight > 200");
+	BOOST_CHECK(q1->size() == 1);
+	BOOST_CHECK(q1->at(0).get<int>("id") == 1);
+
+	Table* q2 = d.query("id", "table1", "NOT id < 3 AND 1953/01/01 >= born");
+	BOOST_CHECK(q2->size() == 1);
+	BOOST_CHECK(q2->at(0).get<int>("id") == 3);
+
+	Table* q3 = d.query("id", "table1", "weight >= 120.5");
+	BOOST_CHECK(q3->size() == 3);
+
+	BOOST_CHECK_THROW(d.query("id", "table1", "missing = 1"), ColumnDoesNotExistError);
+	BOOST_CHECK_THROW(d.query("id", "table1", "id = 1 AND"), QuerySyntaxError);
+}
+
+BOOST_AUTO_TEST_CASE( query_test_batches )
+{
+	/*
+		Rows are matched in batches, so check a table that spans several
+		batches and doesn't end on a batch boundary
+	*/
+	Database d;
+	Table* t1 = new Table();
+	t1->add_column("id", Table::integer);
+	t1->add_column("score", Table::floating);
+	for (int i = 0; i < 2500; i++) {
+		vector<pair<string, string> > ent;
+		ent.push_back(make_pair("id", to_string(static_cast<long long>(i))));
+		ent.push_back(make_pair("score", to_string(static_cast<long long>(i % 10))));
+		t1->insert(Record(ent));
+	}
+	d.add_table("table1", t1);
+
+	Table* q1 = d.query("id", "table1", "NOT score < 9");
+	BOOST_CHECK(q1->size() == 250);
+	BOOST_CHECK(q1->at(249).get<int>("id") == 2499);
+
+	Table* q2 = d.query("id", "table1", "id >= 1000 AND id < 1030 OR id = 2048");
+	BOOST_CHECK(q2->size() == 31);
+	BOOST_CHECK(q2->at(0).get<int>("id") == 1000);
+	BOOST_CHECK(q2->at(30).get<int>("id") == 2048);
+
+	d.delete_from("table1", "score != 0");
+	BOOST_CHECK(d.table("table1")->size() == 250);
+}
+
+BOOST_AUTO_TEST_CASE( query_test_comparisons )
+{
+	/*
+		Every comparison operator on integer, float and date columns, over a
+		table that ends partway through a 64 row word. NULLs never match.
+	*/
+	Database d;
+	Table* t1 = new Table();
+	t1->add_column("id", Table::integer);
+	t1->add_column("rating", Table::floating);
+	t1->add_column("day", Table::date);
+	for (int i = 0; i < 131; i++) {
+		vector<pair<string, string> > ent;
+		ent.push_back(make_pair("id", i % 7 == 0 ? "NULL" : to_string(static_cast<long long>(i - 60))));
+		ent.push_back(make_pair("rating", to_string(static_cast<long long>(i % 5)) + ".5"));
+		ent.push_back(make_pair("day", "2013/01/" + string(i % 28 < 9 ? "0" : "") + to_string(static_cast<long long>(i % 28 + 1))));
+		t1->insert(Record(ent));
+	}
+	d.add_table("table1", t1);
+
+	// ids run from -59 to 70, with 19 NULLs in between
+	BOOST_CHECK(d.query("id", "table1", "id = 0")->size() == 1);
+	BOOST_CHECK(d.query("id", "table1", "id != 0")->size() == 111);
+	BOOST_CHECK(d.query("id", "table1", "id < 0")->size() == 51);
+	BOOST_CHECK(d.query("id", "table1", "id <= 0")->size() == 52);
+	BOOST_CHECK(d.query("id", "table1", "id > 50")->size() == 17);
+	BOOST_CHECK(d.query("id", "table1", "id >= 50")->size() == 18);
+
+	BOOST_CHECK(d.query("id", "table1", "rating >= 1 AND rating <= 2")->size() == 26);
+	BOOST_CHECK(d.query("id", "table1", "rating = 4.5")->size() == 26);
+	BOOST_CHECK(d.query("id", "table1", "rating != 4.5")->size() == 105);
+	BOOST_CHECK(d.query("id", "table1", "rating > 3.5")->size() == 26);
+	BOOST_CHECK(d.query("id", "table1", "rating < 0.5")->size() == 0);
+
+	BOOST_CHECK(d.query("id", "table1", "day >= 2013/01/10 AND day < 2013/01/20")->size() == 50);
+}
+
+BOOST_AUTO_TEST_CASE( query_test_text_comparisons )
+{
+	/*
+		Comparisons that fall back to text, row by row: two varchar columns,
+		a varchar column with one of another type, and a column with a
+		literal it can't be converted to.
+	*/
+	Database d;
+	Table* t1 = new Table();
+	t1->add_column("name", Table::varchar);
+	t1->add_column("nick", Table::varchar);
+	t1->add_column("label", Table::varchar);
+	t1->add_column("code", Table::integer);
+	t1->add_column("rating", Table::floating);
+	t1->add_column("day", Table::date);
+	const char* rows[][6] = {
+		{ "ann", "ann", "12", "12", "1.5", "2013/01/01" },
+		{ "bob", "al", "7", "7", "2", "2013/01/02" },
+		{ "carl", "dave", "5", "100", "0.5", "2013/01/03" },
+		{ "NULL", "x", "NULL", "NULL", "NULL", "NULL" }
+	};
+	for (int i = 0; i < 4; i++) {
+		vector<pair<string, string> > ent;
+		ent.push_back(make_pair("name", rows[i][0]));
+		ent.push_back(make_pair("nick", rows[i][1]));
+		ent.push_back(make_pair("label", rows[i][2]));
+		ent.push_back(make_pair("code", rows[i][3]));
+		ent.push_back(make_pair("rating", rows[i][4]));
+		ent.push_back(make_pair("day", rows[i][5]));
+		t1->insert(Record(ent));
+	}
+	d.add_table("table1", t1);
+
+	BOOST_CHECK(d.query("name", "table1", "name = nick")->size() == 1);
+	BOOST_CHECK(d.query("name", "table1", "name < nick")->size() == 1);
+	BOOST_CHECK(d.query("name", "table1", "name > nick")->size() == 1);
+	BOOST_CHECK(d.query("name", "table1", "name != nick")->size() == 2);
+
+	// "5" sorts after "100" as text
+	BOOST_CHECK(d.query("name", "table1", "label = code")->size() == 2);
+	BOOST_CHECK(d.query("name", "table1", "label > code")->size() == 1);
+	BOOST_CHECK(d.query("name", "table1", "code < label")->size() == 1);
+	BOOST_CHECK(d.query("name", "table1", "code >= label")->size() == 2);
+	BOOST_CHECK(d.query("name", "table1", "day > code")->size() == 2);
+
+	BOOST_CHECK(d.query("name", "table1", "code = 'abc'")->size() == 0);
+	BOOST_CHECK(d.query("name", "table1", "code < 'a'")->size() == 3);
+	BOOST_CHECK(d.query("name", "table1", "rating = '1.5'")->size() == 1);
+}
+
+BOOST_AUTO_TEST_CASE( query_view_test )
+{
+	/*
+		A view reads rows from its source until the source changes, then keeps
+		the rows it had
+	*/
+	Database d;
+	Table* t1 = new Table();
+	t1->add_column("id", Table::integer);
+	t1->add_column("name", Table::varchar);
+	for (int i = 0; i < 10; i++) {
+		vector<pair<string, string> > ent;
+		ent.push_back(make_pair("id", to_string(static_cast<long long>(i))));
+		ent.push_back(make_pair("name", "name" + to_string(static_cast<long long>(i))));
+		t1->insert(Record(ent));
+	}
+	d.add_table("table1", t1);
+
+	ResultView* view = d.query_view("name", "table1", "id >= 7");
+	BOOST_CHECK(!view->is_materialized());
+	BOOST_CHECK(view->size() == 3);
+	BOOST_CHECK(view->columns().size() == 1);
+	BOOST_CHECK(view->at(0).get<string>("name") == "name7");
+	int count = 0;
+	for (ResultView::ViewIterator it = view->begin(); it != view->end(); ++it)
+		count++;
+	BOOST_CHECK(count == 3);
+
+	d.delete_from("table1", "id = 7");
+	BOOST_CHECK(view->is_materialized());
+	BOOST_CHECK(view->size() == 3);
+	BOOST_CHECK(view->at(0).get<string>("name") == "name7");
+
+	// Changing the view's table leaves the source alone
+	ResultView* other = d.query_view("*", "table1", "id < 3");
+	other->table()->drop_where("id = 0");
+	BOOST_CHECK(other->size() == 2);
+	BOOST_CHECK(d.table("table1")->size() == 9);
+
+	// Dropping the source table keeps the view readable
+	ResultView* last = d.query_view("id", "table1", "id = 9");
+	d.drop_table("table1");
+	BOOST_CHECK(last->at(0).get<int>("id") == 9);
+
+	delete view;
+	delete other;
+	delete last;
+}
+
+BOOST_AUTO_TEST_CASE( query_cursor_test )
+{
+	/*
+		A cursor returns the same rows as query, one at a time, and can be
+		stopped early
+	*/
+	Database d;
+	Table* t1 = new Table();
+	t1->add_column("id", Table::integer);
+	t1->add_column("name", Table::varchar);
+	for (int i = 0; i < 3000; i++) {
+		vector<pair<string, string> > ent;
+		ent.push_back(make_pair("id", to_string(static_cast<long long>(i))));
+		ent.push_back(make_pair("name", "name" + to_string(static_cast<long long>(i))));
+		t1->insert(Record(ent));
+	}
+	d.add_table("table1", t1);
+
+	Cursor* cursor = d.query_cursor("name", "table1", "id >= 1000 AND id < 2500");
+	Record record;
+	int count = 0;
+	while (cursor->next(record))
+		count++;
+	BOOST_CHECK(count == 1500);
+	BOOST_CHECK(record.get<string>("name") == "name2499");
+	BOOST_CHECK(record.size() == 1);
+	BOOST_CHECK(!cursor->next(record));
+	delete cursor;
+
+	cursor = d.query_cursor("*", "table1", "id > 10");
+	BOOST_CHECK(cursor->next(record));
+	BOOST_CHECK(record.get<int>("id") == 11);
+	d.delete_from("table1", "id = 0");
+	BOOST_CHECK_THROW(cursor->next(record), InvalidOperationError);
+	delete cursor;
+}
+
+BOOST_AUTO_TEST_CASE( query_test_subqueries )
+{
+	/*
+		IN, ANY, ALL and EXISTS against other tables, including empty tables,
+		NULLs in the subquery and mismatched column types.
+	*/
+	Database d;
+	Table* people = new Table();
+	people->add_column("id", Table::integer);
+	people->add_column("name", Table::varchar);
+	people->add_column("score", Table::floating);
+	for (int i = 1; i <= 20; i++) {
+		vector<pair<string, string> > ent;
+		ent.push_back(make_pair("id", to_string(static_cast<long long>(i))));
+		ent.push_back(make_pair("name", "p" + to_string(static_cast<long long>(i))));
+		ent.push_back(make_pair("score", to_string(static_cast<long long>(i / 2)) + (i % 2 ? ".5" : ".0")));
+		people->insert(Record(ent));
+	}
+	d.add_table("people", people);
+
+	// 2, 4, 6, 8, 10 and a NULL
+	Table* picks = new Table();
+	picks->add_column("n", Table::integer);
+	for (int i = 0; i <= 5; i++) {
+		vector<pair<string, string> > ent;
+		ent.push_back(make_pair("n", i == 0 ? "NULL" : to_string(static_cast<long long>(i * 2))));
+		picks->insert(Record(ent));
+	}
+	d.add_table("picks", picks);
+
+	Table* names = new Table();
+	names->add_column("name", Table::varchar);
+	vector<pair<string, string> > p3, p5, x;
+	p3.push_back(make_pair("name", "p3"));
+	p5.push_back(make_pair("name", "p5"));
+	x.push_back(make_pair("name", "x"));
+	names->insert(Record(p3));
+	names->insert(Record(p5));
+	names->insert(Record(x));
+	d.add_table("names", names);
+
+	Table* empty = new Table();
+	empty->add_column("n", Table::integer);
+	d.add_table("empty", empty);
+
+	// More than one column, so the one named like the compared column is used
+	Table* wide = new Table();
+	wide->add_column("label", Table::varchar);
+	wide->add_column("id", Table::integer);
+	for (int i = 15; i <= 17; i++) {
+		vector<pair<string, string> > ent;
+		ent.push_back(make_pair("label", "w"));
+		ent.push_back(make_pair("id", to_string(static_cast<long long>(i))));
+		wide->insert(Record(ent));
+	}
+	d.add_table("wide", wide);
+
+	BOOST_CHECK(d.query("id", "people", "id IN picks")->size() == 5);
+	BOOST_CHECK(d.query("id", "people", "id IN (picks)")->size() == 5);
+	BOOST_CHECK(d.query("id", "people", "NOT (id IN picks)")->size() == 15);
+	BOOST_CHECK(d.query("id", "people", "name IN names")->size() == 2);
+	BOOST_CHECK(d.query("id", "people", "score IN picks")->size() == 5);
+	BOOST_CHECK(d.query("id", "people", "id IN wide")->size() == 3);
+	BOOST_CHECK(d.query("id", "people", "id = ANY(picks)")->size() == 5);
+	BOOST_CHECK(d.query("id", "people", "id != ALL(picks)")->size() == 15);
+
+	BOOST_CHECK(d.query("id", "people", "id < ANY(picks)")->size() == 9);
+	BOOST_CHECK(d.query("id", "people", "id >= ANY(picks)")->size() == 19);
+	BOOST_CHECK(d.query("id", "people", "id > ALL(picks)")->size() == 10);
+	BOOST_CHECK(d.query("id", "people", "id <= ALL(picks)")->size() == 2);
+	BOOST_CHECK(d.query("id", "people", "score < ALL(picks)")->size() == 3);
+	BOOST_CHECK(d.query("id", "people", "id != ANY(picks)")->size() == 20);
+	BOOST_CHECK(d.query("id", "people", "id = ALL(picks)")->size() == 0);
+	BOOST_CHECK(d.query("id", "people", "id > ANY(empty)")->size() == 0);
+	BOOST_CHECK(d.query("id", "people", "id > ALL(empty)")->size() == 20);
+
+	BOOST_CHECK(d.query("id", "people", "EXISTS(picks)")->size() == 20);
+	BOOST_CHECK(d.query("id", "people", "NOT EXISTS(empty) AND id <= 3")->size() == 3);
+	BOOST_CHECK(d.query("id", "people", "EXISTS(empty) OR id = 1")->size() == 1);
+
+	Cursor* cursor = d.query_cursor("id", "people", "id IN wide");
+	Record record;
+	int count = 0;
+	while (cursor->next(record))
+		++count;
+	BOOST_CHECK(count == 3);
+	delete cursor;
+
+	d.update("people", "id > ALL(picks)", "name = 'big'");
+	BOOST_CHECK(d.query("id", "people", "name = 'big'")->size() == 10);
+	d.delete_from("people", "id IN picks");
+	BOOST_CHECK(d.table("people")->size() == 15);
+
+	BOOST_CHECK_THROW(d.query("id", "people", "id IN missing"), TableDoesNotExistError);
+	BOOST_CHECK_THROW(d.query("id", "people", "score IN wide"), InvalidOperationError);
+	BOOST_CHECK_THROW(d.query("id", "people", "id IN 'picks'"), QuerySyntaxError);
+	BOOST_CHECK_THROW(d.query("id", "people", "id < ANY(picks"), QuerySyntaxError);
+}
+
+BOOST_AUTO_TEST_CASE( query_test_nulls )
+{
+	/*
+		Comparisons with NULL are unknown: NOT keeps them unknown, AND and OR
+		follow SQL, and only rows where the whole clause is true match.
+	*/
+	Database d;
+	Table* t1 = new Table();
+	t1->add_column("id", Table::integer);
+	t1->add_column("x", Table::integer);
+	t1->add_column("name", Table::varchar);
+	for (int i = 1; i <= 10; i++) {
+		vector<pair<string, string> > ent;
+		ent.push_back(make_pair("id", to_string(static_cast<long long>(i))));
+		ent.push_back(make_pair("x", i % 3 == 0 ? "?" : to_string(static_cast<long long>(i))));
+		ent.push_back(make_pair("name", i % 4 == 0 ? "NULL" : "n" + to_string(static_cast<long long>(i))));
+		t1->insert(Record(ent));
+	}
+	d.add_table("table1", t1);
+
+	// x is NULL for ids 3, 6 and 9, and name for ids 4 and 8
+	BOOST_CHECK(d.query("id", "table1", "x = 4")->size() == 1);
+	BOOST_CHECK(d.query("id", "table1", "x != 4")->size() == 6);
+	BOOST_CHECK(d.query("id", "table1", "NOT x = 4")->size() == 6);
+	BOOST_CHECK(d.query("id", "table1", "x = 4 OR x != 4")->size() == 7);
+	BOOST_CHECK(d.query("id", "table1", "x > 100 OR id > 0")->size() == 10);
+	BOOST_CHECK(d.query("id", "table1", "NOT (x > 100 AND id > 0)")->size() == 7);
+	BOOST_CHECK(d.query("id", "table1", "NOT (x > 100 AND id > 100)")->size() == 10);
+	BOOST_CHECK(d.query("id", "table1", "x = id")->size() == 7);
+	BOOST_CHECK(d.query("id", "table1", "name = 'n1'")->size() == 1);
+	BOOST_CHECK(d.query("id", "table1", "name != 'n1'")->size() == 7);
+	BOOST_CHECK(d.query("id", "table1", "NOT (name < 'a')")->size() == 8);
+
+	Table* result = d.query("*", "table1", "id = 3");
+	BOOST_CHECK(result->at(0).is_null("x"));
+	BOOST_CHECK(result->at(0).get<int>("x") == 0);
+	BOOST_CHECK(!result->at(0).is_null("name"));
+	delete result;
+}
+
 
 
 
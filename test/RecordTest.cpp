@@ -59,3 +59,70 @@ BOOST_AUTO_TEST_CASE( record_test1 )
 
 	// this is really all we need since record is tested so much throughout the testing (especially query)
 }
+
+BOOST_AUTO_TEST_CASE( record_typed_values )
+{
+	// values keep their C++ type until they are read back as another type
+	Record r;
+	r.set("name", "Abraham Lincoln");
+	r.set("age", 56);
+	r.set("height", 1.93);
+	BOOST_CHECK(r.get<string>("name") == "Abraham Lincoln");
+	BOOST_CHECK(r.get<int>("age") == 56);
+	BOOST_CHECK(r.get<string>("age") == "56");
+	BOOST_CHECK_CLOSE(r.get<float>("height"), 1.93, TOL);
+	BOOST_CHECK(r.get<int>("height") == 1);
+
+	// string values are converted on request
+	r.set("age", "57");
+	BOOST_CHECK(r.get<int>("age") == 57);
+
+	// iterating gives every field in string form
+	Record::RecordIterator it = r.begin();
+	BOOST_CHECK(it->first == "name" && it->second == "Abraham Lincoln");
+	++it;
+	BOOST_CHECK(it->first == "age" && it->second == "57");
+	++it;
+	BOOST_CHECK(it->first == "height" && it->second == "1.93");
+	++it;
+	BOOST_CHECK(it == r.end());
+
+	// records read from a table carry the column types
+	Table::ColumnList columns;
+	columns.push_back(make_pair("age", Table::integer));
+	columns.push_back(make_pair("born", Table::date));
+	Table t(columns);
+	Record row;
+	row.set("age", 56);
+	row.set("born", "1809/02/12");
+	t.insert(row);
+	BOOST_CHECK(t.at(0).get<int>("age") == 56);
+	BOOST_CHECK(t.at(0).get<string>("born") == "1809/02/12");
+}
+
+BOOST_AUTO_TEST_CASE( record_field_index )
+{
+	Table::ColumnList columns;
+	columns.push_back(make_pair("name", Table::varchar));
+	columns.push_back(make_pair("age", Table::integer));
+	Table t(columns);
+	Record r;
+	r.set("name", "Pam");
+	r.set("age", 64);
+	t.insert(r);
+
+	// look the field up once, then read it by position
+	Record row = t.at(0);
+	unsigned age = row.index_for("age");
+	BOOST_CHECK(age == 1);
+	BOOST_CHECK(row.get<int>(age) == 64);
+	BOOST_CHECK(row.get<string>(0u) == "Pam");
+	BOOST_CHECK_THROW(row.get<int>(5u), ColumnDoesNotExistError);
+	BOOST_CHECK_THROW(row.index_for("weight"), ColumnDoesNotExistError);
+
+	// a record read from a table can be changed and inserted again
+	row.set("name", "George");
+	t.insert(row);
+	BOOST_CHECK(t.size() == 2);
+	BOOST_CHECK(t.at(1).get<string>("name") == "George");
+}
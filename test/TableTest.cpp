@@ -438,6 +438,221 @@ BOOST_AUTO_TEST_CASE(insert_key_exception)
 	BOOST_CHECK_THROW(t.insert(r2), KeyConflictError);
 }
 
+BOOST_AUTO_TEST_CASE(insert_batch_test)
+{
+	Table t;
+	t.add_column("ID", Table::integer);
+	t.add_column("name", Table::varchar);
+	vector<string> names;
+	names.push_back("ID");
+	t.set_key(names);
+	Record existing;
+	existing.set("ID", "7");
+	existing.set("name", "seven");
+	t.insert(existing);
+
+	vector<Record> batch;
+	for (int i = 0; i < 200; ++i) {
+		Record r;
+		r.set("ID", to_string(static_cast<long long>(i + 100)));
+		r.set("name", i % 3 == 0 ? "NULL" : "name" + to_string(static_cast<long long>(i)));
+		batch.push_back(r);
+	}
+	t.insert_batch(batch);
+	BOOST_REQUIRE(t.size() == 201);
+	BOOST_CHECK(t.at(0).get<string>("name") == "seven");
+	BOOST_CHECK(t.at(200).get<int>("ID") == 299);
+	BOOST_CHECK(t.count("name") == 1 + 133);
+	vector<string> key;
+	key.push_back("150");
+	BOOST_CHECK(t.find(key)->get<string>("name") == "name50");
+
+	// Every conflict is reported, and nothing is inserted
+	vector<Record> conflicting;
+	for (int id = 0; id < 6; ++id) {
+		Record r;
+		r.set("ID", to_string(static_cast<long long>(id == 2 ? 7 : (id == 4 ? 1 : (id == 5 ? 120 : id)))));
+		r.set("name", "x");
+		conflicting.push_back(r);
+	}
+	try {
+		t.insert_batch(conflicting);
+		BOOST_ERROR("insert_batch should have thrown");
+	} catch (const KeyConflictError& e) {
+		vector<unsigned> expected;
+		expected.push_back(2);
+		expected.push_back(4);
+		expected.push_back(5);
+		BOOST_CHECK(e.records() == expected);
+	}
+	BOOST_CHECK(t.size() == 201);
+	key[0] = "0";
+	BOOST_CHECK(t.find(key) == t.end());
+
+	// A bad value takes the whole batch out again, keys included
+	vector<Record> bad;
+	for (int id = 1000; id < 1003; ++id) {
+		Record r;
+		r.set("ID", to_string(static_cast<long long>(id)));
+		r.set("name", "x");
+		bad.push_back(r);
+	}
+	bad[2].set("ID", "not a number");
+	BOOST_CHECK_THROW(t.insert_batch(bad), InvalidTypeError);
+	BOOST_CHECK(t.size() == 201);
+	bad.pop_back();
+	t.insert_batch(bad);
+	BOOST_CHECK(t.size() == 203);
+
+	Record wrong;
+	wrong.set("other", "1");
+	BOOST_CHECK_THROW(t.insert_batch(vector<Record>(1, wrong)), ColumnDoesNotExistError);
+
+	// Also outside the key, after earlier columns were filled
+	Table plain;
+	plain.add_column("name", Table::varchar);
+	plain.add_column("n", Table::integer);
+	vector<Record> rows(100);
+	for (int i = 0; i < 100; ++i) {
+		rows[i].set("name", "row");
+		rows[i].set("n", i == 70 ? "seventy" : "1");
+	}
+	BOOST_CHECK_THROW(plain.insert_batch(rows), InvalidTypeError);
+	BOOST_CHECK(plain.size() == 0);
+	BOOST_CHECK(plain.count("name") == 0);
+}
+
+//FIND TESTS
+BOOST_AUTO_TEST_CASE(find_by_key)
+{
+	Table t;
+	t.add_column("ID", Table::integer);
+	t.add_column("name", Table::varchar);
+	vector<string> names;
+	names.push_back("ID");
+	t.set_key(names);
+	for (int i = 0; i < 3; ++i) {
+		vector<pair<string, string> > v;
+		v.push_back(make_pair("ID", to_string(static_cast<long long>(i))));
+		v.push_back(make_pair("name", "name" + to_string(static_cast<long long>(i))));
+		t.insert(Record(v));
+	}
+	vector<string> key;
+	key.push_back("2");
+	BOOST_CHECK(t.find(key)->get<string>("name") == "name2");
+	key[0] = "5";
+	BOOST_CHECK(t.find(key) == t.end());
+	key.push_back("extra");
+	BOOST_CHECK_THROW(t.find(key), InvalidOperationError);
+}
+
+BOOST_AUTO_TEST_CASE(find_after_drop_and_update)
+{
+	Table t;
+	t.add_column("ID", Table::integer);
+	t.add_column("aaaa", Table::integer);
+	vector<string> names;
+	names.push_back("ID");
+	t.set_key(names);
+	for (int i = 0; i < 4; ++i) {
+		vector<pair<string, string> > v;
+		v.push_back(make_pair("ID", to_string(static_cast<long long>(i))));
+		v.push_back(make_pair("aaaa", to_string(static_cast<long long>(i))));
+		t.insert(Record(v));
+	}
+	t.drop_where("ID = 1");
+	vector<string> key;
+	key.push_back("3");
+	BOOST_CHECK(t.find(key)->get<int>("aaaa") == 3);
+
+	// Rows swapping keys do not conflict, but taking an existing key does
+	t.update("ID = 3", "ID = 1");
+	key[0] = "1";
+	BOOST_CHECK(t.find(key)->get<int>("aaaa") == 3);
+	BOOST_CHECK_THROW(t.update("ID = 0", "ID = 2"), KeyConflictError);
+	key[0] = "0";
+	BOOST_CHECK(t.find(key) != t.end());
+
+	vector<pair<string, string> > v;
+	v.push_back(make_pair("ID", "3"));
+	v.push_back(make_pair("aaaa", "5"));
+	t.insert(Record(v));
+	BOOST_CHECK(t.size() == 4);
+}
+
+BOOST_AUTO_TEST_CASE(update_bad_value)
+{
+	Table t;
+	t.add_column("ID", Table::integer);
+	t.add_column("name", Table::varchar);
+	t.add_column("n", Table::integer);
+	vector<string> names;
+	names.push_back("ID");
+	t.set_key(names);
+	for (int i = 0; i < 3; ++i) {
+		vector<pair<string, string> > v;
+		v.push_back(make_pair("ID", to_string(static_cast<long long>(i))));
+		v.push_back(make_pair("name", "row"));
+		v.push_back(make_pair("n", "1"));
+		t.insert(Record(v));
+	}
+
+	// A value of the wrong type leaves every row and the key index alone
+	BOOST_CHECK_THROW(t.update("ID >= 0", "name = 'zzz', n = 'abc'"), InvalidTypeError);
+	BOOST_CHECK(t.at(0).get<string>("name") == "row");
+	BOOST_CHECK_THROW(t.update("ID = 0", "ID = 9, n = 'abc'"), InvalidTypeError);
+	BOOST_CHECK(t.at(0).get<int>("ID") == 0);
+	vector<string> key;
+	key.push_back("0");
+	BOOST_CHECK(t.find(key) != t.end());
+	key[0] = "9";
+	BOOST_CHECK(t.find(key) == t.end());
+}
+
+//PROJECT TESTS
+BOOST_AUTO_TEST_CASE(project_rows_and_columns)
+{
+	Table t;
+	t.add_column("ID", Table::integer);
+	t.add_column("aaaa", Table::varchar);
+	t.add_column("bbbb", Table::floating);
+	vector<string> names;
+	names.push_back("ID");
+	t.set_key(names);
+	for (int i = 0; i < 5; ++i) {
+		vector<pair<string, string> > v;
+		v.push_back(make_pair("ID", to_string(static_cast<long long>(i))));
+		v.push_back(make_pair("aaaa", "row" + to_string(static_cast<long long>(i))));
+		v.push_back(make_pair("bbbb", "1.5"));
+		t.insert(Record(v));
+	}
+	vector<unsigned> rows;
+	rows.push_back(3);
+	rows.push_back(1);
+	vector<string> columns;
+	columns.push_back("bbbb");
+	columns.push_back("ID");
+	Table* p = t.project(columns, rows);
+	BOOST_CHECK(p->size() == 2);
+	BOOST_CHECK(p->columns().size() == 2);
+	BOOST_CHECK(p->columns()[0].first == "bbbb");
+	BOOST_CHECK(p->at(0).get<int>("ID") == 3);
+	BOOST_CHECK(p->key() == names);
+	delete p;
+
+	// Without all of its columns the key is dropped
+	columns.pop_back();
+	p = t.project(columns, rows);
+	BOOST_CHECK(p->key().empty());
+	delete p;
+
+	columns.push_back("cccc");
+	BOOST_CHECK_THROW(t.project(columns, rows), ColumnDoesNotExistError);
+	columns.pop_back();
+	rows.push_back(5);
+	BOOST_CHECK_THROW(t.project(columns, rows), RowDoesNotExistError);
+}
+
 //BEGIN TESTS
 BOOST_AUTO_TEST_CASE(begin_test)
 {
@@ -503,6 +718,33 @@ BOOST_AUTO_TEST_CASE(end_test)
 	// BOOST_CHECK(test.get<int>("bbbb") == 2);
 }
 
+//ITERATOR TESTS
+BOOST_AUTO_TEST_CASE(iterate_all_rows)
+{
+	Table t;
+	t.add_column("ID", Table::integer);
+	t.add_column("name", Table::varchar);
+	t.add_column("born", Table::date);
+	const char* ids[] = { "0", "1", "2" };
+	const char* names[] = { "Pam", "George", "Linda" };
+	const char* dates[] = { "1948/09/26", "1979/10/18", "1954/02/21" };
+	for (int i = 0; i < 3; i++) {
+		Record r;
+		r.set("ID", ids[i]);
+		r.set("name", names[i]);
+		r.set("born", dates[i]);
+		t.insert(r);
+	}
+	int i = 0;
+	for (Table::TableIterator it = t.begin(); it != t.end(); it++, i++) {
+		BOOST_CHECK(it->get<int>("ID") == i);
+		BOOST_CHECK((*it).get<string>("name") == names[i]);
+		BOOST_CHECK(t.at(i).get<string>("born") == dates[i]);
+	}
+	BOOST_CHECK(i == 3);
+	BOOST_CHECK(t.last().get<string>("name") == "Linda");
+}
+
 //FIRST TESTS
 BOOST_AUTO_TEST_CASE(first_test)
 {
@@ -711,6 +953,70 @@ BOOST_AUTO_TEST_CASE(count_test_exception)
 	BOOST_CHECK_THROW(t.count("blah"), ColumnDoesNotExistError);
 }
 
+BOOST_AUTO_TEST_CASE(count_test_null_bitmap)
+{
+	// NULL, "?" and empty strings over several words of the validity bitmap
+	Table t;
+	t.add_column("ID", Table::integer);
+	t.add_column("aaaa", Table::floating);
+	t.add_column("name", Table::varchar);
+	for (int i = 0; i < 150; ++i) {
+		Record r;
+		r.set("ID", to_string(static_cast<long long>(i)));
+		r.set("aaaa", i % 3 == 0 ? "?" : (i % 3 == 1 ? "NULL" : "1.5"));
+		r.set("name", i % 5 == 0 ? "?" : (i % 5 == 1 ? "" : "n"));
+		t.insert(r);
+	}
+	BOOST_CHECK(t.count("ID") == 150);
+	BOOST_CHECK(t.count("aaaa") == 50);
+	// An empty varchar is a value, not NULL
+	BOOST_CHECK(t.count("name") == 120);
+	BOOST_CHECK(t.at(0).is_null("aaaa"));
+	BOOST_CHECK(!t.at(2).is_null("aaaa"));
+	BOOST_CHECK(t.at(0).is_null("name"));
+	BOOST_CHECK(!t.at(1).is_null("name"));
+	BOOST_CHECK_THROW(t.at(0).is_null("blah"), ColumnDoesNotExistError);
+
+	// Updates and drops carry the bits along with the values
+	t.update("ID = 2", "aaaa = '?'");
+	BOOST_CHECK(t.count("aaaa") == 49);
+	t.update("ID = 3", "aaaa = 2.5");
+	BOOST_CHECK(t.count("aaaa") == 50);
+	t.drop_where("ID < 100");
+	BOOST_CHECK(t.size() == 50);
+	BOOST_CHECK(t.count("aaaa") == 17);
+	BOOST_CHECK_CLOSE(t.sum<float>("aaaa"), 25.5, TOL);
+	BOOST_CHECK(t.at(0).is_null("aaaa"));
+	BOOST_CHECK(!t.at(1).is_null("aaaa"));
+
+	// Comparisons never match NULLs, so only the 1.5s go
+	t.drop_where("aaaa < 2");
+	BOOST_CHECK(t.size() == 33);
+	BOOST_CHECK(t.count("aaaa") == 0);
+
+	t.add_column("bbbb", Table::integer);
+	BOOST_CHECK(t.count("bbbb") == 0);
+	BOOST_CHECK(t.at(32).is_null("bbbb"));
+}
+
+BOOST_AUTO_TEST_CASE(insert_type_exception)
+{
+	Table t;
+	t.add_column("ID", Table::integer);
+	t.add_column("born", Table::date);
+	Record r1;
+	r1.set("ID", "one");
+	r1.set("born", "2013/01/01");
+	BOOST_CHECK_THROW(t.insert(r1), InvalidTypeError);
+	Record r2;
+	r2.set("ID", "1");
+	r2.set("born", "yesterday");
+	BOOST_CHECK_THROW(t.insert(r2), InvalidTypeError);
+	// a failed insert must not leave part of the row behind
+	BOOST_CHECK(t.size() == 0);
+	BOOST_CHECK(t.count("ID") == 0);
+}
+
 //SUM TESTS
 BOOST_AUTO_TEST_CASE(sum_works)
 {
@@ -858,6 +1164,30 @@ BOOST_AUTO_TEST_CASE(min_works)
 	BOOST_CHECK(t.min<string>("time") == "04:20:01");
 }
 
+BOOST_AUTO_TEST_CASE(min_max_all_nan)
+{
+	// NaN is never the smallest or largest value the fast path looks for, so
+	// a column of nothing else has to be compared row by row
+	Table t;
+	t.add_column("float", Table::floating);
+	for (int i = 0; i < 5; ++i) {
+		Record r;
+		r.set("float", "nan");
+		t.insert(r);
+	}
+	float low = t.min<float>("float");
+	float high = t.max<float>("float");
+	BOOST_CHECK(low != low);
+	BOOST_CHECK(high != high);
+
+	vector<Aggregate> aggregates;
+	aggregates.push_back(Aggregate(Aggregate::min, "float"));
+	aggregates.push_back(Aggregate(Aggregate::max, "float"));
+	Table g = t.group_by(vector<string>(), aggregates);
+	BOOST_REQUIRE(g.size() == 1);
+	BOOST_CHECK(g.at(0).get<string>("min(float)") == t.at(0).get<string>("float"));
+}
+
 BOOST_AUTO_TEST_CASE(min_column_exception)
 {
 	Table t;
@@ -959,3 +1289,225 @@ BOOST_AUTO_TEST_CASE(max_type_exception)
 	t.add_column("time", Table::time);
 	BOOST_CHECK_THROW(t.min<char>("date"), InvalidTypeError);
 }
+
+//GROUP_BY TESTS
+BOOST_AUTO_TEST_CASE(group_by_works)
+{
+	Table t;
+	t.add_column("placeID", Table::integer);
+	t.add_column("rating", Table::integer);
+	t.add_column("score", Table::floating);
+	t.add_column("name", Table::varchar);
+	const char* rows[][4] = {
+		{"7", "2", "1.5", "b"},
+		{"3", "1", "0.5", "x"},
+		{"7", "NULL", "2.5", "a"},
+		{"NULL", "4", "NULL", "c"},
+		{"3", "3", "3.5", "y"},
+		{"7", "0", "0.5", "a"}
+	};
+	for (int i = 0; i < 6; ++i) {
+		Record r;
+		r.set("placeID", rows[i][0]);
+		r.set("rating", rows[i][1]);
+		r.set("score", rows[i][2]);
+		r.set("name", rows[i][3]);
+		t.insert(r);
+	}
+
+	vector<string> keys;
+	keys.push_back("placeID");
+	vector<Aggregate> aggregates;
+	aggregates.push_back(Aggregate(Aggregate::count, "*"));
+	aggregates.push_back(Aggregate(Aggregate::count, "rating"));
+	aggregates.push_back(Aggregate(Aggregate::sum, "rating"));
+	aggregates.push_back(Aggregate(Aggregate::avg, "rating", "average"));
+	aggregates.push_back(Aggregate(Aggregate::min, "name"));
+	aggregates.push_back(Aggregate(Aggregate::max, "score"));
+	Table g = t.group_by(keys, aggregates);
+
+	// Groups come in the order they first appear; NULL is a group too
+	BOOST_CHECK(g.size() == 3);
+	BOOST_CHECK(g.columns().size() == 7);
+	BOOST_CHECK(g.key() == keys);
+	BOOST_CHECK(g.columns()[4].first == "average");
+	BOOST_CHECK(g.columns()[4].second == Table::floating);
+	Record seven = g.at(0);
+	BOOST_CHECK(seven.get<int>("placeID") == 7);
+	BOOST_CHECK(seven.get<int>("count(*)") == 3);
+	BOOST_CHECK(seven.get<int>("count(rating)") == 2);
+	BOOST_CHECK(seven.get<int>("sum(rating)") == 2);
+	BOOST_CHECK_CLOSE(seven.get<float>("average"), 1.0, TOL);
+	BOOST_CHECK(seven.get<string>("min(name)") == "a");
+	BOOST_CHECK_CLOSE(seven.get<float>("max(score)"), 2.5, TOL);
+	Record three = g.at(1);
+	BOOST_CHECK(three.get<int>("placeID") == 3);
+	BOOST_CHECK(three.get<int>("sum(rating)") == 4);
+	BOOST_CHECK_CLOSE(three.get<float>("average"), 2.0, TOL);
+	BOOST_CHECK(three.get<string>("min(name)") == "x");
+	Record none = g.at(2);
+	BOOST_CHECK(none.get<string>("placeID") == "");
+	BOOST_CHECK(none.get<int>("count(*)") == 1);
+	BOOST_CHECK(none.get<string>("max(score)") == "");
+
+	// No key columns: the whole table is one group, even when it is empty
+	vector<string> no_keys;
+	Table all = t.group_by(no_keys, aggregates);
+	BOOST_CHECK(all.size() == 1);
+	BOOST_CHECK(all.at(0).get<int>("count(*)") == 6);
+	BOOST_CHECK(all.at(0).get<int>("sum(rating)") == 10);
+	Table empty_table(t.columns());
+	Table empty = empty_table.group_by(no_keys, aggregates);
+	BOOST_CHECK(empty.size() == 1);
+	BOOST_CHECK(empty.at(0).get<int>("count(*)") == 0);
+	BOOST_CHECK(empty.at(0).get<string>("sum(rating)") == "");
+}
+
+BOOST_AUTO_TEST_CASE(group_by_many_morsels)
+{
+	Table t;
+	t.add_column("group", Table::integer);
+	t.add_column("value", Table::integer);
+	unsigned rows = 2 * ThreadPool::morsel_size + 5;
+	for (unsigned i = 0; i < rows; ++i) {
+		Record r;
+		r.set("group", to_string(static_cast<long long>((i * 31) % 100)));
+		r.set("value", to_string(static_cast<long long>(i % 10)));
+		t.insert(r);
+	}
+	vector<string> keys;
+	keys.push_back("group");
+	vector<Aggregate> aggregates;
+	aggregates.push_back(Aggregate(Aggregate::count, "value"));
+	aggregates.push_back(Aggregate(Aggregate::sum, "value"));
+	aggregates.push_back(Aggregate(Aggregate::max, "value"));
+	Table g = t.group_by(keys, aggregates);
+
+	vector<int> counts(100, 0), sums(100, 0), maxes(100, 0);
+	for (unsigned i = 0; i < rows; ++i) {
+		++counts[(i * 31) % 100];
+		sums[(i * 31) % 100] += i % 10;
+		maxes[(i * 31) % 100] = max(maxes[(i * 31) % 100], static_cast<int>(i % 10));
+	}
+	BOOST_CHECK(g.size() == 100);
+	BOOST_CHECK(g.at(1).get<int>("group") == 31);
+	bool same = true;
+	for (int i = 0; i < g.size(); ++i) {
+		Record r = g.at(i);
+		int group = r.get<int>("group");
+		if (r.get<int>("count(value)") != counts[group] || r.get<int>("sum(value)") != sums[group] ||
+		    r.get<int>("max(value)") != maxes[group])
+			same = false;
+	}
+	BOOST_CHECK(same);
+}
+
+BOOST_AUTO_TEST_CASE(group_by_exceptions)
+{
+	Table t;
+	t.add_column("ID", Table::integer);
+	t.add_column("vchar", Table::varchar);
+	vector<string> keys;
+	keys.push_back("ID");
+	vector<Aggregate> aggregates;
+	aggregates.push_back(Aggregate(Aggregate::sum, "vchar"));
+	BOOST_CHECK_THROW(t.group_by(keys, aggregates), InvalidOperationError);
+	aggregates[0] = Aggregate(Aggregate::min, "nothing");
+	BOOST_CHECK_THROW(t.group_by(keys, aggregates), ColumnDoesNotExistError);
+	aggregates[0] = Aggregate(Aggregate::count, "vchar", "ID");
+	BOOST_CHECK_THROW(t.group_by(keys, aggregates), InvalidOperationError);
+	keys.push_back("missing");
+	aggregates.clear();
+	BOOST_CHECK_THROW(t.group_by(keys, aggregates), ColumnDoesNotExistError);
+}
+
+//AGGREGATE TESTS
+BOOST_AUTO_TEST_CASE(aggregate_matches_separate_calls)
+{
+	Table t;
+	t.add_column("ID", Table::integer);
+	t.add_column("float", Table::floating);
+	t.add_column("date", Table::date);
+	for (int i = 0; i < 50; ++i) {
+		Record r;
+		r.set("ID", i % 9 == 0 ? "NULL" : to_string(static_cast<long long>(i * 3 - 40)));
+		r.set("float", to_string(static_cast<long long>(i)) + ".25");
+		r.set("date", "2013/02/" + string(i % 28 < 9 ? "0" : "") + to_string(static_cast<long long>(i % 28 + 1)));
+		t.insert(r);
+	}
+
+	vector<Aggregate> aggregates;
+	aggregates.push_back(Aggregate(Aggregate::count, "ID"));
+	aggregates.push_back(Aggregate(Aggregate::sum, "ID"));
+	aggregates.push_back(Aggregate(Aggregate::min, "ID"));
+	aggregates.push_back(Aggregate(Aggregate::max, "ID"));
+	aggregates.push_back(Aggregate(Aggregate::avg, "float"));
+	aggregates.push_back(Aggregate(Aggregate::max, "date", "last"));
+	Record result = t.aggregate(aggregates);
+
+	BOOST_CHECK(result.size() == 6);
+	BOOST_CHECK(result.get<int>("count(ID)") == t.count("ID"));
+	BOOST_CHECK(result.get<int>("sum(ID)") == t.sum<int>("ID"));
+	BOOST_CHECK(result.get<int>("min(ID)") == t.min<int>("ID"));
+	BOOST_CHECK(result.get<int>("max(ID)") == t.max<int>("ID"));
+	BOOST_CHECK_CLOSE(result.get<float>("avg(float)"), 24.75, TOL);
+	BOOST_CHECK(result.get<string>("last") == t.max<string>("date"));
+}
+
+BOOST_AUTO_TEST_CASE(aggregate_kernels_match_row_by_row)
+{
+	Table t;
+	t.add_column("ID", Table::integer);
+	t.add_column("tenth", Table::floating);
+	t.add_column("float", Table::floating);
+	t.add_column("date", Table::date);
+	// Several morsels, and a tail shorter than a vector
+	unsigned rows = 2 * ThreadPool::morsel_size + 13;
+	long long int_sum = 0;
+	int int_count = 0, int_min = 0, int_max = 0;
+	float float_min = 0, float_max = 0;
+	for (unsigned i = 0; i < rows; ++i) {
+		Record r;
+		int id = static_cast<int>(i * 7919 % 20001) - 10000;
+		if (i % 11 == 0) {
+			r.set("ID", "NULL");
+		} else {
+			r.set("ID", to_string(static_cast<long long>(id)));
+			int_min = int_count == 0 ? id : min(int_min, id);
+			int_max = int_count == 0 ? id : max(int_max, id);
+			int_sum += id;
+			++int_count;
+		}
+		r.set("tenth", i % 13 == 0 ? "NULL" : "0.1");
+		float value = static_cast<float>(i * 37 % 1001) / 4 - 100;
+		r.set("float", to_string(static_cast<long double>(value)));
+		float_min = i == 0 ? value : min(float_min, value);
+		float_max = i == 0 ? value : max(float_max, value);
+		r.set("date", "2013/0" + to_string(static_cast<long long>(i % 9 + 1)) + "/1" + to_string(static_cast<long long>(i % 7)));
+		t.insert(r);
+	}
+	unsigned tenths = rows - (rows - 1) / 13 - 1;
+
+	BOOST_CHECK(t.count("ID") == int_count);
+	BOOST_CHECK(t.sum<long long>("ID") == int_sum);
+	BOOST_CHECK(t.min<int>("ID") == int_min);
+	BOOST_CHECK(t.max<int>("ID") == int_max);
+	BOOST_CHECK(t.count("tenth") == tenths);
+	// Adding 0.1f one at a time in float precision drifts far past this tolerance
+	BOOST_CHECK_CLOSE(t.sum<double>("tenth"), tenths * static_cast<double>(0.1f), 1e-9);
+	BOOST_CHECK_CLOSE(t.min<float>("float"), float_min, TOL);
+	BOOST_CHECK_CLOSE(t.max<float>("float"), float_max, TOL);
+	BOOST_CHECK(t.min<string>("date") == "2013/01/10");
+	BOOST_CHECK(t.max<string>("date") == "2013/09/16");
+
+	vector<Aggregate> aggregates;
+	aggregates.push_back(Aggregate(Aggregate::count, "*"));
+	aggregates.push_back(Aggregate(Aggregate::avg, "ID"));
+	aggregates.push_back(Aggregate(Aggregate::min, "float"));
+	aggregates.push_back(Aggregate(Aggregate::max, "date"));
+	Record result = t.aggregate(aggregates);
+	BOOST_CHECK(result.get<int>("count(*)") == rows);
+	BOOST_CHECK_CLOSE(result.get<double>("avg(ID)"), static_cast<double>(int_sum) / int_count, TOL);
+	BOOST_CHECK_CLOSE(result.get<float>("min(float)"), float_min, TOL);
+	BOOST_CHECK(result.get<string>("max(date)") == "2013/09/16");
+}
@@ -0,0 +1,108 @@
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <stdexcept>
+#include "database.h"
+#include "thread_pool.h"
+
+BOOST_AUTO_TEST_SUITE(thread_pool_test)
+BOOST_AUTO_TEST_CASE(parallel_for_covers_range)
+{
+	ThreadPool pool(4);
+	BOOST_CHECK(pool.size() == 4);
+
+	// Every row is visited once, by the morsel it belongs to
+	unsigned begin = 5, end = 5 + 3 * ThreadPool::morsel_size + 17;
+	BOOST_CHECK(ThreadPool::morsel_count(begin, end) == 4);
+	vector<int> visits(end, 0);
+	vector<int> morsels(4, 0);
+	vector<unsigned> begins(4, 0);
+	pool.parallel_for(begin, end, [&](unsigned morsel, unsigned morsel_begin, unsigned morsel_end) {
+		++morsels[morsel];
+		begins[morsel] = morsel_begin;
+		for (unsigned row = morsel_begin; row < morsel_end; ++row)
+			++visits[row];
+	});
+	for (unsigned row = 0; row < end; ++row)
+		BOOST_CHECK(visits[row] == (row < begin ? 0 : 1));
+	for (unsigned i = 0; i < morsels.size(); ++i) {
+		BOOST_CHECK(morsels[i] == 1);
+		BOOST_CHECK(begins[i] == begin + i * ThreadPool::morsel_size);
+	}
+
+	// Empty ranges don't call the body
+	int calls = 0;
+	pool.parallel_for(7, 7, [&](unsigned, unsigned, unsigned) {
+		++calls;
+	});
+	BOOST_CHECK(calls == 0);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_for_exceptions_and_nesting)
+{
+	ThreadPool pool(3);
+	unsigned end = 10 * ThreadPool::morsel_size;
+	BOOST_CHECK_THROW(pool.parallel_for(0, end, [&](unsigned morsel, unsigned, unsigned) {
+		if (morsel == 2)
+			throw InvalidOperationError("morsel 2");
+	}), InvalidOperationError);
+
+	// The pool still works afterwards, and a loop inside a loop runs inline
+	vector<int> inner(10, 0);
+	pool.parallel_for(0, end, [&](unsigned morsel, unsigned, unsigned) {
+		int count = 0;
+		pool.parallel_for(0, 2 * ThreadPool::morsel_size, [&](unsigned, unsigned, unsigned) {
+			++count;
+		});
+		inner[morsel] = count;
+	});
+	for (unsigned i = 0; i < inner.size(); ++i)
+		BOOST_CHECK(inner[i] == 2);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_scans_match_serial_results)
+{
+	// Enough rows for several morsels; every seventh value is NULL
+	Database d;
+	Table* t = new Table();
+	t->add_column("id", Table::integer);
+	t->add_column("value", Table::integer);
+	unsigned rows = 5 * ThreadPool::morsel_size + 123;
+	for (unsigned i = 0; i < rows; ++i) {
+		Record r;
+		r.set("id", to_string(static_cast<long long>(i)));
+		r.set("value", i % 7 == 0 ? "NULL" : to_string(static_cast<long long>(i % 1000)));
+		t->insert(r);
+	}
+	d.add_table("t", t);
+
+	int count = 0, matches = 0, kept = 0;
+	long long sum = 0;
+	for (unsigned i = 0; i < rows; ++i) {
+		if (i % 7 != 0) {
+			++count;
+			sum += i % 1000;
+			if (i % 1000 == 500)
+				++matches;
+			if (i % 1000 >= 500)
+				++kept;
+		} else {
+			++kept;
+		}
+	}
+	BOOST_CHECK(t->count("value") == count);
+	BOOST_CHECK(t->sum<long long>("value") == sum);
+	BOOST_CHECK(t->min<int>("value") == 0);
+	BOOST_CHECK(t->max<int>("value") == 999);
+
+	// Matches come back in row order
+	Table* result = d.query("id", "t", "value = 500");
+	BOOST_CHECK(result->size() == matches);
+	for (int i = 1; i < result->size(); ++i)
+		BOOST_CHECK(result->at(i - 1).get<int>("id") < result->at(i).get<int>("id"));
+	delete result;
+
+	// NULLs are never less than 500, so they stay
+	d.delete_from("t", "value < 500");
+	BOOST_CHECK(d.table("t")->size() == kept);
+}
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,179 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned threads) {
+  body_ = NULL;
+  begin_ = end_ = grain_ = 0;
+  generation_ = 0;
+  busy_ = 0;
+  stopping_ = false;
+  failed_ = false;
+  running_ = false;
+
+  if (threads == 0)
+    threads = 1;
+  for (unsigned i = 0; i < threads; ++i)
+    queues_.push_back(new Queue);
+  for (unsigned i = 0; i + 1 < threads; ++i)
+    workers_.push_back(thread(&ThreadPool::work, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(state_lock_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (unsigned i = 0; i < workers_.size(); ++i)
+    workers_[i].join();
+  for (unsigned i = 0; i < queues_.size(); ++i)
+    delete queues_[i];
+}
+
+static mutex instance_lock;
+static ThreadPool* shared_pool = NULL;
+
+ThreadPool& ThreadPool::instance() {
+  // Never destroyed: joining threads while the library is being unloaded
+  // can deadlock
+  lock_guard<mutex> lock(instance_lock);
+  if (!shared_pool)
+    shared_pool = new ThreadPool(thread::hardware_concurrency());
+  return *shared_pool;
+}
+
+unsigned ThreadPool::size() const {
+  return queues_.size();
+}
+
+unsigned ThreadPool::morsel_count(unsigned begin, unsigned end, unsigned grain) {
+  if (end <= begin)
+    return 0;
+  return (end - begin - 1) / grain + 1;
+}
+
+void ThreadPool::parallel_for(unsigned begin, unsigned end,
+                              const function<void (unsigned, unsigned, unsigned)>& body) {
+  parallel_for(begin, end, morsel_size, body);
+}
+
+void ThreadPool::parallel_for(unsigned begin, unsigned end, unsigned grain,
+                              const function<void (unsigned, unsigned, unsigned)>& body) {
+  unsigned morsels = morsel_count(begin, end, grain);
+  bool idle = false;
+  if (morsels <= 1 || workers_.empty() || !running_.compare_exchange_strong(idle, true)) {
+    for (unsigned morsel = 0; morsel < morsels; ++morsel) {
+      unsigned morsel_begin = begin + morsel * grain;
+      body(morsel, morsel_begin, end - morsel_begin < grain ? end : morsel_begin + grain);
+    }
+    return;
+  }
+  // Clears running_ however the loop ends
+  struct Finished {
+    atomic<bool>& running;
+    ~Finished() { running = false; }
+  } finished = { running_ };
+
+  // Give each thread a contiguous share, so neighbouring morsels tend to run
+  // on the same core
+  unsigned queues = queues_.size();
+  for (unsigned q = 0; q < queues; ++q) {
+    lock_guard<mutex> lock(queues_[q]->lock);
+    for (unsigned morsel = morsels * q / queues; morsel < morsels * (q + 1) / queues; ++morsel)
+      queues_[q]->morsels.push_back(morsel);
+  }
+
+  {
+    lock_guard<mutex> lock(state_lock_);
+    body_ = &body;
+    begin_ = begin;
+    end_ = end;
+    grain_ = grain;
+    failed_ = false;
+    error_ = exception_ptr();
+    busy_ = workers_.size();
+    ++generation_;
+  }
+  wake_.notify_all();
+
+  run_morsels(queues - 1);
+
+  exception_ptr error;
+  {
+    unique_lock<mutex> lock(state_lock_);
+    while (busy_ != 0)
+      done_.wait(lock);
+    body_ = NULL;
+    error = error_;
+  }
+  if (error)
+    rethrow_exception(error);
+}
+
+void ThreadPool::work(unsigned queue) {
+  unsigned seen = 0;
+  while (true) {
+    {
+      unique_lock<mutex> lock(state_lock_);
+      while (!stopping_ && generation_ == seen)
+        wake_.wait(lock);
+      if (stopping_)
+        return;
+      seen = generation_;
+    }
+
+    run_morsels(queue);
+
+    {
+      lock_guard<mutex> lock(state_lock_);
+      --busy_;
+    }
+    done_.notify_one();
+  }
+}
+
+void ThreadPool::run_morsels(unsigned queue) {
+  unsigned morsel;
+  while (next_morsel(queue, morsel)) {
+    {
+      lock_guard<mutex> lock(state_lock_);
+      if (failed_)
+        continue;  // drain the queues without running anything
+    }
+    unsigned morsel_begin = begin_ + morsel * grain_;
+    unsigned morsel_end = end_ - morsel_begin < grain_ ? end_ : morsel_begin + grain_;
+    try {
+      (*body_)(morsel, morsel_begin, morsel_end);
+    } catch (...) {
+      lock_guard<mutex> lock(state_lock_);
+      if (!failed_) {
+        failed_ = true;
+        error_ = current_exception();
+      }
+    }
+  }
+}
+
+// Takes the next morsel from the front of the thread's own queue, or else
+// steals one from the back of another thread's queue
+bool ThreadPool::next_morsel(unsigned queue, unsigned& morsel) {
+  {
+    lock_guard<mutex> lock(queues_[queue]->lock);
+    if (!queues_[queue]->morsels.empty()) {
+      morsel = queues_[queue]->morsels.front();
+      queues_[queue]->morsels.pop_front();
+      return true;
+    }
+  }
+
+  unsigned queues = queues_.size();
+  for (unsigned i = 1; i < queues; ++i) {
+    Queue& victim = *queues_[(queue + i) % queues];
+    lock_guard<mutex> lock(victim.lock);
+    if (!victim.morsels.empty()) {
+      morsel = victim.morsels.back();
+      victim.morsels.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,106 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+#pragma warning(disable: 4251)
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+using namespace std;
+
+#include "exception.h"
+
+/**
+ * A fixed set of worker threads for scanning tables in parallel.
+ *
+ * parallel_for() splits a range of rows into morsels of \a morsel_size rows.
+ * Each thread starts with its own contiguous share of the morsels and takes
+ * them from the front of its queue; a thread that runs out steals from the
+ * back of another's, so a slow morsel doesn't hold up the rest. The calling
+ * thread takes part as well.
+ *
+ * The body is told the number of each morsel, so results can be stored per
+ * morsel and merged in morsel order afterwards. That keeps results (and the
+ * order of rows in them) the same however the morsels were scheduled.
+ *
+ * Only one loop runs on a pool at a time. A parallel_for() called while
+ * another is running, e.g. from inside a body, runs on the calling thread.
+ */
+class EXPORT ThreadPool {
+public:
+  /** The number of rows in a morsel. A multiple of WhereMatcher::batch_size. */
+  static const unsigned morsel_size = 16 * 1024;
+
+  /** Creates a pool of \a threads threads, counting the calling thread. */
+  explicit ThreadPool(unsigned threads);
+
+  ~ThreadPool();
+
+  /** Returns a pool shared by all tables, with one thread per core. */
+  static ThreadPool& instance();
+
+  /** Returns the number of threads, counting the calling thread. */
+  unsigned size() const;
+
+  /** Returns the number of morsels of \a grain rows in [\a begin, \a end). */
+  static unsigned morsel_count(unsigned begin, unsigned end, unsigned grain = morsel_size);
+
+  /**
+   * Calls \a body(morsel, morsel_begin, morsel_end) for each morsel of
+   * [\a begin, \a end), and returns once all of them are done. Calls may run
+   * at the same time on different threads, in any order. Ranges of a single
+   * morsel run on the calling thread.
+   *
+   * If \a body throws, morsels that haven't started are skipped and the first
+   * exception is thrown again on the calling thread.
+   */
+  void parallel_for(unsigned begin, unsigned end,
+                    const function<void (unsigned, unsigned, unsigned)>& body);
+
+  /**
+   * Like parallel_for() above, with morsels of \a grain items instead of
+   * \a morsel_size rows. A grain of 1 runs each item as its own task.
+   */
+  void parallel_for(unsigned begin, unsigned end, unsigned grain,
+                    const function<void (unsigned, unsigned, unsigned)>& body);
+
+private:
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+
+  // Morsels waiting to run on one thread
+  struct Queue {
+    mutex lock;
+    deque<unsigned> morsels;
+  };
+
+  void work(unsigned queue);
+  void run_morsels(unsigned queue);
+  bool next_morsel(unsigned queue, unsigned& morsel);
+
+  vector<thread> workers_;
+  // One queue per worker, then one for the calling thread
+  vector<Queue*> queues_;
+
+  // Set for the whole of a parallel_for() that runs on the workers. A flag
+  // rather than a mutex, since a nested call comes from the thread that set it.
+  atomic<bool> running_;
+
+  // The current job, guarded by state_lock_
+  mutex state_lock_;
+  condition_variable wake_;
+  condition_variable done_;
+  const function<void (unsigned, unsigned, unsigned)>* body_;
+  unsigned begin_, end_, grain_;
+  unsigned generation_;
+  unsigned busy_;
+  bool stopping_;
+  bool failed_;
+  exception_ptr error_;
+};
+
+#endif  // THREAD_POOL_H_
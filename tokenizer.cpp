@@ -13,7 +13,6 @@ Tokenizer::Tokenizer(TokenizerType type, string source) {
 vector<Token> Tokenizer::tokenize() {
   while (stream_.size() > 0) {
     char c = stream_get();
-    char second;
     switch (c) {
       // parenthesis_left
       case '(':
@@ -25,43 +24,6 @@ vector<Token> Tokenizer::tokenize() {
         tokens_.push_back( Token(parenthesis_right, ")") );
         break;
 
-      // bool_or
-      case 'O':
-        c = stream_get();
-        if (c == 'R') {
-          tokens_.push_back( Token(bool_or, "OR") );
-          break;
-        } else {
-          stream_unget(c);
-          handle_attribute_name('O');
-        }
-
-      // bool_and
-      case 'A':
-        c = stream_get();
-        second = stream_get();
-        if (c == 'N' && second == 'D') {
-          tokens_.push_back( Token(bool_and, "AND") );
-          break;
-        } else {
-          stream_unget(second);
-          stream_unget(c);
-          handle_attribute_name('A');
-        }
-
-      // bool_not
-      case 'N':
-        c = stream_get();
-        second = stream_get();
-        if (c == 'O' && second == 'T') {
-          tokens_.push_back( Token(bool_not, "NOT") );
-          break;
-        } else {
-          stream_unget(second);
-          stream_unget(c);
-          handle_attribute_name('N');
-        }
-
       // condtional_lt / condtional_lte
       case '<':
         c = stream_get();
@@ -118,6 +80,9 @@ vector<Token> Tokenizer::tokenize() {
             if (c == QUOTE) {
               break;
             }
+            if (c == 0 && stream_.empty()) {
+              throw QuerySyntaxError("Missing closing quote after: " + value);
+            }
 
             value.push_back(c);
           }
@@ -156,17 +121,45 @@ vector<Token> Tokenizer::tokenize() {
   return tokens_;
 }
 
+// Reads a word, which is either a keyword or an attribute name. A character
+// other than a space after the word is left in the stream, so "EXISTS(" and
+// "name)" split correctly.
 void Tokenizer::handle_attribute_name(char first) {
   string attribute(1, first);
-  while (true) {
-    first = stream_get(false);
-    if (first != NULL && first != ' ' && first != ')') {
-      attribute.push_back(first);
-    } else {
-      tokens_.push_back( Token(attribute_name, attribute) );
-      break;
+  if (is_name_char(first)) {
+    while (true) {
+      char c = stream_get(false);
+      if (is_name_char(c)) {
+        attribute.push_back(c);
+      } else {
+        if (c != 0 && c != ' ')
+          stream_unget(c);
+        break;
+      }
     }
   }
+
+  if (attribute == "OR")
+    tokens_.push_back( Token(bool_or, attribute) );
+  else if (attribute == "AND")
+    tokens_.push_back( Token(bool_and, attribute) );
+  else if (attribute == "NOT")
+    tokens_.push_back( Token(bool_not, attribute) );
+  else if (attribute == "IN")
+    tokens_.push_back( Token(subquery_in, attribute) );
+  else if (attribute == "ANY")
+    tokens_.push_back( Token(subquery_any, attribute) );
+  else if (attribute == "ALL")
+    tokens_.push_back( Token(subquery_all, attribute) );
+  else if (attribute == "EXISTS")
+    tokens_.push_back( Token(subquery_exists, attribute) );
+  else
+    tokens_.push_back( Token(attribute_name, attribute) );
+}
+
+bool Tokenizer::is_name_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+    c == '-' || c == '_';
 }
 
 char Tokenizer::stream_get(bool skip_space) {
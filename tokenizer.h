@@ -30,7 +30,12 @@ enum TokenType {
   value_date            = 14,
   value_time            = 15,
 
-  attribute_name        = 16
+  attribute_name        = 16,
+
+  subquery_in           = 17,
+  subquery_any          = 18,
+  subquery_all          = 19,
+  subquery_exists       = 20
 };
 
 enum TokenizerType {
@@ -59,6 +64,7 @@ private:
   char stream_get(bool include_space = true);
   void stream_unget(char c);
   static bool string_contains(string source, char target);
+  static bool is_name_char(char c);
   void handle_attribute_name(char first);
 
   vector<Token> tokens_;
@@ -0,0 +1,221 @@
+#include "value.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <limits>
+
+// Reads the digits in value[begin, end) as a non-negative number.
+// Returns -1 if the range is empty or contains anything but digits.
+static int parse_digits(const string& value, size_t begin, size_t end) {
+  if (begin >= end)
+    return -1;
+  int result = 0;
+  for (size_t i = begin; i < end; ++i) {
+    if (value[i] < '0' || value[i] > '9')
+      return -1;
+    result = result * 10 + (value[i] - '0');
+  }
+  return result;
+}
+
+// Splits value into three numbers separated by sep, e.g. 2013/01/31 or 04:20:01
+static bool parse_triple(const string& value, char sep, int& a, int& b, int& c) {
+  size_t first = value.find(sep);
+  if (first == string::npos)
+    return false;
+  size_t second = value.find(sep, first + 1);
+  if (second == string::npos)
+    return false;
+
+  a = parse_digits(value, 0, first);
+  b = parse_digits(value, first + 1, second);
+  c = parse_digits(value, second + 1, value.size());
+  return a >= 0 && b >= 0 && c >= 0;
+}
+
+// Writes value as exactly `width` digits, padding with zeros
+static void put_digits(string& out, int value, int width) {
+  char buffer[16];
+  for (int i = width - 1; i >= 0; --i) {
+    buffer[i] = '0' + value % 10;
+    value /= 10;
+  }
+  out.append(buffer, width);
+}
+
+Value::Value() {
+  type_ = undefined_type;
+  null_ = true;
+  int_ = 0;
+}
+
+Value::Value(int value) {
+  type_ = integer;
+  null_ = false;
+  int_ = value;
+}
+
+Value::Value(float value) {
+  type_ = floating;
+  null_ = false;
+  float_ = value;
+}
+
+Value::Value(double value) {
+  type_ = floating;
+  null_ = false;
+  float_ = static_cast<float>(value);
+}
+
+Value::Value(const string& value) {
+  type_ = varchar;
+  null_ = false;
+  int_ = 0;
+  text_ = value;
+}
+
+Value::Value(const char* value) {
+  type_ = varchar;
+  null_ = false;
+  int_ = 0;
+  text_ = value;
+}
+
+Value Value::packed(RecordType type, int value) {
+  Value result(value);
+  result.type_ = type;
+  return result;
+}
+
+Value::RecordType Value::type() const {
+  return type_;
+}
+
+bool Value::is_null() const {
+  return null_;
+}
+
+int Value::packed_value() const {
+  return int_;
+}
+
+float Value::float_value() const {
+  return float_;
+}
+
+const string& Value::text() const {
+  return text_;
+}
+
+string Value::to_string() const {
+  return get<string>();
+}
+
+bool Value::operator==(const Value& other) const {
+  if (null_ || other.null_)
+    return null_ == other.null_;
+  if (type_ != other.type_)
+    return false;
+
+  switch (type_) {
+  case integer:
+  case date:
+  case time:
+    return int_ == other.int_;
+  case floating:
+    return float_ == other.float_;
+  default:
+    return text_ == other.text_;
+  }
+}
+
+bool Value::operator!=(const Value& other) const {
+  return !(*this == other);
+}
+
+int Value::pack(RecordType type, const string& value) {
+  switch (type) {
+  case integer: {
+    const char *begin = value.c_str();
+    char *end;
+    errno = 0;
+    long parsed = strtol(begin, &end, 10);
+    if (end == begin || *end != '\0' || errno == ERANGE ||
+        parsed <= numeric_limits<int>::min() || parsed > numeric_limits<int>::max())
+      throw InvalidTypeError("Invalid integer value: " + value);
+    return static_cast<int>(parsed);
+  }
+  case date: {
+    int year, month, day;
+    if (!parse_triple(value, '/', year, month, day) || year > 9999 ||
+        month < 1 || month > 12 || day < 1 || day > 31)
+      throw InvalidTypeError("Invalid date value: " + value);
+    return year * 10000 + month * 100 + day;
+  }
+  case time: {
+    int hours, minutes, seconds;
+    if (!parse_triple(value, ':', hours, minutes, seconds) || hours > 23 ||
+        minutes > 59 || seconds > 59)
+      throw InvalidTypeError("Invalid time value: " + value);
+    return hours * 10000 + minutes * 100 + seconds;
+  }
+  default:
+    throw InvalidTypeError("Cannot pack value of non-integral type: " + value);
+  }
+}
+
+string Value::unpack(RecordType type, int value) {
+  string result;
+  append_unpacked(result, type, value);
+  return result;
+}
+
+void Value::append_unpacked(string& out, RecordType type, int value) {
+  switch (type) {
+  case date:
+    put_digits(out, value / 10000, 4);
+    out.push_back('/');
+    put_digits(out, value / 100 % 100, 2);
+    out.push_back('/');
+    put_digits(out, value % 100, 2);
+    return;
+  case time:
+    put_digits(out, value / 10000, 2);
+    out.push_back(':');
+    put_digits(out, value / 100 % 100, 2);
+    out.push_back(':');
+    put_digits(out, value % 100, 2);
+    return;
+  default: {
+    // Written backwards into a buffer, which is faster than a stringstream
+    char buffer[16];
+    char *end = buffer + sizeof(buffer), *p = end;
+    unsigned magnitude = value < 0 ? 0u - static_cast<unsigned>(value) : value;
+    do {
+      *--p = '0' + magnitude % 10;
+      magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0)
+      *--p = '-';
+    out.append(p, end);
+  }
+  }
+}
+
+string Value::format_float(float value) {
+  string result;
+  append_float(result, value);
+  return result;
+}
+
+// %g is what a stream prints a float as by default, without building the
+// stream
+void Value::append_float(string& out, float value) {
+  char buffer[32];
+#ifdef _MSC_VER
+  int length = sprintf_s(buffer, "%g", value);
+#else
+  int length = snprintf(buffer, sizeof(buffer), "%g", value);
+#endif
+  out.append(buffer, length);
+}
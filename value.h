@@ -0,0 +1,146 @@
+#ifndef VALUE_H_
+#define VALUE_H_
+#pragma warning(disable: 4251)
+
+#include <string>
+#include <sstream>
+#include <cstdlib>
+using namespace std;
+
+#include "exception.h"
+#include "column_type.h"
+
+/**
+ * A single field value, stored in its native type.
+ *
+ * Integers and floats are kept as numbers, dates and times in the packed form
+ * used by Column (yyyymmdd and hhmmss), and strings as text. A value set from
+ * a string has type varchar until it is inserted into a table column, where it
+ * is parsed into the column type.
+ *
+ * Conversions to and from strings only happen when a caller asks for a
+ * different C++ type than the one stored.
+ */
+class EXPORT Value : public ColumnType {
+public:
+  /** Creates a NULL value. */
+  Value();
+  Value(int value);
+  Value(float value);
+  Value(double value);
+  Value(const string& value);
+  Value(const char* value);
+
+  /** Creates a date or time value from its packed form. */
+  static Value packed(RecordType type, int value);
+
+  RecordType type() const;
+  bool is_null() const;
+
+  /** The raw number stored in integer, date and time values. */
+  int packed_value() const;
+  /** The number stored in floating values. */
+  float float_value() const;
+  /** The text stored in varchar values. */
+  const string& text() const;
+
+  /** Returns the value in string form. NULL is returned as "". */
+  string to_string() const;
+
+  /**
+   * Returns the value converted to \a T.
+   * NULL values are returned as T().
+   */
+  template <typename T>
+  T get() const;
+
+  bool operator==(const Value& other) const;
+  bool operator!=(const Value& other) const;
+
+  /**
+   * Packs a string into the integer form used for integer, date and time values.
+   * Throws an \a InvalidTypeError if \a value is not valid for \a type.
+   */
+  static int pack(RecordType type, const string& value);
+  /** Reverses pack. */
+  static string unpack(RecordType type, int value);
+  /** Like unpack(), but appends the string to \a out. */
+  static void append_unpacked(string& out, RecordType type, int value);
+  /** Formats a float the way it is shown in string form. */
+  static string format_float(float value);
+  /** Like format_float(), but appends the string to \a out. */
+  static void append_float(string& out, float value);
+
+private:
+  RecordType type_;
+  bool null_;
+  union {
+    int int_;
+    float float_;
+  };
+  string text_;
+};
+
+/**
+ * Converts a stored value to the C++ type requested by the caller.
+ * Used by Value::get and Column::get.
+ */
+template <typename T>
+struct ValueCast {
+  static T from_int(int value) { return static_cast<T>(value); }
+  static T from_float(float value) { return static_cast<T>(value); }
+  static T from_text(const string& value) {
+    stringstream ss(value);
+    T result = T();
+    ss >> result;
+    return result;
+  }
+};
+
+template <>
+struct ValueCast<int> {
+  static int from_int(int value) { return value; }
+  static int from_float(float value) { return static_cast<int>(value); }
+  static int from_text(const string& value) { return static_cast<int>(strtol(value.c_str(), 0, 10)); }
+};
+
+template <>
+struct ValueCast<float> {
+  static float from_int(int value) { return static_cast<float>(value); }
+  static float from_float(float value) { return value; }
+  static float from_text(const string& value) { return static_cast<float>(strtod(value.c_str(), 0)); }
+};
+
+template <>
+struct ValueCast<double> {
+  static double from_int(int value) { return value; }
+  static double from_float(float value) { return value; }
+  static double from_text(const string& value) { return strtod(value.c_str(), 0); }
+};
+
+template <>
+struct ValueCast<string> {
+  static string from_int(int value) { return Value::unpack(Value::integer, value); }
+  static string from_float(float value) { return Value::format_float(value); }
+  static string from_text(const string& value) { return value; }
+};
+
+template <typename T>
+T Value::get() const {
+  if (null_)
+    return T();
+
+  switch (type_) {
+  case integer:
+    return ValueCast<T>::from_int(int_);
+  case floating:
+    return ValueCast<T>::from_float(float_);
+  case date:
+  case time:
+    return ValueCast<T>::from_text(unpack(type_, int_));
+  default:
+    return ValueCast<T>::from_text(text_);
+  }
+}
+
+#endif  // VALUE_H_
@@ -1,165 +1,626 @@
 #include "where_matcher.h"
+#include "table.h"
+#include "column.h"
+#include "database.h"
+#include "compare_kernels.h"
+#include "thread_pool.h"
 
-#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <climits>
+#include <algorithm>
 
-WhereMatcher::WhereMatcher(string where_clause) {
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Applies a comparison operator to two values of the same type
+template <typename T>
+static bool apply(TokenType op, const T& left, const T& right) {
+  switch (op) {
+  case conditional_eq:
+    return left == right;
+  case conditional_neq:
+    return !(left == right);
+  case conditional_lt:
+    return left < right;
+  case conditional_gt:
+    return right < left;
+  case conditional_lte:
+    return !(right < left);
+  default:
+    return !(left < right);
+  }
+}
+
+// Returns the operator that gives the same result with the operands swapped
+static TokenType mirror(TokenType op) {
+  switch (op) {
+  case conditional_lt:
+    return conditional_gt;
+  case conditional_gt:
+    return conditional_lt;
+  case conditional_lte:
+    return conditional_gte;
+  case conditional_gte:
+    return conditional_lte;
+  default:
+    return op;
+  }
+}
+
+static unsigned words_for(unsigned count) {
+  return (count + 63) / 64;
+}
+
+// Clears the bits past the last row, which NOT and constants would set
+static void clear_tail(uint64_t* bits, unsigned count) {
+  if (count % 64 != 0)
+    bits[count / 64] &= (static_cast<uint64_t>(1) << (count % 64)) - 1;
+}
+
+// Returns true if the bits of all count rows are set
+static bool all_set(const uint64_t* bits, unsigned count) {
+  for (unsigned word = 0; word < count / 64; ++word)
+    if (bits[word] != ~static_cast<uint64_t>(0))
+      return false;
+  if (count % 64 != 0)
+    return bits[count / 64] == (static_cast<uint64_t>(1) << (count % 64)) - 1;
+  return true;
+}
+
+// Returns the position of the lowest set bit of a non-zero word
+static inline unsigned lowest_bit(uint64_t word) {
+#ifdef _MSC_VER
+  unsigned long index;
+  if (_BitScanForward(&index, static_cast<unsigned long>(word)))
+    return index;
+  _BitScanForward(&index, static_cast<unsigned long>(word >> 32));
+  return index + 32;
+#else
+  return __builtin_ctzll(word);
+#endif
+}
+
+static bool is_literal(TokenType type) {
+  return type == value_numeral || type == value_varchar || type == value_date || type == value_time;
+}
+
+static bool is_comparison(TokenType type) {
+  return type >= conditional_eq && type <= conditional_gte;
+}
+
+WhereMatcher::Node::Node(Kind kind) {
+  this->kind = kind;
+  op = conditional_eq;
+  left = right = 0;
+  column = other = 0;
+  result = false;
+  int_value = 0;
+  float_value = 0;
+  number = 0;
+  quantifier = value_undefined_type;
+}
+
+WhereMatcher::WhereMatcher(string where_clause, const Table& table, Database* database) {
   Tokenizer tokenizer(TokenizerType::where, where_clause);
-  query_ = tokenizer.tokenize();
-  query_ = vector<Token>(query_.rbegin(), query_.rend());
+  tokens_ = tokenizer.tokenize();
+  position_ = 0;
+
+  // An empty clause matches every row
+  if (tokens_.empty()) {
+    Node node(Node::constant);
+    node.result = true;
+    root_ = add_node(node);
+    return;
+  }
+
+  root_ = parse_or();
+  if (position_ != tokens_.size())
+    throw QuerySyntaxError("Unexpected symbol: " + tokens_[position_].second);
+
+  // Names are only resolved once the whole clause is known to be valid, so
+  // syntax errors are reported first
+  for (unsigned i = 0; i < nodes_.size(); ++i)
+    if (nodes_[i].kind == Node::comparison)
+      compile(nodes_[i], table, database);
+
+  tokens_.clear();
 }
 
-bool WhereMatcher::does_match(Record record) {
-  record_ = record;
-  tokens_ = query_;
-  return parse_and();
+void WhereMatcher::match_batch(unsigned begin, unsigned count, uint64_t* bits) const {
+  uint64_t fails[batch_size / 64];
+  evaluate(root_, begin, count, bits, fails);
 }
 
-bool WhereMatcher::parse_conditional() {
-  Token left_token = stream_get();
+void WhereMatcher::select(unsigned begin, unsigned end, vector<unsigned>& selection) const {
+  // Large ranges are split into morsels that are matched in parallel, then
+  // joined in order
+  if (ThreadPool::morsel_count(begin, end) > 1) {
+    vector<vector<unsigned> > morsels(ThreadPool::morsel_count(begin, end));
+    ThreadPool::instance().parallel_for(begin, end, [&](unsigned morsel, unsigned morsel_begin, unsigned morsel_end) {
+      select_batches(morsel_begin, morsel_end, morsels[morsel]);
+    });
+    for (unsigned i = 0; i < morsels.size(); ++i)
+      selection.insert(selection.end(), morsels[i].begin(), morsels[i].end());
+    return;
+  }
+  select_batches(begin, end, selection);
+}
 
-  // handling of parenthesis
-  if (left_token.first == parenthesis_left) {
-    bool result = parse_and();
-    Token close_parenthesis = stream_get();
+void WhereMatcher::select_batches(unsigned begin, unsigned end, vector<unsigned>& selection) const {
+  uint64_t bits[batch_size / 64], fails[batch_size / 64];
+  for (unsigned batch = begin; batch < end; batch += batch_size) {
+    unsigned count = end - batch < batch_size ? end - batch : batch_size;
+    evaluate(root_, batch, count, bits, fails);
+    for (unsigned word = 0; word < words_for(count); ++word) {
+      for (uint64_t set = bits[word]; set != 0; set &= set - 1)
+        selection.push_back(batch + word * 64 + lowest_bit(set));
+    }
+  }
+}
+
+unsigned WhereMatcher::parse_or() {
+  unsigned left = parse_and();
+  while (stream_peek().first == bool_or) {
+    stream_get();
+    Node node(Node::or_node);
+    node.left = left;
+    node.right = parse_and();
+    left = add_node(node);
+  }
+  return left;
+}
+
+unsigned WhereMatcher::parse_and() {
+  unsigned left = parse_not();
+  while (stream_peek().first == bool_and) {
+    stream_get();
+    Node node(Node::and_node);
+    node.left = left;
+    node.right = parse_not();
+    left = add_node(node);
+  }
+  return left;
+}
+
+unsigned WhereMatcher::parse_not() {
+  Node node(Node::not_node);
+  if (stream_peek().first == bool_not) {
+    stream_get();
+    node.left = parse_not();
+    return add_node(node);
+  }
+
+  unsigned condition = parse_primary();
+  if (stream_peek().first != bool_not)
+    return condition;
 
-    if (close_parenthesis.first != parenthesis_right) {
+  // Postfix form, e.g. "age > 40 NOT"
+  stream_get();
+  node.left = condition;
+  return add_node(node);
+}
+
+unsigned WhereMatcher::parse_primary() {
+  if (stream_peek().first == parenthesis_left) {
+    stream_get();
+    unsigned result = parse_or();
+    if (stream_get().first != parenthesis_right)
       throw QuerySyntaxError("Invalid syntax, missing closing parenthesis.");
-    } else {
-      return result;
-    }
+    return result;
   }
 
-  Token op_token = stream_get();
-  TokenType value_type = left_token.first;
+  Node node(Node::comparison);
+  if (stream_peek().first == subquery_exists) {
+    node.quantifier = stream_get().first;
+    node.subquery = parse_subquery();
+    return add_node(node);
+  }
 
-  // the left side is an attribute_name, we need to look ahead for the type
-  if (value_type == attribute_name) {
-    Token right_token = stream_get();
-    value_type = right_token.first;
-    stream_unget(right_token);
+  node.left_token = parse_operand();
+  Token op = stream_get();
+  if (op.first == subquery_in) {
+    node.quantifier = subquery_in;
+    node.subquery = parse_subquery();
+    return add_node(node);
   }
+  if (!is_comparison(op.first))
+    throw QuerySyntaxError("Unrecognized symbol: " + (op.second.empty() ? node.left_token.second : op.second));
+  node.op = op.first;
 
-  stream_unget(left_token);
+  TokenType next = stream_peek().first;
+  if (next == subquery_any || next == subquery_all) {
+    node.quantifier = stream_get().first;
+    node.subquery = parse_subquery();
+    return add_node(node);
+  }
+  node.right_token = parse_operand();
+  return add_node(node);
+}
 
-  // In C++ you can't declare variables of the same name, even if they were
-  // never actually declared, this is a really ugly fix, but if there is a way
-  // to emulate some sort of dynamic typing C++, we could make this a lot better
-  switch (op_token.first) {
-    case conditional_eq:
-      switch (value_type) {
-        case value_numeral:
-          return parse_value<float>() == parse_value<float>();
-        case value_varchar:
-        case value_date:
-        case value_time:
-          return parse_value<string>().compare(parse_value<string>()) == 0;
-      }
-    case conditional_neq:
-      switch (value_type) {
-        case value_numeral:
-          return parse_value<float>() != parse_value<float>();
-        case value_varchar:
-        case value_date:
-        case value_time:
-          return parse_value<string>().compare(parse_value<string>()) != 0;
-      }
-    case conditional_lt:
-      switch (value_type) {
-        case value_numeral:
-          return parse_value<float>() < parse_value<float>();
-        case value_varchar:
-        case value_date:
-        case value_time:
-          return parse_value<string>().compare(parse_value<string>()) > 0;
-      }
-    case conditional_gt:
-      switch (value_type) {
-        case value_numeral:
-          return parse_value<float>() > parse_value<float>();
-        case value_varchar:
-        case value_date:
-        case value_time:
-		      return parse_value<string>().compare(parse_value<string>()) < 0;
-      }
-      break;
-    case conditional_lte:
-      switch (value_type) {
-        case value_numeral:
-          return parse_value<float>() <= parse_value<float>();
-        case value_varchar:
-        case value_date:
-        case value_time:
-          return parse_value<string>().compare(parse_value<string>()) >= 0;
-      }
-      break;
-    case conditional_gte:
-      switch (value_type) {
-        case value_numeral:
-          return parse_value<float>() >= parse_value<float>();
-        case value_varchar:
-        case value_date:
-        case value_time:
-          return parse_value<string>().compare(parse_value<string>()) <= 0;
+// Reads the table name of a subquery, which may be in parentheses
+string WhereMatcher::parse_subquery() {
+  bool parenthesized = stream_peek().first == parenthesis_left;
+  if (parenthesized)
+    stream_get();
+  Token name = stream_get();
+  if (name.first != attribute_name)
+    throw QuerySyntaxError("Expected a table name: " + name.second);
+  if (parenthesized && stream_get().first != parenthesis_right)
+    throw QuerySyntaxError("Invalid syntax, missing closing parenthesis.");
+  return name.second;
+}
+
+Token WhereMatcher::parse_operand() {
+  Token token = stream_get();
+  if (token.first != attribute_name && !is_literal(token.first))
+    throw QuerySyntaxError("Expected attribute name or value: " + token.second);
+  return token;
+}
+
+void WhereMatcher::compile(Node& node, const Table& table, Database* database) {
+  if (node.quantifier != value_undefined_type) {
+    compile_subquery(node, table, database);
+    return;
+  }
+
+  // Put the column (if any) on the left
+  if (node.left_token.first != attribute_name && node.right_token.first == attribute_name) {
+    swap(node.left_token, node.right_token);
+    node.op = mirror(node.op);
+  }
+
+  if (node.left_token.first != attribute_name) {
+    // Two literals, so the result is the same for every row
+    const string& left = node.left_token.second;
+    const string& right = node.right_token.second;
+    node.kind = Node::constant;
+    if (node.left_token.first == value_numeral && node.right_token.first == value_numeral)
+      node.result = apply(node.op, strtod(left.c_str(), 0), strtod(right.c_str(), 0));
+    else
+      node.result = apply(node.op, left.compare(right), 0);
+    return;
+  }
+
+  const Column& column = table.data_[table.index_for(node.left_token.second)];
+  node.column = &column;
+  if (node.right_token.first != attribute_name) {
+    compile_with_literal(node, column, node.right_token);
+    return;
+  }
+
+  const Column& other = table.data_[table.index_for(node.right_token.second)];
+  node.other = &other;
+  if (column.is_numeric() && other.is_numeric())
+    node.kind = Node::column_numbers;
+  else if (column.type() == other.type())
+    node.kind = column.type() == Column::varchar ? Node::column_varchars : Node::column_packed;
+  else
+    node.kind = Node::column_texts;
+}
+
+// Works out a subquery once: EXISTS becomes a constant, IN a hash set of the
+// table's values, and ANY or ALL a comparison with its smallest or largest
+// value (or a constant when that decides it for every row)
+void WhereMatcher::compile_subquery(Node& node, const Table& table, Database* database) {
+  if (!database)
+    throw TableDoesNotExistError("Table " + node.subquery + " could not be found");
+  const Table& subquery = *database->table(node.subquery);
+  TokenType quantifier = node.quantifier;
+  node.quantifier = value_undefined_type;
+  if (quantifier == subquery_exists) {
+    node.kind = Node::constant;
+    node.result = subquery.size() > 0;
+    return;
+  }
+
+  if (node.left_token.first != attribute_name)
+    throw QuerySyntaxError("Expected a column before " + node.subquery);
+  const string& name = node.left_token.second;
+  const Column& column = table.data_[table.index_for(name)];
+  node.column = &column;
+
+  unsigned value_column;
+  if (subquery.data_.size() == 1)
+    value_column = 0;
+  else if (subquery.has_column(name))
+    value_column = subquery.index_for(name);
+  else
+    throw InvalidOperationError("Table " + node.subquery + " should have one column, or a column named " + name);
+  const Column& values = subquery.data_[value_column];
+
+  // "= ANY" is IN, and "!= ALL" is NOT IN
+  if (quantifier == subquery_any && node.op == conditional_eq)
+    quantifier = subquery_in;
+  if (quantifier == subquery_all && node.op == conditional_neq)
+    quantifier = subquery_in;
+
+  if (quantifier == subquery_in) {
+    unsigned rows = values.size();
+    if (column.type() == values.type() && column.type() != Column::varchar && column.type() != Column::floating) {
+      node.kind = Node::in_ints;
+      for (unsigned row = 0; row < rows; ++row)
+        if (!values.is_null(row))
+          node.int_set.insert(values.int_data()[row]);
+    } else {
+      node.kind = Node::in_keys;
+      string key;
+      for (unsigned row = 0; row < rows; ++row) {
+        if (values.is_null(row))
+          continue;
+        key.clear();
+        try {
+          column.append_key(values.get_value(row), key);
+        } catch (const InvalidTypeError&) {
+          continue;  // can't equal any value of the column
+        }
+        node.key_set.insert(key);
       }
-      break;
+    }
+    return;
+  }
+
+  int min_row = values.min_row(), max_row = values.max_row();
+  if (min_row < 0) {
+    // No values: ANY never holds, ALL always does
+    node.kind = Node::constant;
+    node.result = quantifier == subquery_all;
+    return;
+  }
+  bool single = values.compare(min_row, values, max_row) == 0;
+
+  switch (node.op) {
+  case conditional_lt:
+  case conditional_lte:
+    compile_with_value(node, column, values, quantifier == subquery_any ? max_row : min_row);
+    return;
+  case conditional_gt:
+  case conditional_gte:
+    compile_with_value(node, column, values, quantifier == subquery_any ? min_row : max_row);
+    return;
+  default:
+    // "!= ANY" or "= ALL": only one distinct value leaves room for doubt
+    if (!single) {
+      node.kind = Node::constant;
+      node.result = quantifier == subquery_any;
+      return;
+    }
+    compile_with_value(node, column, values, min_row);
+  }
+}
+
+// Compiles a comparison of column with the value at row of values
+void WhereMatcher::compile_with_value(Node& node, const Column& column, const Column& values, unsigned row) {
+  if (column.type() == values.type()) {
+    switch (column.type()) {
+    case Column::floating:
+      node.kind = Node::float_constant;
+      node.float_value = values.float_data()[row];
+      return;
+    case Column::varchar:
+      node.kind = Node::text;
+      node.text_value = values.get_string(row);
+      return;
     default:
-      throw QuerySyntaxError("Unrecognized symbol: " + left_token.second);
+      node.kind = Node::int_constant;
+      node.int_value = values.int_data()[row];
+      return;
+    }
   }
-  throw QuerySyntaxError("Unknown type, internal error");
+
+  TokenType type = value_varchar;
+  if (values.is_numeric())
+    type = value_numeral;
+  else if (values.type() == Column::date)
+    type = value_date;
+  else if (values.type() == Column::time)
+    type = value_time;
+  compile_with_literal(node, column, Token(type, values.get_string(row)));
 }
 
-bool WhereMatcher::parse_not() {
-  bool left = parse_conditional();
-  Token t = stream_get();
+void WhereMatcher::compile_with_literal(Node& node, const Column& column, const Token& literal) {
+  const string& value = literal.second;
+  switch (column.type()) {
+  case Column::integer:
+    if (literal.first == value_numeral) {
+      // Whole numbers can be compared as ints; anything else goes through doubles
+      double number = strtod(value.c_str(), 0);
+      if (number == floor(number) && number > INT_MIN && number <= INT_MAX) {
+        node.kind = Node::int_constant;
+        node.int_value = static_cast<int>(number);
+        return;
+      }
+    }
+    break;
+  case Column::floating:
+    if (literal.first == value_numeral) {
+      // Compare as floats, so that "gpa >= 3.9" matches a stored 3.9
+      node.kind = Node::float_constant;
+      node.float_value = static_cast<float>(strtod(value.c_str(), 0));
+      return;
+    }
+    break;
+  case Column::date:
+  case Column::time:
+    if (literal.first == value_date || literal.first == value_time ||
+        literal.first == value_varchar) {
+      try {
+        node.int_value = Value::pack(column.type(), value);
+        node.kind = Node::int_constant;
+        return;
+      } catch (const InvalidTypeError&) {
+        // Not a valid date or time, so fall back to comparing strings
+      }
+    }
+    break;
+  case Column::varchar:
+    if (literal.first != value_numeral) {
+      node.kind = Node::text;
+      node.text_value = value;
+      return;
+    }
+    break;
+  default:
+    break;
+  }
 
-  if (t.first == bool_not) {
-    return !left;
+  // The types don't line up; compare the way the literal is written
+  if (literal.first == value_numeral) {
+    node.kind = Node::any_number;
+    node.number = strtod(value.c_str(), 0);
   } else {
-    if (t.first != value_undefined_type)
-      stream_unget(t);
-    return left;
+    node.kind = Node::any_text;
+    node.text_value = value;
   }
 }
 
-bool WhereMatcher::parse_or() {
-  bool left = parse_not();
-  Token t = stream_get();
+// Sets bit i of holds for the rows where the node is true, and of fails for
+// those where it is false. Rows in neither compared with NULL, so whether the
+// node holds for them is unknown.
+void WhereMatcher::evaluate(unsigned index, unsigned begin, unsigned count, uint64_t* holds, uint64_t* fails) const {
+  const Node& node = nodes_[index];
+  unsigned words = words_for(count);
+  uint64_t other_holds[batch_size / 64], other_fails[batch_size / 64];
 
-  if (t.first == bool_or) {
-    return left || parse_and();
-  } else {
-    if (t.first != value_undefined_type)
-      stream_unget(t);
-    return left;
+  switch (node.kind) {
+  case Node::constant:
+    fill(holds, holds + words, node.result ? ~static_cast<uint64_t>(0) : 0);
+    fill(fails, fails + words, node.result ? 0 : ~static_cast<uint64_t>(0));
+    clear_tail(holds, count);
+    clear_tail(fails, count);
+    return;
+
+  case Node::and_node: {
+    evaluate(node.left, begin, count, holds, fails);
+    if (all_set(fails, count))
+      return;  // nothing left for the right side to decide
+    evaluate(node.right, begin, count, other_holds, other_fails);
+    for (unsigned word = 0; word < words; ++word) {
+      holds[word] &= other_holds[word];
+      fails[word] |= other_fails[word];
+    }
+    return;
+  }
+  case Node::or_node:
+    evaluate(node.left, begin, count, holds, fails);
+    if (all_set(holds, count))
+      return;
+    evaluate(node.right, begin, count, other_holds, other_fails);
+    for (unsigned word = 0; word < words; ++word) {
+      holds[word] |= other_holds[word];
+      fails[word] &= other_fails[word];
+    }
+    return;
+  case Node::not_node:
+    evaluate(node.left, begin, count, fails, holds);
+    return;
+
+  case Node::int_constant:
+    compare_ints(node.column->int_data() + begin, count, node.op, node.int_value, holds);
+    split_nulls(node, begin, count, holds, fails);
+    return;
+  case Node::float_constant:
+    compare_floats(node.column->float_data() + begin, count, node.op, node.float_value, holds);
+    split_nulls(node, begin, count, holds, fails);
+    return;
+
+  default:
+    // Comparisons without a typed kernel are tested one row at a time. Text
+    // forms and keys are built in buffers kept for the whole batch.
+    fill(holds, holds + words, 0);
+    fill(fails, fails + words, 0);
+    string left, right;
+    for (unsigned i = 0; i < count; ++i) {
+      unsigned row = begin + i;
+      if ((node.column && node.column->is_null(row)) || (node.other && node.other->is_null(row)))
+        continue;
+      uint64_t bit = static_cast<uint64_t>(1) << (i % 64);
+      if (test(node, row, left, right))
+        holds[i / 64] |= bit;
+      else
+        fails[i / 64] |= bit;
+    }
+    return;
+  }
+}
+
+// Given the rows a comparison holds for in holds, moves the rows where it
+// failed to fails, and clears the rows with a NULL column from both
+void WhereMatcher::split_nulls(const Node& node, unsigned begin, unsigned count, uint64_t* holds, uint64_t* fails) const {
+  unsigned words = words_for(count);
+  fill(fails, fails + words, ~static_cast<uint64_t>(0));
+  clear_tail(fails, count);
+  node.column->clear_nulls(begin, count, fails);
+  for (unsigned word = 0; word < words; ++word) {
+    holds[word] &= fails[word];
+    fails[word] &= ~holds[word];
   }
 }
 
-bool WhereMatcher::parse_and() {
-  bool left = parse_or();
-  Token t = stream_get();
+// Tests a comparison on one non-NULL row, using left and right as scratch
+// space for text forms and keys
+bool WhereMatcher::test(const Node& node, unsigned row, string& left, string& right) const {
+  switch (node.kind) {
+  case Node::text:
+    return apply(node.op, node.column->compare_text(row, node.text_value), 0);
 
-  if(t.first == bool_and) {
-	bool right = parse_and();
-    return left && right;
-  } else {
-    if (t.first != value_undefined_type)
-      stream_unget(t);
-    return left;
+  case Node::column_numbers:
+    return apply(node.op, node.column->get<double>(row), node.other->get<double>(row));
+  case Node::column_packed:
+    return apply(node.op, node.column->int_data()[row], node.other->int_data()[row]);
+  case Node::column_varchars:
+    return apply(node.op, node.column->compare(row, *node.other, row), 0);
+  case Node::column_texts:
+    // A varchar side is compared where it is
+    left.clear();
+    if (node.column->type() == Column::varchar) {
+      node.other->append_string(row, left);
+      return apply(node.op, node.column->compare_text(row, left), 0);
+    }
+    node.column->append_string(row, left);
+    if (node.other->type() == Column::varchar)
+      return apply(node.op, 0, node.other->compare_text(row, left));
+    right.clear();
+    node.other->append_string(row, right);
+    return apply(node.op, left.compare(right), 0);
+
+  case Node::any_number:
+    return apply(node.op, node.column->get<double>(row), node.number);
+  case Node::any_text:
+    left.clear();
+    node.column->append_string(row, left);
+    return apply(node.op, left.compare(node.text_value), 0);
+
+  case Node::in_ints: {
+    bool found = node.int_set.count(node.column->int_data()[row]) != 0;
+    return found == (node.op == conditional_eq);
+  }
+  case Node::in_keys: {
+    left.clear();
+    node.column->append_key(row, left);
+    bool found = node.key_set.count(left) != 0;
+    return found == (node.op == conditional_eq);
   }
+
+  default:
+    throw QuerySyntaxError("Unknown type, internal error");
+  }
+}
+
+unsigned WhereMatcher::add_node(const Node& node) {
+  nodes_.push_back(node);
+  return nodes_.size() - 1;
 }
 
 Token WhereMatcher::stream_get() {
-  if (tokens_.size() > 0) {
-    vector<Token>::iterator it = tokens_.end();
-    it--;
-    Token token = *it;
-    tokens_.pop_back();
-    return token;
-  } else {
-    return Token(value_undefined_type, "");
-  }
+  if (position_ < tokens_.size())
+    return tokens_[position_++];
+  return Token(value_undefined_type, "");
 }
 
-void WhereMatcher::stream_unget(Token token) {
-  tokens_.push_back(token);
-}
\ No newline at end of file
+Token WhereMatcher::stream_peek() const {
+  if (position_ < tokens_.size())
+    return tokens_[position_];
+  return Token(value_undefined_type, "");
+}
@@ -1,63 +1,163 @@
 #ifndef WHEREMATCHER_H_
 #define WHEREMATCHER_H_
+#pragma warning(disable: 4251)
 
 #include "exception.h"
-#include "record.h"
 #include "tokenizer.h"
 
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <unordered_set>
 using namespace std;
 
+class Table;
+class Column;
+class Database;
+
+/**
+ * A where clause compiled against the columns of a table.
+ *
+ * The clause is parsed once into a tree of predicates. Column names are
+ * resolved to the columns of the table and literals are converted to the type
+ * of the column they are compared with, so matching a row reads straight from
+ * the column storage without building a Record or touching the tokens.
+ *
+ * Rows are matched in batches of up to \a batch_size. Comparisons against a
+ * constant run as tight loops over a column's array and produce a bitmap with
+ * one bit per row; AND, OR and NOT combine the bitmaps a word at a time.
+ *
+ * AND binds tighter than OR, and NOT tighter than both. NOT may be written
+ * before a condition, or after it as in older queries. An empty clause
+ * matches every row.
+ *
+ * As in SQL, a comparison with a NULL value is neither true nor false but
+ * unknown. NOT leaves it unknown, AND is false if either side is false and
+ * OR is true if either side is true, and a row only matches if the whole
+ * clause is true. So `x = 5` and `NOT x = 5` both leave out rows where x is
+ * NULL. Each node works out a bitmap of the rows it holds for and one of
+ * those it fails for, with the columns' validity bitmaps deciding which rows
+ * are in neither.
+ *
+ * Conditions may refer to other tables in the database:
+ *
+ * - `column IN table` holds if the column's value is in the table.
+ * - `column op ANY(table)` holds if the comparison holds for some value in
+ *   the table, and `column op ALL(table)` if it holds for all of them.
+ * - `EXISTS(table)` holds if the table has any rows.
+ *
+ * The table must have a single column, or a column with the same name as the
+ * one it is compared with. Each subquery is worked out once when the clause
+ * is compiled: IN builds a hash set of the table's values, ANY and ALL reduce
+ * to a comparison with the smallest or largest value, and EXISTS becomes a
+ * constant. NULLs in the table are left out.
+ *
+ * The matcher refers to the table's columns, so it must not outlive the table
+ * or be used after columns are added or removed.
+ */
 class EXPORT WhereMatcher {
 public:
-  WhereMatcher(string where_clause);
-  bool does_match(Record record);
+  /**
+   * Compiles \a where_clause against \a table. Subqueries name tables in
+   * \a database.
+   *
+   * Throws a \a QuerySyntaxError if the clause cannot be parsed.
+   * Throws a \a ColumnDoesNotExistError if it refers to a column that is not
+   * in the table.
+   * Throws a \a TableDoesNotExistError if a subquery names a table that is
+   * not in \a database, or there is no database.
+   * Throws an \a InvalidOperationError if a subquery's table has no column to
+   * compare with.
+   */
+  WhereMatcher(string where_clause, const Table& table, Database* database = NULL);
+
+  /** The largest number of rows matched at once. */
+  static const unsigned batch_size = 1024;
+
+  /**
+   * Matches the \a count rows starting at \a begin, where \a count is at most
+   * \a batch_size. Bit i of \a bits (64 rows per word) is set if row
+   * begin + i satisfies the where clause, and bits past \a count are clear.
+   */
+  void match_batch(unsigned begin, unsigned count, uint64_t* bits) const;
+
+  /**
+   * Appends the rows in [\a begin, \a end) that satisfy the where clause to
+   * \a selection, in order. Ranges longer than a morsel are matched on all
+   * cores (see ThreadPool).
+   */
+  void select(unsigned begin, unsigned end, vector<unsigned>& selection) const;
+
 private:
-  vector<Token> tokens_;
-  vector<Token> query_;
-  Record record_;
+  struct Node {
+    enum Kind {
+      constant,
+      and_node, or_node, not_node,
+      // Unresolved comparison between left_token and right_token
+      comparison,
+      // Comparisons of a column with a literal. int_constant covers integer,
+      // date and time columns.
+      int_constant, float_constant, text,
+      // Comparisons between two columns
+      column_numbers, column_packed, column_varchars, column_texts,
+      // Fallbacks through Column::get, for mismatched types
+      any_number, any_text,
+      // Membership in a subquery's values; op is conditional_eq for IN, or
+      // conditional_neq for NOT IN
+      in_ints, in_keys
+    };
+
+    Node(Kind kind);
+
+    Kind kind;
+    TokenType op;
+    // Children of and_node, or_node and not_node
+    unsigned left, right;
 
-  bool parse_conditional();
-  bool parse_not();
-  bool parse_or();
-  bool parse_and();
+    Token left_token, right_token;
+    const Column* column;
+    const Column* other;
 
-  template <typename T>
-  T parse_value();
-  template <>
-  string parse_value();
+    bool result;
+    int int_value;
+    float float_value;
+    double number;
+    string text_value;
 
+    // The table of a subquery and how it is used: subquery_in, subquery_any,
+    // subquery_all or subquery_exists. value_undefined_type otherwise.
+    TokenType quantifier;
+    string subquery;
+    unordered_set<int> int_set;
+    unordered_set<string> key_set;
+  };
+
+  unsigned parse_or();
+  unsigned parse_and();
+  unsigned parse_not();
+  unsigned parse_primary();
+  Token parse_operand();
+  string parse_subquery();
+
+  void compile(Node& node, const Table& table, Database* database);
+  void compile_subquery(Node& node, const Table& table, Database* database);
+  void compile_with_value(Node& node, const Column& column, const Column& values, unsigned row);
+  void compile_with_literal(Node& node, const Column& column, const Token& literal);
+
+  void select_batches(unsigned begin, unsigned end, vector<unsigned>& selection) const;
+  void evaluate(unsigned node, unsigned begin, unsigned count, uint64_t* holds, uint64_t* fails) const;
+  void split_nulls(const Node& node, unsigned begin, unsigned count, uint64_t* holds, uint64_t* fails) const;
+  bool test(const Node& node, unsigned row, string& left, string& right) const;
+
+  unsigned add_node(const Node& node);
   Token stream_get();
-  void stream_unget(Token token);
-};
+  Token stream_peek() const;
+
+  vector<Node> nodes_;
+  unsigned root_;
 
-template <typename T>
-T WhereMatcher::parse_value() {
-  Token t = stream_get();
-
-  if (t.first == attribute_name) {
-    return record_.get<T>(t.second);
-  } else {
-    stringstream ss;
-    ss << t.second;
-
-    T value;
-    ss >> value;
-
-    return value;
-  }
-}
-
-template <>
-string WhereMatcher::parse_value() {
-  Token t = stream_get();
-
-  if (t.first == attribute_name) {
-    return record_.get<string>(t.second);
-  } else {
-    return t.second;
-  }
-}
+  vector<Token> tokens_;
+  unsigned position_;
+};
 
 #endif
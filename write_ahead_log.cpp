@@ -0,0 +1,597 @@
+#include "write_ahead_log.h"
+#include "table_log.h"
+#include "binary_io.h"
+
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+static const char magic[8] = { 'D', 'B', 'T', '7', 'W', 'L', 'O', 'G' };
+// magic and version
+static const unsigned header_bytes = 8 + 4;
+// size of the body, checksum and sequence number
+static const unsigned entry_header_bytes = 4 + 8 + 8;
+
+// What an entry does. The body of an entry is its kind, the name of its table
+// and then the arguments listed here.
+enum EntryKind {
+  table_added_entry = 1,   // columns, key, rows
+  table_dropped_entry,     //
+  rows_inserted_entry,     // rows
+  rows_deleted_entry,      // where
+  rows_updated_entry,      // where, set
+  column_added_entry,      // name, type
+  column_deleted_entry,    // name
+  column_renamed_entry,    // from, to
+  key_set_entry            // column names
+};
+
+LogOptions::LogOptions() {
+  sync = sync_always;
+  sync_interval_ms = 100;
+}
+
+// The file calls, which differ between the C runtimes. The file is opened for
+// appending, so writes go to the end even after it is truncated.
+#ifdef _WIN32
+
+static int open_file(const string& path, bool create) {
+  int fd = -1;
+  int flags = _O_RDWR | _O_BINARY | (create ? _O_CREAT | _O_APPEND : 0);
+  _sopen_s(&fd, path.c_str(), flags, _SH_DENYNO, _S_IREAD | _S_IWRITE);
+  return fd;
+}
+
+static bool write_file(int fd, const char* data, size_t bytes) {
+  while (bytes > 0) {
+    int written = _write(fd, data, static_cast<unsigned>(min<size_t>(bytes, 1 << 30)));
+    if (written <= 0)
+      return false;
+    data += written;
+    bytes -= written;
+  }
+  return true;
+}
+
+static bool flush_file(int fd) {
+  return _commit(fd) == 0;
+}
+
+static bool truncate_file(int fd, uint64_t size) {
+  return _chsize_s(fd, size) == 0;
+}
+
+static void close_file(int fd) {
+  _close(fd);
+}
+
+#else
+
+static int open_file(const string& path, bool create) {
+  return open(path.c_str(), create ? O_RDWR | O_CREAT | O_APPEND : O_RDONLY, 0644);
+}
+
+static bool write_file(int fd, const char* data, size_t bytes) {
+  while (bytes > 0) {
+    ssize_t written = write(fd, data, bytes);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    data += written;
+    bytes -= written;
+  }
+  return true;
+}
+
+static bool flush_file(int fd) {
+  return fsync(fd) == 0;
+}
+
+static bool truncate_file(int fd, uint64_t size) {
+  return ftruncate(fd, size) == 0;
+}
+
+static void close_file(int fd) {
+  close(fd);
+}
+
+#endif
+
+void sync_file(const string& path) {
+  int fd = open_file(path, false);
+  if (fd < 0)
+    throw IOError("Could not open " + path);
+  bool flushed = flush_file(fd);
+  close_file(fd);
+  if (!flushed)
+    throw IOError("Could not flush " + path + " to disk");
+}
+
+// Returns the contents of the file at path, or nothing if it doesn't exist
+static string read_file(const string& path) {
+  ifstream in(path.c_str(), ios::binary);
+  if (!in)
+    return string();
+  return string((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+}
+
+static void put_value(string& out, const Value& value) {
+  put<uint8_t>(out, value.is_null() ? Value::undefined_type : value.type());
+  if (value.is_null())
+    return;
+  switch (value.type()) {
+  case Value::floating:
+    put<float>(out, value.float_value());
+    break;
+  case Value::varchar:
+    put_string(out, value.text());
+    break;
+  default:
+    put<int32_t>(out, value.packed_value());
+  }
+}
+
+static string entry(EntryKind kind, const string& table) {
+  string body;
+  put<uint8_t>(body, kind);
+  put_string(body, table);
+  return body;
+}
+
+// Reads the fields of an entry back out of its body. The body passed its
+// checksum, so running past the end means the log was written wrongly.
+class EntryReader {
+public:
+  EntryReader(const string& body) : body_(body), pos_(0) {}
+
+  template <typename T>
+  T get() {
+    T value;
+    memcpy(&value, take(sizeof(value)), sizeof(value));
+    return value;
+  }
+
+  string get_string() {
+    uint32_t size = get<uint32_t>();
+    return string(take(size), size);
+  }
+
+  Value get_value() {
+    uint8_t type = get<uint8_t>();
+    switch (type) {
+    case Value::undefined_type:
+      return Value();
+    case Value::integer:
+      return Value(get<int32_t>());
+    case Value::floating:
+      return Value(get<float>());
+    case Value::varchar:
+      return Value(get_string());
+    case Value::date:
+    case Value::time:
+      return Value::packed(static_cast<Value::RecordType>(type), get<int32_t>());
+    default:
+      throw IOError("Log entry has a value of unknown type");
+    }
+  }
+
+private:
+  const char* take(size_t bytes) {
+    if (bytes > body_.size() - pos_)
+      throw IOError("Log entry is truncated");
+    const char* p = body_.data() + pos_;
+    pos_ += bytes;
+    return p;
+  }
+
+  const string& body_;
+  size_t pos_;
+};
+
+WriteAheadLog::WriteAheadLog(const string& path, const LogOptions& options, uint64_t sequence)
+  : path_(path), options_(options) {
+  flushing_ = false;
+  failed_ = false;
+  closing_ = false;
+
+  string data = read_file(path);
+  uint64_t last = 0;
+  size_t end = scan(data, path, [&](uint64_t entry, const string&) { last = entry; });
+  sequence_ = max(sequence, last);
+  synced_sequence_ = sequence_;
+
+  file_ = open_file(path, true);
+  if (file_ < 0)
+    throw IOError("Could not open " + path);
+  // Start a new file, or cut off an entry torn by a crash
+  bool ready;
+  if (end == 0) {
+    string header(magic, sizeof(magic));
+    put<uint32_t>(header, version);
+    ready = truncate_file(file_, 0) && write_file(file_, header.data(), header.size()) && flush_file(file_);
+  } else {
+    ready = end == data.size() || (truncate_file(file_, end) && flush_file(file_));
+  }
+  if (!ready) {
+    close_file(file_);
+    throw IOError("Could not write " + path);
+  }
+
+  if (options_.sync == LogOptions::sync_interval)
+    sync_thread_ = thread(&WriteAheadLog::sync_periodically, this);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+  {
+    unique_lock<mutex> lock(mutex_);
+    closing_ = true;
+    while (flushing_)
+      flushed_.wait(lock);
+  }
+  flushed_.notify_all();
+  if (sync_thread_.joinable())
+    sync_thread_.join();
+  flush_file(file_);
+  close_file(file_);
+}
+
+uint64_t WriteAheadLog::sequence() const {
+  lock_guard<mutex> lock(mutex_);
+  return sequence_;
+}
+
+void WriteAheadLog::truncate() {
+  unique_lock<mutex> lock(mutex_);
+  while (flushing_ || !pending_.empty()) {
+    if (flushing_)
+      flushed_.wait(lock);
+    else
+      flush_pending(lock);
+  }
+  if (!truncate_file(file_, header_bytes) || !flush_file(file_)) {
+    failed_ = true;
+    throw IOError("Could not truncate " + path_);
+  }
+}
+
+void WriteAheadLog::table_added(const string& name, const Table& table) {
+  string body = entry(table_added_entry, name);
+  Table::ColumnList columns = table.columns();
+  put<uint32_t>(body, columns.size());
+  for (auto column : columns) {
+    put_string(body, column.first);
+    put<uint8_t>(body, column.second);
+  }
+  vector<string> key = table.key();
+  put<uint32_t>(body, key.size());
+  for (const string& column : key)
+    put_string(body, column);
+  put_rows(body, table, 0);
+  append(body);
+}
+
+void WriteAheadLog::table_dropped(const string& name) {
+  append(entry(table_dropped_entry, name));
+}
+
+void WriteAheadLog::append(const string& body) {
+  unique_lock<mutex> lock(mutex_);
+  if (failed_)
+    throw IOError("Log " + path_ + " could not be written, and takes no more changes");
+
+  uint64_t entry = ++sequence_;
+  string frame;
+  frame.reserve(entry_header_bytes + body.size());
+  put<uint32_t>(frame, body.size());
+  put<uint64_t>(frame, 0);  // the checksum, filled in below
+  put<uint64_t>(frame, entry);
+  frame += body;
+  uint64_t sum = checksum(frame.data() + 12, frame.size() - 12);
+  memcpy(&frame[4], &sum, sizeof(sum));
+
+  if (options_.sync != LogOptions::sync_always) {
+    if (!write_file(file_, frame.data(), frame.size())) {
+      failed_ = true;
+      throw IOError("Could not write to " + path_);
+    }
+    return;
+  }
+
+  // Group commit: the entry waits with any others that arrive while a flush
+  // is running, and whichever writer finds no flush running writes and
+  // flushes all of them
+  pending_ += frame;
+  while (synced_sequence_ < entry && !failed_) {
+    if (flushing_)
+      flushed_.wait(lock);
+    else
+      flush_pending(lock);
+  }
+  if (synced_sequence_ < entry)
+    throw IOError("Could not write to " + path_);
+}
+
+// Writes and flushes the pending entries. The lock is let go meanwhile, so
+// other writers can add the entries for the next flush.
+void WriteAheadLog::flush_pending(unique_lock<mutex>& lock) {
+  string entries;
+  entries.swap(pending_);
+  uint64_t last = sequence_;
+  flushing_ = true;
+  lock.unlock();
+  bool written = write_file(file_, entries.data(), entries.size()) && flush_file(file_);
+  lock.lock();
+  flushing_ = false;
+  if (written)
+    synced_sequence_ = last;
+  else
+    failed_ = true;
+  flushed_.notify_all();
+}
+
+void WriteAheadLog::sync_periodically() {
+  unique_lock<mutex> lock(mutex_);
+  while (!closing_) {
+    flushed_.wait_for(lock, chrono::milliseconds(options_.sync_interval_ms));
+    if (closing_)
+      break;
+    lock.unlock();
+    bool flushed = flush_file(file_);
+    lock.lock();
+    if (!flushed)
+      failed_ = true;
+  }
+}
+
+// Calls handler with the sequence number and body of each entry in data, up
+// to the end or the first torn entry, and returns where that is. Returns 0
+// if data is too short to hold the header.
+size_t WriteAheadLog::scan(const string& data, const string& path, const EntryHandler& handler) {
+  size_t magic_bytes = min<size_t>(data.size(), sizeof(magic));
+  if (data.compare(0, magic_bytes, magic, magic_bytes) != 0)
+    throw IOError(path + " is not a database log");
+  // A header cut short by a crash means the log was never written to
+  if (data.size() < header_bytes)
+    return 0;
+  uint32_t file_version;
+  memcpy(&file_version, data.data() + sizeof(magic), sizeof(file_version));
+  if (file_version != version)
+    throw IOError(path + " is a log from another version of the database");
+
+  size_t pos = header_bytes;
+  while (data.size() - pos >= entry_header_bytes) {
+    uint32_t size;
+    uint64_t sum, entry;
+    memcpy(&size, data.data() + pos, sizeof(size));
+    memcpy(&sum, data.data() + pos + 4, sizeof(sum));
+    memcpy(&entry, data.data() + pos + 12, sizeof(entry));
+    if (size > data.size() - pos - entry_header_bytes ||
+        checksum(data.data() + pos + 12, 8 + size) != sum)
+      break;
+    handler(entry, data.substr(pos + entry_header_bytes, size));
+    pos += entry_header_bytes + size;
+  }
+  return pos;
+}
+
+uint64_t WriteAheadLog::replay(const string& path, uint64_t sequence, Database& database) {
+  string data = read_file(path);
+  uint64_t last = sequence;
+  scan(data, path, [&](uint64_t entry, const string& body) {
+    if (entry <= sequence)
+      return;
+    try {
+      redo(body, database);
+    } catch (const IOError&) {
+      throw;
+    } catch (const exception& e) {
+      throw IOError("Could not redo an entry of " + path + ": " + e.what());
+    }
+    last = entry;
+  });
+  return last;
+}
+
+// Appends the rows of table from begin on, a row at a time
+void WriteAheadLog::put_rows(string& out, const Table& table, unsigned begin) {
+  unsigned rows = table.size();
+  put<uint32_t>(out, rows - begin);
+  put<uint32_t>(out, table.data_.size());
+  for (unsigned row = begin; row < rows; ++row) {
+    for (const Column& column : table.data_)
+      put_value(out, column.get_value(row));
+  }
+}
+
+// Reads rows written by put_rows and inserts them into table
+void WriteAheadLog::read_rows(EntryReader& reader, Table& table) {
+  const SchemaPtr& schema = table.schema_;
+  uint32_t count = reader.get<uint32_t>();
+  uint32_t columns = reader.get<uint32_t>();
+  if (columns != schema->size())
+    throw IOError("Log entry has rows with the wrong number of columns");
+
+  vector<Record> records;
+  records.reserve(count);
+  for (uint32_t row = 0; row < count; ++row) {
+    records.push_back(Record(schema));
+    for (uint32_t i = 0; i < columns; ++i)
+      records.back().values_.push_back(reader.get_value());
+  }
+  table.insert_batch(records);
+}
+
+void WriteAheadLog::redo(const string& body, Database& database) {
+  EntryReader reader(body);
+  uint8_t kind = reader.get<uint8_t>();
+  string name = reader.get_string();
+
+  switch (kind) {
+  case table_added_entry: {
+    Table::ColumnList columns;
+    uint32_t column_count = reader.get<uint32_t>();
+    for (uint32_t i = 0; i < column_count; ++i) {
+      string column = reader.get_string();
+      columns.push_back(make_pair(column, static_cast<Table::RecordType>(reader.get<uint8_t>())));
+    }
+    vector<string> key;
+    uint32_t key_size = reader.get<uint32_t>();
+    for (uint32_t i = 0; i < key_size; ++i)
+      key.push_back(reader.get_string());
+
+    Table* table = new Table(columns);
+    try {
+      table->set_key(key);
+      read_rows(reader, *table);
+      database.add_table(name, table);
+    } catch (...) {
+      delete table;
+      throw;
+    }
+    break;
+  }
+  case table_dropped_entry:
+    database.drop_table(name);
+    break;
+  case rows_inserted_entry: {
+    Table* table = database.table(name);
+    read_rows(reader, *table);
+    break;
+  }
+  case rows_deleted_entry:
+    database.delete_from(name, reader.get_string());
+    break;
+  case rows_updated_entry: {
+    string where = reader.get_string();
+    database.update(name, where, reader.get_string());
+    break;
+  }
+  case column_added_entry: {
+    string column = reader.get_string();
+    database.table(name)->add_column(column, static_cast<Table::RecordType>(reader.get<uint8_t>()));
+    break;
+  }
+  case column_deleted_entry:
+    database.table(name)->del_column(reader.get_string());
+    break;
+  case column_renamed_entry: {
+    string from = reader.get_string();
+    database.table(name)->rename_column(from, reader.get_string());
+    break;
+  }
+  case key_set_entry: {
+    vector<string> key;
+    uint32_t key_size = reader.get<uint32_t>();
+    for (uint32_t i = 0; i < key_size; ++i)
+      key.push_back(reader.get_string());
+    database.table(name)->set_key(key);
+    break;
+  }
+  default:
+    throw IOError("Log entry of unknown kind");
+  }
+}
+
+TableLog::TableLog() {
+  log_ = NULL;
+}
+
+TableLog::TableLog(const TableLog&) {
+  log_ = NULL;
+}
+
+TableLog& TableLog::operator=(const TableLog&) {
+  return *this;
+}
+
+void TableLog::attach(WriteAheadLog* log, const string& name) {
+  log_ = log;
+  name_ = name;
+}
+
+void TableLog::detach() {
+  log_ = NULL;
+}
+
+// Logged as dropping the table and adding it again with its new contents
+void TableLog::replaced(const Table& table) {
+  if (log_ == NULL)
+    return;
+  log_->table_dropped(name_);
+  log_->table_added(name_, table);
+}
+
+void TableLog::inserted(const Table& table, unsigned begin) {
+  if (log_ == NULL || begin >= static_cast<unsigned>(table.size()))
+    return;
+  string body = entry(rows_inserted_entry, name_);
+  WriteAheadLog::put_rows(body, table, begin);
+  log_->append(body);
+}
+
+void TableLog::deleted(const string& where) {
+  if (log_ == NULL)
+    return;
+  string body = entry(rows_deleted_entry, name_);
+  put_string(body, where);
+  log_->append(body);
+}
+
+void TableLog::updated(const string& where, const string& set) {
+  if (log_ == NULL)
+    return;
+  string body = entry(rows_updated_entry, name_);
+  put_string(body, where);
+  put_string(body, set);
+  log_->append(body);
+}
+
+void TableLog::column_added(const string& name, RecordType type) {
+  if (log_ == NULL)
+    return;
+  string body = entry(column_added_entry, name_);
+  put_string(body, name);
+  put<uint8_t>(body, type);
+  log_->append(body);
+}
+
+void TableLog::column_deleted(const string& name) {
+  if (log_ == NULL)
+    return;
+  string body = entry(column_deleted_entry, name_);
+  put_string(body, name);
+  log_->append(body);
+}
+
+void TableLog::column_renamed(const string& from, const string& to) {
+  if (log_ == NULL)
+    return;
+  string body = entry(column_renamed_entry, name_);
+  put_string(body, from);
+  put_string(body, to);
+  log_->append(body);
+}
+
+void TableLog::key_set(const vector<string>& column_names) {
+  if (log_ == NULL)
+    return;
+  string body = entry(key_set_entry, name_);
+  put<uint32_t>(body, column_names.size());
+  for (const string& column : column_names)
+    put_string(body, column);
+  log_->append(body);
+}
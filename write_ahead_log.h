@@ -0,0 +1,129 @@
+#ifndef WRITE_AHEAD_LOG_H_
+#define WRITE_AHEAD_LOG_H_
+#pragma warning(disable: 4251)
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+using namespace std;
+
+#include "exception.h"
+#include "database.h"
+
+class EntryReader;
+
+/**
+ * An append-only log of the changes made to a Database, which recover()
+ * redoes on top of the last snapshot after a crash (see Database::open_log()).
+ *
+ * Changes are logged as statements: the rows inserted, the where and set
+ * clauses of deletes and updates, and changes to tables and columns. Each
+ * entry has a sequence number, and a snapshot records the last one it
+ * includes, so replay() skips what the snapshot already has. The file holds
+ *   - the magic "DBT7WLOG" and the format version
+ *   - the entries, each the size of its body, a checksum of its sequence
+ *     number and body, its sequence number, and the body
+ *
+ * An entry cut short by a crash fails its checksum. replay() stops at the
+ * first such entry, and opening the log cuts it and anything after it off.
+ *
+ * Entries can be appended from several threads at once. With
+ * LogOptions::sync_always, the entries that arrive while a flush is running
+ * are written and flushed together by the next one (group commit), so a
+ * flush is paid per batch of writers rather than per change.
+ */
+class WriteAheadLog {
+public:
+  /** The format version written to the file. */
+  static const uint32_t version = 1;
+
+  /**
+   * Opens the log at \a path for appending, creating it if needed, and cuts
+   * off a torn entry at its end. New entries are numbered after the last one
+   * in the file, or after \a sequence if that is larger.
+   * Throws an \a IOError if the file cannot be opened or is not a log.
+   */
+  WriteAheadLog(const string& path, const LogOptions& options, uint64_t sequence);
+
+  /** Flushes the log to disk and closes it. */
+  ~WriteAheadLog();
+
+  /** The sequence number of the last entry appended. */
+  uint64_t sequence() const;
+
+  /**
+   * Empties the log, once a snapshot holds everything in it. Numbering
+   * carries on where it was.
+   * Throws an \a IOError if the file cannot be truncated.
+   */
+  void truncate();
+
+  /** Logs that \a table was added to the database as \a name, with its rows. */
+  void table_added(const string& name, const Table& table);
+  /** Logs that the table \a name was dropped. */
+  void table_dropped(const string& name);
+
+  /**
+   * Appends \a body as the next entry. Returns once the entry is as durable
+   * as the LogOptions ask for.
+   * Throws an \a IOError if the entry cannot be written, and for every entry
+   * after that.
+   */
+  void append(const string& body);
+
+  /**
+   * Redoes the entries of the log at \a path numbered after \a sequence on
+   * \a database, and returns the number of the last one (or \a sequence if
+   * there are none). A missing file is an empty log.
+   * Throws an \a IOError if the file is not a log or an entry cannot be
+   * redone.
+   */
+  static uint64_t replay(const string& path, uint64_t sequence, Database& database);
+
+private:
+  friend class TableLog;
+
+  WriteAheadLog(const WriteAheadLog&);
+  WriteAheadLog& operator=(const WriteAheadLog&);
+
+  typedef function<void(uint64_t, const string&)> EntryHandler;
+  static size_t scan(const string& data, const string& path, const EntryHandler& handler);
+  static void redo(const string& body, Database& database);
+  static void put_rows(string& out, const Table& table, unsigned begin);
+  static void read_rows(EntryReader& reader, Table& table);
+  void flush_pending(unique_lock<mutex>& lock);
+  void sync_periodically();
+
+  string path_;
+  LogOptions options_;
+  int file_;
+
+  mutable mutex mutex_;
+  // Signalled when a flush finishes, and when the log is closing
+  condition_variable flushed_;
+  uint64_t sequence_;
+  // Entries appended but not yet written, under sync_always
+  string pending_;
+  // Whether a thread is writing and flushing entries, and the last entry
+  // that is on disk
+  bool flushing_;
+  uint64_t synced_sequence_;
+  // Set once writing fails. A later entry could depend on the lost one, so
+  // the log takes no more.
+  bool failed_;
+
+  // Flushes the file under sync_interval
+  thread sync_thread_;
+  bool closing_;
+};
+
+/**
+ * Flushes the file or directory at \a path to disk.
+ * Throws an \a IOError if it cannot be opened or flushed.
+ */
+void sync_file(const string& path);
+
+#endif  // WRITE_AHEAD_LOG_H_